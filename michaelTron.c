@@ -17,10 +17,33 @@
 #include <stdarg.h>
 #include <fcntl.h>
 #include <time.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 /*** Definitions ***/
 #define CTRL_KEY(k) ((k) & 0x1f)
 #define MICHAEL_TRON_VER "1.0"
+#define DEFAULT_TICK_RATE 10    // simulation steps per second
+#define MAX_TICK_RATE 1000
+#define MAX_CATCHUP_TICKS 4     // after a stall (e.g. Ctrl-Z) don't fast forward the game
 
 enum keys {
     BACKSPACE = 127,
@@ -55,524 +78,6988 @@ enum keys {
 typedef enum gameState {
     START_SCREEN,
     IN_GAME,
-    PLAYER1_WIN,
-    PLAYER2_WIN,
-    DRAW
+    GAME_OVER       // tron.winner says who, -1 for a draw
 } gameState;
 
+// who is steering a cycle
+typedef enum aiEngine {
+    AI_NONE,        // a human at the keyboard
+    AI_CHASER,      // computerMakeMove, greedy chaser ("easy")
+    AI_MINIMAX,     // minimaxMakeMove, alpha-beta search ("hard")
+    AI_MCTS,        // mctsMakeMove, multi-threaded Monte Carlo tree search
+    AI_BOT          // botMakeMove, an outside program (--bot CMD) over pipes
+} aiEngine;
+
+// what sits on a board cell, one byte per cell. Cycle i's trail is CELL_CYCLE + 2 * i and its
+// head the value after, so the owner of any cell is a shift away.
+typedef enum cellType {
+    CELL_EMPTY,
+    CELL_WALL,
+    CELL_CYCLE
+} cellType;
+
+#define MAX_CYCLES 126      // the last head is 253, glyph codes above that are the renderer's
+#define MAX_HUMANS 2        // WASD and the arrow keys
+#define MAX_QUEUED_TURNS 4  // turns pressed faster than ticks wait here, one is taken per tick
+static inline uint8_t trailCell(int i) { return CELL_CYCLE + 2 * i; }
+static inline uint8_t headCell(int i) { return CELL_CYCLE + 2 * i + 1; }
+static inline bool isHeadCell(uint8_t cell) { return cell >= CELL_CYCLE && ((cell - CELL_CYCLE) & 1); }
+static inline int cellOwner(uint8_t cell) { return (cell - CELL_CYCLE) >> 1; }
+
 typedef struct lightCycle {
     int posX;
     int posY;
     int dirX;
     int dirY;
+    int lastDirX;   // heading actually moved on the last tick, turns are checked against this
+    int lastDirY;
     bool alive;
+    aiEngine engine;
 } lightCycle;
 
+// a human's turns in the order they were pressed, with when they were read
+typedef struct turnBuffer {
+    int8_t dirX[MAX_QUEUED_TURNS];
+    int8_t dirY[MAX_QUEUED_TURNS];
+    uint64_t readNs[MAX_QUEUED_TURNS];
+    int count;
+} turnBuffer;
+
+// Zobrist keys come from a mixer instead of a table, so a key costs no memory however big the
+// board is. A position's key is the XOR of one key per occupied cell plus the head cell and
+// heading of every live cycle. Kinds keep the key families apart, cycles get one each.
+#define ZOBRIST_OCCUPIED 0
+#define ZOBRIST_HEAD 1                                  // + cycle index
+#define ZOBRIST_HEADING (ZOBRIST_HEAD + MAX_CYCLES)     // + cycle index
+#define ZOBRIST_SEARCHER (ZOBRIST_HEADING + MAX_CYCLES) // whose point of view a score is from
+
+// Transposition table shared by every search in the process, tournament workers included.
+// Slots are written without locks: a slot holds data and key ^ data, so one another thread
+// tore in half doesn't check out and reads as a miss.
+typedef struct ttSlot {
+    _Atomic uint64_t check;
+    _Atomic uint64_t data;  // score, depth, bound, best move and generation, see ttStore
+} ttSlot;
+
+typedef struct transTable {
+    ttSlot * slots;
+    uint64_t mask;          // slot count - 1, a power of two
+    atomic_uint generation; // bumped by every search, older entries give way first
+} transTable;
+
+typedef enum { TT_NONE = 0, TT_EXACT, TT_LOWER, TT_UPPER } ttBound;
+
+typedef struct ttEntry {
+    int score;
+    int depth;              // plies searched below the position, 0 for a leaf evaluation
+    ttBound bound;
+    int move;
+} ttEntry;
+
+// The bit planes sweep every row the fronts have been to on every pass, so on a big board a kernel
+// without AVX2 loses to the cell by cell BFS (scalar and SSE2 on 200x600). The first leaves a
+// search scores take turns between the two, timed, and the faster one scores the rest.
+#define VORONOI_TRIALS 32
+
+#define TT_DEFAULT_MB 16
+#define TT_BENCH_SAMPLE 64  // headless: every this many ticks a position is searched again at a
+#define TT_BENCH_DEPTH 3    // fixed depth with and without a table, for the speedup
+
+// scratch space for minimaxMakeMove, allocated the first time a search runs
+typedef struct searchContext {
+    uint64_t * occ;         // private copy of the occupied plane the search scribbles on
+    int numWords;
+    int stride;             // bits per board row, cells are addressed as y * stride + x
+    int myBit;
+    int oppBit;
+    struct floodPlanes * flood; // voronoiScore's bit planes
+    int trials;             // leaves scored both ways in turn so far, see VORONOI_TRIALS
+    uint64_t trialNs[2];    // what they took, bit planes and BFS
+    bool scoreByBfs;        // the BFS won, on boards too big for a narrow kernel's passes
+    long separated;         // leaves where the cycles were walled off from each other, per search like nodes
+    int * queue;            // scratch for voronoiScoreBfs, allocated the first time it runs
+    int * dist;
+    uint8_t * owner;
+    uint32_t * visited;     // generation stamps so the BFS arrays never need clearing
+    uint32_t generation;
+    uint64_t deadline;
+    int clockCountdown;     // nodes left until the next look at the clock
+    uint64_t leafNs;        // the slower end of what leaves have been taking, one that wouldn't finish in time isn't started
+    bool outOfTime;
+    long nodes;
+    int depthReached;
+
+    uint64_t hash;          // Zobrist key of the position being searched
+    int me;                 // cycle indices, for their head keys
+    int opp;
+    transTable * tt;        // NULL searches without one
+    uint8_t ttGeneration;
+    long ttProbes;          // for the benchmark, per search like nodes
+    long ttHits;
+    long ttCutoffs;         // hits that answered a node without searching it
+} searchContext;
+
+// Monte Carlo tree node. Each side keeps UCB statistics for its own three relative moves,
+// children are indexed by the joint move (mine * 3 + theirs).
+typedef struct mctsNode {
+    int32_t child[9];
+    uint32_t visits;
+    uint32_t myVisits[3];
+    uint32_t oppVisits[3];
+    float myValue[3];
+    float oppValue[3];
+} mctsNode;
+
+struct mctsContext;
+
+typedef struct mctsWorker {
+    struct mctsContext * ctx;
+    pthread_t thread;
+    uint64_t * occ;         // own copy of the occupied plane
+    int * touched;          // bits set during the current iteration, cleared afterwards
+    int numTouched;
+    mctsNode * nodes;       // preallocated tree, reset every move
+    int numNodes;
+    uint32_t rng;
+    long playouts;
+} mctsWorker;
+
+// a pool of workers that sleep between moves, kept for the life of the game
+typedef struct mctsContext {
+    int numWorkers;
+    mctsWorker * workers;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    int jobId;
+    int running;
+    bool quit;
+
+    // the position being searched, read only while workers run
+    const uint64_t * rootOcc;
+    int numWords;
+    int stride;
+    int myBit;
+    int oppBit;
+    int myDir;
+    int oppDir;
+    uint64_t deadline;
+
+    atomic_long rootVisits[3];
+    atomic_long rootScore[3];
+    atomic_long playouts;
+} mctsContext;
+
+#define MCTS_MAX_NODES (1 << 16)
+#define MCTS_MAX_PLIES 512
+#define MCTS_EXPLORATION 1.4f
+
+#define SEARCH_INF 0x3fffffff
+#define SEARCH_WIN 1000000
+#define SEARCH_MAX_DEPTH 64
+#define SEARCH_DECIDED (SEARCH_WIN - 2 * SEARCH_MAX_DEPTH - 2) // past this a score is a crash ply plies away
+#define SEARCH_CLOCK_NODES 64   // interior nodes and table answered leaves between looks at the clock
+
+// Shortest path distance from a cycle's head over empty cells, for computerMakeMove. Only the
+// cycles somebody asks about get one. Stored as arrival turns (numTurn + distance) so a cycle
+// moving along a shortest path leaves its own field alone, only cells whose paths ran through
+// the new heads need repairing. That's still everything whose path left the old head sideways,
+// about a tenth of an open board's field every tick, so a repair only beats a rebuild by a
+// fraction and make bench prints both.
+typedef struct distanceFields {
+    uint32_t * arrival[MAX_CYCLES]; // boardRows * boardCols, DIST_UNREACHABLE if blocked or cut off
+    int turn[MAX_CYCLES];           // numTurn each field describes, -1 forces a rebuild
+    int reachable[MAX_CYCLES];      // finite cells in each field
+    int backoff[MAX_CYCLES];        // ticks left to rebuild outright after a repair gave up
+    uint64_t * orphans;     // (old arrival << 32 | cell) of cells a repair invalidated, then its seeds
+    int * queue;            // BFS scratch
+    long repaired;          // for the benchmark: cells recomputed by repairs, repairs that
+    long repairs;           // finished, and single field rebuilds
+    long rebuilds;
+} distanceFields;
+
+#define DIST_UNREACHABLE UINT32_MAX
+#define DIST_MAX_ORPHAN_FRACTION 8   // orphaning more of a field than this loses to a plain BFS
+#define DIST_BACKOFF_TICKS 8         // and on a board that open the next few ticks won't be better
+
+// --arena boards live in 64x64 chunks allocated the first time something is drawn on them,
+// so empty space costs nothing and memory grows with the trails instead of the arena
+#define ARENA_CHUNK_BITS 6
+#define ARENA_CHUNK (1 << ARENA_CHUNK_BITS)
+#define ARENA_MAX_SIDE 1000000  // keeps chunk keys and dirty cell maths in 32 bits
+#define ARENA_SPAWN_ROWS 40     // cycles start in a box this big around the middle, scaled
+#define ARENA_SPAWN_COLS 120    // up with the player count
+#define ARENA_EMPTY_KEY UINT64_MAX
+
+typedef struct arenaChunk {
+    uint64_t occupied[ARENA_CHUNK]; // a word per row
+    uint8_t cells[ARENA_CHUNK * ARENA_CHUNK];
+} arenaChunk;
+
+// open addressing from chunk coordinates to chunks, kept at most half full
+typedef struct arenaMap {
+    uint64_t * keys;        // chunkY << 32 | chunkX, ARENA_EMPTY_KEY for a free slot
+    arenaChunk ** chunks;
+    int capacity;           // a power of two
+    int numChunks;
+    uint64_t lastKey;       // lookups cluster around the heads, the last hit is checked first
+    arenaChunk * last;
+    arenaChunk ** spare;    // chunks of earlier games, reused before allocating more
+    int numSpare;
+    int spareCap;
+} arenaMap;
+
+typedef struct abuf {
+    char* b;
+    int len;
+    int cap;
+} abuf;
+
+#define MAX_DIRTY_CELLS (4 * MAX_CYCLES)  // more than a tick can touch, overflow just forces a full repaint
+#define MAX_GLYPH_BYTES 11  // "\x1b[0;7;96m ", a trail cell in a new colour
+#define MAX_SGR_BYTES 10
+#define NUM_COLORS 12       // cycle colours, they repeat past that
+#define NUM_ATTRS (2 + 2 * NUM_COLORS) // default, crashed, then trail and head of every colour
+#define ATTR_DEFAULT 0
+#define ATTR_DEAD 1
+#define ATTR_UNKNOWN -1     // whatever some other write left the terminal in
+#define BLANK_RUN_MIN 12    // from here on erase + cursor forward beats writing the spaces
+#define MAX_CURSOR_MOVE_BYTES 24
+#define MOVE_CLAIM_BITS 8
+#define MOVE_CLAIM_SLOTS (1 << MOVE_CLAIM_BITS) // at least twice MAX_CYCLES so probes stay short
+#define FRAME_STATUS_SIZE 256
+
+// makeTick's record of a tick, enough for unmakeTick to put back exactly what was there. Cells
+// aren't stored: a cycle that moved left a trail behind and put its head on an empty cell.
+typedef struct undoCycle {
+    int cycle;              // one per cycle alive going into the tick
+    int posX;
+    int posY;
+    int dirX;
+    int dirY;
+    int lastDirX;
+    int lastDirY;
+    bool moved;             // took its step, rather than crashing where it stood
+} undoCycle;
+
+typedef struct undoEntry {
+    uint64_t hash;
+    gameState curState;
+    int winner;
+    int numDirty;           // the renderer's too, a search's ticks never reach the screen
+    bool fullRepaint;
+    int firstCycle;         // where its undoCycles start
+    int numCycles;
+} undoEntry;
+
+typedef struct undoStack {
+    undoEntry * entries;
+    undoCycle * cycles;
+    int top;
+    int maxTicks;
+    int numCycles;          // undoCycles in use by the entries below top
+    int maxCycles;
+} undoStack;
+
+#define UNDO_MAX_TICKS 256  // deeper than any search looks
+#define MAKE_BENCH_DEPTH 5  // --bench-make walks every joint move this many ticks deep
+#define MAKE_BENCH_POSITIONS 32
+
 typedef struct tron {
-    char ** gameBoard;
+    uint8_t * cells;        // boardRows * boardCols cellTypes in one block, row major
+    uint64_t * occupied;    // one bit per non-empty cell, every row starts on a fresh word
+    arenaMap * arena;       // chunked storage instead of the two above for --arena, else NULL
+    int wordsPerRow;
     int boardRows;
     int boardCols;
     
-    lightCycle player1;
-    lightCycle player2;
+    lightCycle cycles[MAX_CYCLES];
+    int numCycles;          // 2 unless --players says otherwise, at most MAX_CYCLES
+    int claims[MOVE_CLAIM_SLOTS]; // moveCycles' hash of next cells, cycle index + 1 or 0
 
     gameState curState;
+    int winner;             // index of the last cycle standing, -1 for a draw
     
     bool singlePlayer;
     int numTurn;
+    uint64_t hash;          // Zobrist key of the board and cycles, kept by setCell and the cycle
+                            // updates. Not kept on --arena boards, nothing searches those
+
+    uint32_t rngState;      // per game so headless runs are reproducible from a seed
+    bool randomStart;       // scatter the cycles instead of the fixed start positions
+
+    aiEngine computerEngine;    // what takes over player 2 in single player, C cycles it
+    uint64_t aiBudgetNs;        // how long a search may think per tick
+    int aiThreads;              // size of the MCTS worker pool, counting the calling thread
+    searchContext * search;
+    transTable * tt;            // shared with other trons searching in the process, NULL for none
+    mctsContext * mcts;
+    distanceFields * distance;  // allocated the first time the chaser runs
+
+    struct recorder * recorder; // writes a replay of every match when set
+    struct profiler * prof;     // phase timings for the HUD and --trace, NULL when neither is on
+    struct spectatorServer * spectators; // --spectate, gets every frame drawScreen writes
+    struct botHub * bots;       // --bot, the outside programs driving AI_BOT cycles
+    undoStack * undo;           // makeTick's, allocated the first time it runs
+
+    // keyboard, see gameLoop()
+    turnBuffer turns[MAX_HUMANS];
+    bool showInputLag;      // --input-stats puts the numbers below in the instruction bar
+    long lagTurns;          // turns applied, and how long they waited between read() and their tick
+    uint64_t lagTotalNs;
+    uint64_t lagMaxNs;
+
+    // renderer bookkeeping, see drawScreen()
+    int viewTop;            // the window of the board that's on screen, all of it unless --arena
+    int viewLeft;
+    int viewRows;
+    int viewCols;
+    int follow;             // the cycle the window keeps in sight
+    // The simulation's half: what the window should show, turned into snapshots by snapshotTake
+    int * dirtyCells;       // y * viewCols + x, window relative, of cells touched since last frame
+    int numDirty;
+    bool fullRepaint;       // set on state changes, the next frame then redraws everything
+    uint8_t * viewGlyphs;   // glyph code of every cell in the window as of the last snapshot
+    uint64_t * rowsChanged; // rows of viewGlyphs changed since the last snapshot, one bit each
+    long frameSeq;          // snapshots taken, and the last that wanted a full repaint or a new status bar
+    long fullSeq;
+    long statusSeq;
+    int statusLen;
+    char statusText[FRAME_STATUS_SIZE]; // as of statusSeq
+    struct frameSnapshot * snapshot; // buildFrame's, when there's no render thread
+    struct renderThread * render;    // gameLoop's, the only thing drawing while it's running
+    atomic_long framesDropped;       // snapshots replaced before anyone drew them, counted by the drawing side
+
+    // The drawing half, only ever touched by whoever draws, the render thread when there is one
+    uint8_t * shadowBoard;  // glyph code of every cell in the window as of the last frame written
+    long drawnSeq;          // snapshot the screen shows
+    abuf frame;             // reused by every drawScreen, sized once by frameInit
+    char glyphChar[256];    // what each glyph code prints, see glyphInit
+    uint8_t glyphAttr[256]; // and in which attributes
+    char attrBytes[NUM_ATTRS][MAX_SGR_BYTES + 1]; // SGR getting there from any state
+    uint8_t attrLen[NUM_ATTRS];
+    int frameAttr;          // attributes the terminal will be in at this point of the frame
 } tron;
 
+
 /*** Tron Functions ***/
-void gameInit(tron * this);
+void gameInit(tron * this, int rows, int cols);
+void boardGameInit(tron * this, int rows, int cols, int viewRows, int viewCols);
+void arenaGameInit(tron * this, int rows, int cols, int viewRows, int viewCols);
+void spawnGrid(int rows, int cols, int numCycles, int * blockCols, int * blockRows);
+void spawnArea(int rows, int cols, int numCycles, bool arena, int * top, int * left, int * areaRows, int * areaCols);
+bool spawnFits(int rows, int cols, int numCycles);
+void placeCycles(tron * this);
 void gameStart(tron * this);
+void gameBegin(tron * this);
 void makeBorder(tron * this);
 
-bool updateCyclePos(tron * this, int playerNum);
-void computerMakeMove(tron* this);
+void gameTick(tron * this);
+void computerMoves(tron * this);
+void moveCycles(tron * this);
+void stepCycles(tron * this);
+undoStack * undoInit(int maxTicks, int maxCycles);
+bool makeTick(tron * this);
+void unmakeTick(tron * this);
+void updateCyclePos(tron * this, int i);
+void killCycle(tron * this, int i);
+void steerCycle(lightCycle * cycle, int dirX, int dirY);
+int nearestOpponent(tron * this, int i);
+void computerMakeMove(tron* this, int i);
 void deathHandler(tron* this);
 bool crashChecker(int nextX, int nextY, tron * this);
+void markDirty(tron * this, int x, int y);
+
+uint32_t tronRand(tron * this);
+
+void setCell(tron * this, int x, int y, uint8_t type);
+void rebuildOccupied(tron * this);
+arenaMap * arenaMapInit(void);
+arenaChunk * arenaChunkAt(arenaMap * map, int x, int y, bool create);
+void arenaClear(arenaMap * map);
+long arenaBytes(arenaMap * map);
+long arenaTrailCells(arenaMap * map);
+uint8_t arenaGetCell(tron * this, int x, int y);
+bool arenaIsOccupied(tron * this, int x, int y);
+static inline uint8_t getCell(tron * this, int x, int y) {
+    if (this->arena != NULL) return arenaGetCell(this, x, y);
+    return this->cells[y * this->boardCols + x];
+}
+static inline bool isOccupied(tron * this, int x, int y) {
+    if (this->arena != NULL) return arenaIsOccupied(this, x, y);
+    return (this->occupied[y * this->wordsPerRow + (x >> 6)] >> (x & 63)) & 1;
+}
+static inline uint64_t * occupiedRow(tron * this, int y) {
+    return &this->occupied[y * this->wordsPerRow];
+}
+// splitmix64 of the index and the key family, see ZOBRIST_OCCUPIED
+static inline uint64_t zobristKey(uint64_t index, int kind) {
+    uint64_t z = (index << 8 | (uint64_t) kind) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+// a live cycle's share of the key, cells are numbered like bits of the occupied plane
+static inline uint64_t zobristHead(int i, uint64_t bit, int dir) {
+    return zobristKey(bit, ZOBRIST_HEAD + i) ^ zobristKey((uint64_t) dir, ZOBRIST_HEADING + i);
+}
+static inline uint64_t cycleBit(tron * this, int i) {
+    return (uint64_t) this->cycles[i].posY * this->wordsPerRow * 64 + (uint64_t) this->cycles[i].posX;
+}
+uint64_t zobristRebuild(tron * this);
+
+/*** Distance fields ***/
+distanceFields * distanceFieldsInit(tron * this);
+void distanceFieldsInvalidate(distanceFields * df);
+void distanceFieldSync(tron * this, int i);
+void distanceFieldBfs(tron * this, int i);
+bool distanceFieldRepair(tron * this, int i);
+// O(1) once synced, DIST_UNREACHABLE when walls and trails cut the cell off from that cycle
+static inline uint32_t cycleDistance(tron * this, int i, int x, int y) {
+    uint32_t arrival = this->distance->arrival[i][y * this->boardCols + x];
+    return arrival == DIST_UNREACHABLE ? arrival : arrival - (uint32_t) this->numTurn;
+}
+
+/*** Flood fill ***/
+// Voronoi and reachable area a whole distance layer at a time, over bit planes laid out like
+// tron.occupied: a pass grows both sides by one step with shifts, ANDs and ORs on whole words,
+// four at a time with AVX2 and two with SSE2. Rows start on fresh words and the border walls keep
+// anything from running off one row into the next, so a plane is one long bit string where left
+// and right are one bit shifts and up and down are wordsPerRow words away.
+typedef struct floodPlanes floodPlanes;
+typedef void (*floodPassFn)(floodPlanes * fp, const uint64_t * occ, int cur, int from, int to, uint64_t * grew, uint64_t * touched);
+
+struct floodPlanes {
+    int wordsPerRow;
+    int rows;
+    uint64_t * mine[2];     // what each side has, double buffered so a pass only grows the last layer
+    uint64_t * theirs[2];
+    uint64_t * claimed;     // free cells taken by either side or tied, walls and trails are in occ
+    floodPassFn pass;       // the widest the CPU has
+    long passes;            // for --bench-flood
+};
+
+typedef struct floodResult {
+    int mine;               // free cells each head gets to first, tied ones go to nobody
+    int theirs;
+    bool separated;         // none of their cells touch, each has all the room it can reach to itself
+} floodResult;
+
+floodPlanes * floodInit(int wordsPerRow, int rows);
+void floodVoronoi(floodPlanes * fp, const uint64_t * occ, int stride, int myBit, int oppBit, floodResult * r);
+int floodArea(floodPlanes * fp, const uint64_t * occ, int stride, int bit);
+floodPassFn floodPassBest(void);
+const char * floodPassName(floodPassFn pass);
+void floodPassScalar(floodPlanes * fp, const uint64_t * occ, int cur, int from, int to, uint64_t * grew, uint64_t * touched);
+#if defined(__x86_64__) || defined(__i386__)
+void floodPassSse2(floodPlanes * fp, const uint64_t * occ, int cur, int from, int to, uint64_t * grew, uint64_t * touched);
+void floodPassAvx2(floodPlanes * fp, const uint64_t * occ, int cur, int from, int to, uint64_t * grew, uint64_t * touched);
+#endif
+
+/*** Search AI ***/
+void aiMakeMove(tron * this, int i);
+const char * engineName(aiEngine engine);
+aiEngine parseEngine(const char * name);
+searchContext * searchInit(tron * this);
+void minimaxMakeMove(tron * this, int i);
+int voronoiScore(searchContext * ctx, int myBit, int oppBit);
+int voronoiScoreBfs(searchContext * ctx, int myBit, int oppBit, bool * separated);
+const char * voronoiScorerName(searchContext * ctx);
+int dirIndex(int dirX, int dirY);
+int searchMax(searchContext * ctx, int depth, int ply, int myDir, int oppDir, int alpha, int beta);
+int searchMin(searchContext * ctx, int depth, int ply, int myDir, int myMove, int oppDir, int alpha, int beta);
+int searchLeaf(searchContext * ctx);
+int minimaxSearch(tron * this, int i, int maxDepth, uint64_t budgetNs);
+transTable * ttInit(int megabytes);
+bool ttProbe(transTable * tt, uint64_t key, ttEntry * e);
+void ttStore(transTable * tt, uint64_t key, int depth, int score, ttBound bound, int move, uint8_t generation);
+
+/*** Monte Carlo AI ***/
+mctsContext * mctsInit(tron * this, int numWorkers);
+void * mctsWorkerMain(void * arg);
+void mctsSearch(mctsWorker * w);
+void mctsMakeMove(tron * this, int i);
+
+/*** Replay ***/
+#define REPLAY_MAGIC "MTRP"
+#define REPLAY_VERSION 2
+#define REPLAY_HEADER_BYTES 54
+#define REPLAY_KEYFRAME_INTERVAL 256
+#define REPLAY_FPS 60
+#define REPLAY_SEEK_STEP 50
+
+typedef struct recorder {
+    const char * path;      // first match goes here, later ones get .2, .3, ...
+    int matchNumber;
+    int tickRate;
+    uint32_t seed;          // rng state the match started from
+    abuf moves;             // 2 bits per cycle per tick
+    abuf keyframes;
+    abuf keyframeTable;     // (tick u32, offset into keyframes u64) per keyframe
+    int numKeyframes;
+    int numTicks;
+} recorder;
+
+// a whole recording loaded into memory
+typedef struct replay {
+    uint8_t * data;
+    long size;
+    int rows;
+    int cols;
+    int tickRate;
+    int numCycles;
+    int winner;             // -1 for a draw
+    uint32_t numTicks;
+    uint32_t keyframeInterval;
+    uint32_t numKeyframes;
+    const uint8_t * moves;
+    const uint8_t * keyframes;
+    uint64_t keyframesLen;
+    const uint8_t * table;
+} replay;
+
+typedef struct replayReader {
+    const uint8_t * p;
+    const uint8_t * end;
+    bool bad;
+} replayReader;
+
+recorder * recorderInit(const char * path, int tickRate);
+void recorderBegin(tron * this);
+void recorderTick(tron * this);
+void recorderKeyframe(tron * this);
+void recorderFinish(tron * this);
+bool replayLoad(replay * rp, const char * path);
+int replayFindKeyframe(replay * rp, int tick);
+bool replayRestoreKeyframe(replay * rp, tron * this, int k);
+void replayStep(replay * rp, tron * this);
+void replaySeek(replay * rp, tron * this, int tick);
 
 /*** Input & Output ***/
-void processKeypress(tron * tronGame);
+// Keys are read on their own thread and handed over through a single producer, single consumer
+// ring, so a burst from two players on one keyboard is never cut short by the tick.
+#define INPUT_QUEUE_SIZE 256    // a power of two
 
-typedef struct abuf {
-    char* b;
-    int len;
-} abuf;
+typedef struct inputEvent {
+    int key;
+    uint64_t readNs;        // CLOCK_MONOTONIC when the bytes came off stdin
+} inputEvent;
+
+typedef struct inputQueue {
+    inputEvent events[INPUT_QUEUE_SIZE];
+    _Atomic uint32_t head;  // only the input thread writes this
+    _Atomic uint32_t tail;  // only the game thread writes this
+    atomic_long dropped;    // keys lost to a full ring
+    int wakeFd;             // eventfd the input thread pokes after pushing
+    pthread_t thread;
+} inputQueue;
+
+void inputStart(inputQueue * q);
+void * inputThreadMain(void * arg);
+bool inputPush(inputQueue * q, int key, uint64_t readNs);
+bool inputPop(inputQueue * q, inputEvent * ev);
+void gameLoop(tron * tronGame, int tickRate);
+void processKeypress(tron * tronGame, int c, uint64_t readNs);
+void queueTurn(tron * tronGame, int player, int dirX, int dirY, uint64_t readNs);
+void applyQueuedTurns(tron * tronGame);
 
-#define ABUF_INIT {NULL, 0}
+#define ABUF_INIT {NULL, 0, 0}
+void abInit(struct abuf * ab, int cap);
 void abAppend(struct abuf* ab, const char* s, int len);
 void abFree(struct abuf* ab) {free(ab->b);}
+int writeAll(int fd, const char * buf, int len);
+bool readAll(int fd, void * buf, int len);
+
+void frameInit(tron * this);
+void viewFollow(tron * this);
+void viewCenter(tron * this);
+void viewMove(tron * this, int left, int top);
+void buildFrame(tron * this);
+uint8_t cellGlyph(tron * this, int x, int y);
+int statusBarText(tron * this, char * buf, int size);
+void drawGlyph(tron * this, struct abuf * ab, uint8_t glyph);
+void drawRow(tron * this, struct abuf * ab, const uint8_t * glyphs, int n);
+void setAttr(tron * this, struct abuf * ab, int attr);
+char cycleLabel(int i);
+void glyphInit(tron * this);
+
+// glyph codes are cell values, plus these two
+#define GLYPH_DEAD 0xff     // a crashed head, red X
+#define GLYPH_UNKNOWN 0xfe  // shadowBoard: something else is on screen there
+
+/*** Render thread ***/
+// Everything a frame needs from the game, so drawing never reads the tron the simulation is busy
+// changing. gameLoop's simulation fills one while the render thread draws another, and the two
+// trade through renderThread.pending: a slow terminal costs frames, never ticks. A snapshot
+// nobody drew before a newer one replaced it is dropped, the seq numbers let the next one
+// make up for it.
+typedef struct frameSnapshot {
+    uint8_t * glyphs;       // viewRows * viewCols, window relative
+    uint64_t * rowsChanged; // rows that differ from snapshot seq - 1
+    long seq;
+    long fullSeq;           // the latest snapshot up to this one that wanted a full repaint
+    long statusSeq;         // and a new status bar
+    gameState curState;     // for the message overlay
+    int winner;
+    int statusLen;
+    char status[FRAME_STATUS_SIZE]; // instruction bar or HUD, without the attributes around it
+    struct profiler * prof; // build and write timings go here, NULL when nothing wants them
+} frameSnapshot;
+
+#define RENDER_BUFFERS 3
+#define RENDER_FRESH 0x100  // on renderThread.pending: published since the renderer last took one
+
+typedef struct renderThread {
+    frameSnapshot buffers[RENDER_BUFFERS];
+    int back;               // the simulation's, renderPublish fills it
+    int front;              // the render thread's, what it drew last
+    atomic_int pending;     // the third, | RENDER_FRESH when it's newer than front
+    int wakeFd;             // eventfd poked after every publish
+    atomic_bool stop;
+    pthread_t thread;
+} renderThread;
+
+void snapshotInit(tron * this, frameSnapshot * snap);
+bool snapshotTake(tron * this, frameSnapshot * snap);
+void frameBuild(tron * this, const frameSnapshot * snap, struct abuf * ab);
+void drawScreen(tron * this, const frameSnapshot * snap);
+void drawChangedRows(tron * this, struct abuf * ab, const frameSnapshot * snap, bool allRows);
+void drawFullScreen(tron * this, struct abuf * ab, const frameSnapshot * snap);
+void drawStatusBar(tron * this, struct abuf * ab, const frameSnapshot * snap);
+void renderStart(tron * this);
+void renderPublish(tron * this);
+void renderStop(tron * this);
+void * renderThreadMain(void * arg);
+
+/*** Headless & benchmark ***/
+typedef struct options {
+    int tickRate;
+    bool headless;
+    int rows;
+    int cols;
+    int games;
+    int players;            // cycle 1 is the human (or chaser headless), the rest are --ai
+    int arenaRows;          // --arena RxC, 0 for a board the size of the terminal (or --rows/--cols,
+    int arenaCols;          // which become the window onto the arena headless)
+    uint32_t seed;
+    aiEngine ai;
+    int aiBudgetMs;
+    int aiThreads;
+    int ttMb;               // transposition table for minimax, 0 for none
+
+    bool tournament;
+    const char * selfPlayFile; // --selfplay, tournament style games written out as training data
+    aiEngine p1;            // tournament engines, results are reported from p1's side
+    aiEngine p2;
+    int threads;
+    bool json;
+    const char * output;
+
+    const char * recordFile;
+    const char * replayFile;
+    double replaySpeed;
+
+    bool netHost;           // --host PORT
+    int netPort;
+    const char * netJoin;   // --join HOST:PORT
+    int netDelayMs;         // extra latency on everything we send, for trying rollback on loopback
+
+    bool inputStats;
+    bool keyBench;
+    bool floodBench;        // --bench-flood, the bit parallel Voronoi against the BFS
+    bool makeBench;         // --bench-make, makeTick/unmakeTick against copying the board
+    bool hud;               // start with the timing HUD up
+    const char * traceFile; // --trace, Chrome trace JSON of every phase
+    const char * spectate;  // --spectate PORT|PATH, serve the game to viewers
+    const char * watch;     // --watch PORT|PATH, be one
+
+    const char * botCommand; // --bot CMD, what --ai bot runs
+    int botDeadlineMs;      // per move, 0 for one tick
+    const char * botLog;    // --bot-log FILE, every move's round trip as CSV
+    bool serveBot;          // --serve-bot, be a bot: --ai's engine playing through stdin and stdout
+
+    const char * server;    // --server PORT|PATH, host matches for bot protocol clients, a shard per --threads
+    const char * load;      // --load PORT|PATH, be --clients of them at once
+    int clients;
+    int seconds;            // how long either runs, 0 for until Ctrl-C
+} options;
+
+bool parseArgs(int argc, char * argv[], options * opts);
+int runHeadless(options * opts);
+int runFloodBench(options * opts);
+int runMakeBench(options * opts);
+int runReplay(options * opts);
+#define DIST_REBUILD_SAMPLE 16
+/*** Tournament ***/
+typedef struct tournamentWorker {
+    pthread_t thread;
+    options * opts;
+    atomic_int * nextMatch;
+    transTable * tt;        // one for every worker
+    long winsA;
+    long winsB;
+    long draws;
+    double turns;
+    double turnsSquared;
+} tournamentWorker;
+
+int runTournament(options * opts);
+void * tournamentWorkerMain(void * arg);
+uint32_t matchSeed(uint32_t seed, int match);
+void wilsonInterval(long hits, long n, double * lo, double * hi);
+
+/*** Self-play ***/
+// --selfplay FILE: tournament style AI vs AI on every core, every tick written out as a training
+// sample. Native endian structs laid out for mmap: the header, game records wherever their worker
+// got to write them, then an index of record offsets in match order. A game is a replay recording
+// inside, so moves, outcome and where to seek are read in place, boards and cycles come from the
+// nearest keyframe plus at most REPLAY_KEYFRAME_INTERVAL ticks of moves (selfPlayGameReplay).
+#define SELFPLAY_MAGIC "MTSP"
+#define SELFPLAY_VERSION 2
+#define SELFPLAY_CHUNK_BYTES (4 << 20) // finished games a worker collects before one write
+
+typedef struct selfPlayHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t rows;
+    uint32_t cols;
+    uint64_t numGames;
+    uint64_t numSamples;
+    uint64_t indexOffset;   // numGames uint64_t offsets of game records, in match order
+} selfPlayHeader;
+
+// A record is this, then the sections of a recording: 2 bits per cycle per tick, the keyframes
+// and their (tick u32, offset u64) table. Sample i is the position before tick i, the move bits of
+// tick i are what both cycles chose in it, and the outcome is winner. Records are 8 byte aligned.
+typedef struct selfPlayGame {
+    uint64_t firstSample;   // samples are numbered across the file in the order records were written
+    uint32_t ticks;
+    uint32_t match;         // the seed is matchSeed(seed, match)
+    uint32_t numKeyframes;
+    uint32_t keyframesOffset; // from the start of the record, the moves start right after this
+    uint32_t tableOffset;
+    uint32_t recordBytes;
+    int8_t winner;          // cycle index, -1 for a draw
+    uint8_t engine[2];      // aiEngine of each cycle
+    uint8_t pad[5];
+} selfPlayGame;
+
+typedef struct selfPlayWriter {
+    int fd;
+    atomic_long nextOffset; // file space handed out, workers write their chunks without a lock
+    atomic_long nextSample;
+    uint64_t * index;       // record offset of every match
+} selfPlayWriter;
+
+typedef struct selfPlayWorker {
+    pthread_t thread;
+    options * opts;
+    atomic_int * nextMatch;
+    selfPlayWriter * out;
+    transTable * tt;
+    abuf chunk;             // finished records, grown past SELFPLAY_CHUNK_BYTES only for a game that alone is bigger
+    int * chunkGames;       // offset of each finished record in the chunk
+    int numChunkGames;
+    size_t chunkPeak;       // the biggest the chunk got
+    long samples;
+} selfPlayWorker;
+
+int runSelfPlay(options * opts);
+void * selfPlayWorkerMain(void * arg);
+void selfPlayFlush(selfPlayWorker * w);
+bool selfPlayGameReplay(const uint8_t * data, size_t size, uint64_t match, replay * rp);
+void pwriteAll(int fd, const void * buf, size_t len, off_t offset);
+
+/*** Netplay ***/
+// Two players on two machines over UDP. Each peer simulates on its own inputs straight away,
+// guesses the other one keeps going the way they last said, and when the real input turns
+// out different it rolls back to the snapshot before that tick and simulates forward again.
+#define NET_MAGIC "MTNP"
+#define NET_VERSION 1
+#define NET_RING 128            // ticks of inputs and checksums kept, a power of two
+#define NET_MAX_ROLLBACK 32     // predict at most this far past the last remote input, then wait
+#define NET_SNAPSHOTS (NET_MAX_ROLLBACK + 1)
+#define NET_MAX_PACKET 512
+#define NET_HELLO_MS 250        // how often a joining peer knocks
+#define NET_SYNC_COOLDOWN 8     // ticks between clock corrections, long enough to see the last one
+#define NET_QUIET_MS 3000       // past this the status bar says the other side went quiet
+#define NET_DELAY_SLOTS 256
+#define NET_FLAG_WANTS_MATCH 1  // the joiner pressed space
+
+typedef enum netPacketType {
+    NET_HELLO,              // joiner -> host: rows, cols of its terminal
+    NET_WELCOME,            // host -> joiner: the board both will play on, tick rate, seed
+    NET_INPUT               // both ways every tick: unacknowledged inputs, acks, a checksum
+} netPacketType;
+
+// the state before a tick, everything a tick can change
+typedef struct netSnapshot {
+    int tick;               // -1 until used
+    uint8_t * cells;
+    uint64_t * occupied;
+    lightCycle cycles[MAX_HUMANS];
+    int numTurn;
+    uint64_t hash;
+    gameState curState;
+    int winner;
+    uint32_t rngState;
+} netSnapshot;
+
+// --net-delay-ms holds packets back here, so loopback can pretend to be a real network
+typedef struct netDelayed {
+    uint64_t due;
+    int len;
+    uint8_t data[NET_MAX_PACKET];
+} netDelayed;
+
+typedef struct netSession {
+    int fd;                 // UDP socket, connected to the peer once it's known
+    bool host;              // the host is player 1 and decides when matches start
+    int local;              // the cycle this peer steers, the other one is remote
+    bool connected;         // heard an input packet from the peer
+    int tickRate;           // what the WELCOME says, the host's --tick-rate
+    uint32_t seed;
+    abuf packet;
+
+    int match;              // numbered by the host, packets for any other match are dropped
+    bool matchOver;         // game over with every input behind it confirmed
+    bool wantsMatch;
+    int tick;               // ticks simulated this match
+    uint8_t localInput[NET_RING];   // direction index per tick
+    uint8_t remoteInput[NET_RING];  // confirmed remote inputs
+    uint8_t predicted[NET_RING];    // what the simulation used for the remote, confirmed or not
+    uint64_t checksums[NET_RING];   // state after each tick
+    int remoteConfirmed;    // every remote input up to this tick has arrived, -1 for none
+    int localAcked;         // and the peer has all of ours up to here
+    int rollbackTo;         // earliest mispredicted tick, -1 if none
+    netSnapshot snapshots[NET_SNAPSHOTS];
+
+    int remoteTick;         // how far the peer had got when it last sent
+    int remoteAdvantage;    // how far ahead of us it thought it was
+    int syncStall;          // ticks left to sit out so the peer can catch up
+    int syncCooldown;
+    int remoteChecksumTick; // the peer's latest confirmed checksum, -1 once compared
+    uint64_t remoteChecksum;
+    int desyncTick;         // -1 while the checksums agree
+
+    uint32_t echoMs;        // the peer's last send time and when it arrived, for the RTT
+    uint64_t echoReceivedNs;
+    uint64_t lastHeardNs;
+    double rttMs;
+    long rollbacks;
+    long resimulated;
+    int maxRollback;
+    long stalls;
+
+    uint64_t delayNs;
+    netDelayed * delayed;   // FIFO, the delay is the same for every packet
+    int delayedHead;
+    int numDelayed;
+} netSession;
+
+netSession * netSessionInit(tron * this, int fd, bool host);
+uint64_t tronChecksum(tron * this);
+void netBeginMatch(tron * this, netSession * net, int match);
+void netSave(tron * this, netSession * net, int tick);
+void netRestore(tron * this, netSession * net, int tick);
+void netSimulate(tron * this, netSession * net, int tick);
+void netRollback(tron * this, netSession * net);
+void netTick(tron * this, netSession * net);
+bool netCanStart(netSession * net);
+void netSendInput(netSession * net);
+void netSendWelcome(tron * this, netSession * net);
+void netSend(netSession * net);
+void netFlush(netSession * net);
+void netReceive(tron * this, netSession * net, const uint8_t * data, int len);
+int netHandshake(options * opts, int * rows, int * cols, int * tickRate, uint32_t * seed);
+int runNetplay(options * opts);
+
+/*** Spectators ***/
+// --spectate PORT|PATH: viewers connect over TCP on localhost (or a Unix socket for a path) and
+// get the very bytes drawScreen writes to our terminal, so a frame is encoded once however many
+// are watching. Sockets are nonblocking: a viewer whose socket is full keeps the unsent rest of
+// that frame, skips frames until it has drained it, then catches up with a full repaint. One
+// that stays stuck gets dropped. Nobody watching can hold up a tick.
+#define SPECTATOR_STALL_NS 3000000000ULL   // stuck this long on one frame and they're dropped
+#define SPECTATOR_BACKLOG 128
+
+typedef enum { VIEWER_SYNCED, VIEWER_BEHIND, VIEWER_NEEDS_FULL } viewerState;
+
+typedef struct viewer {
+    int fd;
+    viewerState state;
+    char * tail;            // what the socket had no room for, only while BEHIND
+    int tailLen;
+    int tailCap;
+    uint64_t behindSince;
+} viewer;
+
+typedef struct spectatorServer {
+    int listenFd;
+    viewer * viewers;
+    int numViewers;
+    atomic_int watching;    // numViewers, for the status bar on the simulation's side
+    int cap;
+    abuf full;              // repaint for newcomers and viewers catching up, built at most once a frame
+    long joined;
+    long dropped;
+    long resyncs;           // full repaints sent to viewers that fell behind
+} spectatorServer;
+
+spectatorServer * spectatorsInit(const char * where);
+void spectatorsServe(tron * this, spectatorServer * spec, const frameSnapshot * snap);
+bool viewerWrite(viewer * v, const char * buf, int len, uint64_t now);
+void viewerDrop(spectatorServer * spec, int i);
+int spectatorAddress(const char * where, struct sockaddr_storage * addr, socklen_t * len);
+int listenOn(const char * where, int backlog);
+int runWatch(options * opts);
+
+static inline uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*** Profiling ***/
+// Where an interactive tick's time goes. With the HUD off and no --trace every probe is a NULL
+// check, or a flag check once the HUD has been shown with the render thread holding on to it.
+typedef enum profPhase {
+    PHASE_INPUT,    // draining the input ring into processKeypress, the read() itself is on the input thread
+    PHASE_AI,       // computerMoves
+    PHASE_SIM,      // moveCycles, which does updateCyclePos and deathHandler
+    PHASE_BUILD,    // buildFrame
+    PHASE_WRITE,    // write() of the frame
+    NUM_PHASES
+} profPhase;
+
+#define PROF_WINDOW 512                 // latest samples per phase the HUD percentiles cover
+#define PROF_HUD_REFRESH_NS 250000000ULL
+
+typedef struct profRing {
+    uint64_t values[PROF_WINDOW];
+    int next;
+    int count;
+} profRing;
+
+typedef struct profiler {
+    profRing phases[NUM_PHASES];    // durations in ns
+    profRing ticks;                 // when each tick started, for the tick rate
+    profRing frameBytes;            // of frames that had anything in them
+    bool hud;                       // H shows it in place of the instruction bar
+    uint64_t hudDrawnNs;
+    FILE * trace;                   // Chrome trace JSON, streamed as we go
+    uint64_t traceOriginNs;
+    bool traceFirst;
+    pthread_mutex_t lock;           // build and write are recorded on the render thread
+} profiler;
+
+profiler * profilerInit(const char * tracePath);
+void profilerFree(profiler * prof);
+void profilerAtExit(void);
+void profRecord(profiler * prof, profPhase phase, uint64_t start, uint64_t end);
+void profFrame(profiler * prof, uint64_t start, int bytes);
+uint64_t profPercentile(profRing * ring, int pct);
+int profHudText(profiler * prof, char * buf, int size);
+
+static inline bool profOn(const profiler * prof) {
+    return prof != NULL && (prof->hud || prof->trace != NULL);
+}
+
+static inline uint64_t profStart(tron * this) {
+    return profOn(this->prof) ? nowNs() : 0;
+}
+// returns when the phase ended, so the next one can start from there
+static inline uint64_t profEnd(tron * this, profPhase phase, uint64_t start) {
+    if (start == 0 || !profOn(this->prof)) return 0; // switched on mid-phase has nothing to end
+    uint64_t end = nowNs();
+    profRecord(this->prof, phase, start, end);
+    return end;
+}
+
+/*** Bots ***/
+// --ai bot --bot CMD: cycles steered by an outside program, started with /bin/sh -c CMD (once
+// per cycle) and spoken to over its stdin and stdout. Boards are never sent. A match opens with
+// a START giving the board size and every cycle, and after each tick comes a TICK listing only
+// the cycles that turned or crashed: the rest went one cell straight on, crashed ones stay put,
+// so a bot keeps its own board from that. Both ask for a move and get exactly one botReply with
+// the request's seq. A request goes out as soon as a tick is over and its answer is taken at the
+// next one, the bot thinks while we draw. No answer by the deadline and the cycle keeps going
+// straight, an answer after that is only counted. Native endian structs like the other formats.
+#define BOT_RING 64                 // requests a late reply can still be timed against, a power of two
+#define BOT_MAX_BACKLOG (1 << 20)   // unread requests past this and the bot counts as hung
+#define BOT_CRASHED 4               // TICK event for a crash, 0-3 are direction indices
+#define BOT_KEEP_GOING 0xff         // a reply that doesn't turn, so does anything past 3
+#define BOT_SERVE_MAX_CELLS (1 << 24) // --serve-bot keeps bigger boards in arena chunks
 
-void drawScreen(tron * this);
+typedef enum botMessageType { BOT_START = 1, BOT_TICK, BOT_END } botMessageType;
+
+typedef struct botHeader {
+    uint8_t type;
+    uint8_t you;            // the cycle this bot drives
+    uint16_t count;         // START: botCycles that follow, TICK and END: botEvents
+    uint32_t seq;           // for the reply, END has no reply and carries the winner + 1 (0: a draw)
+} botHeader;
+
+typedef struct botStart {
+    int32_t rows;           // with the border, cycles move in 1..cols-2 x 1..rows-2
+    int32_t cols;
+} botStart;
+
+typedef struct botCycle {
+    int32_t posX;
+    int32_t posY;
+    uint8_t heading;        // direction index (up, down, left, right)
+    uint8_t alive;
+    uint8_t pad[2];
+} botCycle;
+
+typedef struct botEvent {
+    uint8_t cycle;
+    uint8_t what;           // direction index it moved in this tick, or BOT_CRASHED
+} botEvent;
+
+typedef struct botReply {
+    uint32_t seq;
+    uint8_t move;           // direction index, reversals are ignored like a human's
+    uint8_t pad[3];
+} botReply;
+
+typedef struct botPlayer {
+    int cycle;
+    pid_t pid;              // 0 for a --server client, whose one socket is both fds
+    int toFd;               // its stdin and stdout, both nonblocking on our side
+    int fromFd;
+    bool gone;              // exited, closed a pipe or stopped reading, its cycle rides straight on
+    bool playing;           // had this match's START and neither crashed nor got the END yet
+    abuf out;               // requests the pipe had no room for
+    uint8_t in[sizeof(botReply)]; // a reply that came in pieces
+    int inLen;
+    uint32_t seq;           // the request the next move comes from
+    bool decided;           // that move has been made, an answer to it now is late
+    bool answered;
+    uint8_t move;
+    uint64_t rttNs;         // of the answer
+    uint64_t sentNs[BOT_RING]; // by seq
+} botPlayer;
+
+typedef struct botHub {
+    const char * command;
+    uint64_t deadlineNs;
+    bool wait;              // headless: no frames to get out, a move waits for its answer up to the deadline
+    bool polled;            // --server: replies are read when epoll says they're in, a move doesn't look again
+    botPlayer * players[MAX_CYCLES]; // started the first time their cycle is a bot
+    uint8_t told[MAX_CYCLES]; // headings (or BOT_CRASHED) as the bots last heard them
+    abuf msg;               // a tick's message is built once, only the header differs per bot
+    FILE * log;             // --bot-log, a CSV line per move and per late reply
+    int match;
+    profRing rtt;           // round trips of the latest replies, late ones included
+    long replies;
+    uint64_t rttTotalNs;
+    uint64_t rttMaxNs;
+    long moves;             // made from an answer in time
+    long timeouts;          // moves without one
+    long late;              // answers that came after their move was made
+} botHub;
+
+botHub * botHubInit(const char * command, uint64_t deadlineNs, bool wait, const char * logPath);
+botPlayer * botSpawn(const char * command, int cycle);
+botPlayer * botAttach(int fd, int cycle);
+void botsStart(tron * this);
+void botsTick(tron * this);
+void botRequest(botHub * hub, botPlayer * bot, botHeader * h);
+void botWrite(botPlayer * bot, const char * buf, int len);
+void botFlush(botPlayer * bot);
+void botGone(botPlayer * bot);
+void botReceive(botHub * hub, botPlayer * bot, uint64_t now);
+void botMakeMove(tron * this, int i);
+int botPollFds(botHub * hub, struct pollfd * fds);
+void botPolled(botHub * hub, struct pollfd * fds, int n);
+void botsStop(botHub * hub);
+int botBodySize(const botHeader * h);
+bool botFollow(tron * this, const botHeader * h, const uint8_t * body, aiEngine ai);
+botReply botAnswer(tron * this, const botHeader * h);
+int runBotServer(options * opts);
+
+/*** Game server ***/
+// --server PORT|PATH: matches by the thousand for clients speaking the bot protocol over a socket,
+// so --serve-bot behind socat is one. Matches live in shards, a thread per --threads pinned to a
+// core of its own with its own epoll over its sockets and a timerfd on the schedule every shard
+// shares: tick k of every match is due at epoch + k periods. Newcomers fill the shard's next
+// match, which begins on the tick after its last seat is taken, and the same players go again
+// after every END until one of them has left. A tick misses its deadline when it's still going
+// once the next one is due. --load is a crowd of stand in clients to try it with.
+#define SERVER_BACKLOG 4096
+#define SERVER_ACCEPT_BATCH 16  // connections a shard takes per wakeup, so idle shards get some too
+#define SERVER_EVENTS 256
+#define SERVER_LISTEN UINT64_MAX        // epoll data of the listening socket and the timer, a
+#define SERVER_TIMER (UINT64_MAX - 1)   // client's is its match index << 8 | its seat
+#define SERVER_REPORT_NS 1000000000ULL
+
+typedef struct serverMatch {
+    tron game;              // its bots are the clients, a botPlayer per seat taken
+    int seated;
+} serverMatch;
+
+typedef struct serverShard {
+    struct gameServer * server;
+    int index;
+    pthread_t thread;
+    int epollFd;
+    int timerFd;
+    serverMatch ** matches; // never move, their index is in the epoll data of their sockets
+    int numMatches;
+    int * spare;            // matches nobody is in, reused before making more
+    int numSpare;
+    int cap;
+    int filling;            // the match newcomers get a seat in, -1 until there's one
+    long tick;              // of the shared schedule, the last one run
+
+    // read by the reporter while the shard runs
+    atomic_int clients;
+    atomic_int playing;     // matches in progress
+    atomic_long played;     // and finished
+    atomic_long ticks;
+    atomic_long misses;     // ticks done after the next one was due, or slept through altogether
+    atomic_long moves;      // made from a reply in time, and without one
+    atomic_long timeouts;
+    pthread_mutex_t lock;   // over done
+    profRing done;          // how long after it was due each tick was over
+} serverShard;
+
+typedef struct gameServer {
+    options * opts;
+    int listenFd;           // every shard's epoll has it, EPOLLEXCLUSIVE wakes one of them
+    uint64_t epoch;         // tick 0, CLOCK_MONOTONIC
+    uint64_t periodNs;
+    atomic_bool stop;
+    serverShard * shards;
+    int numShards;
+} gameServer;
+
+// one --load connection, playing --ai from a board of its own like --serve-bot
+typedef struct loadClient {
+    int fd;
+    bool ready;             // game was set up by the first START
+    bool closed;
+    tron game;
+    abuf in;                // the message coming in, until it's all there
+    abuf out;               // replies the socket had no room for
+} loadClient;
+
+typedef struct loadWorker {
+    pthread_t thread;
+    options * opts;
+    transTable * tt;
+    loadClient * clients;
+    int numClients;
+    uint64_t until;
+    long matches;
+    long wins;
+    long replies;
+    long hungUp;            // connections the server closed on us
+} loadWorker;
+
+void raiseFdLimit(void);
+int runServer(options * opts);
+void * serverShardMain(void * arg);
+void serverAccept(serverShard * shard);
+int serverMatchNew(serverShard * shard);
+void serverSeat(serverShard * shard, botPlayer * bot);
+void serverEvent(serverShard * shard, uint64_t data, uint32_t events);
+void serverTick(serverShard * shard, uint64_t expirations);
+void serverMatchOver(serverShard * shard, int index);
+void serverReport(gameServer * server, double seconds, bool perShard);
+int runLoad(options * opts);
+void * loadWorkerMain(void * arg);
+void loadReceive(loadWorker * w, loadClient * c);
+void loadFlush(loadWorker * w, loadClient * c);
+void loadClose(loadClient * c);
 
 /*** terminal ***/
+// Keys are decoded from whatever one read() returned by a state machine that survives
+// between reads, so an escape sequence split over two reads still comes out whole.
+#define KEY_READ_SIZE 256       // bytes per read(), key arrays need KEY_READ_SIZE + 1 slots
+#define KEY_MAX_PARAMS 2        // CSI parameters we care about, as in ESC [ 1 ; 5 A
+#define KEY_ESC_TIMEOUT_MS 50   // an Esc with nothing after it for this long is the Esc key
+
+typedef enum keyState {
+    KEY_GROUND,
+    KEY_ESC,        // seen ESC
+    KEY_CSI,        // seen ESC [, collecting parameters
+    KEY_SS3         // seen ESC O (or ESC 0), one byte to go
+} keyState;
+
+typedef struct keyParser {
+    keyState state;
+    int params[KEY_MAX_PARAMS];
+    int numParams;
+    char intro;     // the O or 0 of an SS3 sequence
+    long reads;     // read() calls and keys out, for --bench-keys
+    long keys;
+} keyParser;
+
 void enableRawMode(void);
 void disableRawMode(void);
 void die(const char* s);
-int readKey(void); // add support for new special keys here
+int readKeys(keyParser * kp, int fd, int * keys);
+int keyParserFeed(keyParser * kp, const uint8_t * bytes, int n, int * keys);
+int keyParserFlush(keyParser * kp, int * keys);
+int keyDecodeCsi(keyParser * kp, char final); // add support for new special keys here
+int keyDecodeSs3(char intro, char final);
+int runKeyBench(options * opts);
 int getWindowSize (int* rows, int* cols);
 int getCursorPosition(int* rows, int* cols);
 
 /*** Global Varl declaration ***/
 struct termios orig_termio;
+keyParser stdinKeys;    // only one thread reads stdin at a time
+
+int main(int argc, char * argv[]) {
+    options opts;
+    if (!parseArgs(argc, argv, &opts)) return 1;
+
+    if (opts.tournament) return runTournament(&opts);
+    if (opts.selfPlayFile != NULL) return runSelfPlay(&opts);
+    if (opts.headless) return runHeadless(&opts);
+    if (opts.keyBench) return runKeyBench(&opts);
+    if (opts.floodBench) return runFloodBench(&opts);
+    if (opts.makeBench) return runMakeBench(&opts);
+    if (opts.watch != NULL) return runWatch(&opts);
+    if (opts.serveBot) return runBotServer(&opts);
+    if (opts.server != NULL) return runServer(&opts);
+    if (opts.load != NULL) return runLoad(&opts);
+    if (opts.replayFile != NULL) return runReplay(&opts);
+    if (opts.netHost || opts.netJoin != NULL) return runNetplay(&opts);
 
-int main() {
     enableRawMode();
 
-    time_t t;
-    srand((unsigned) time(&t));
+    int rows, cols;
+    if (getWindowSize(&rows, &cols) == -1) {
+        die("getWindowSize");
+    }
+    int boardRows = opts.arenaRows > 0 ? opts.arenaRows : rows - 1;
+    int boardCols = opts.arenaCols > 0 ? opts.arenaCols : cols - 1;
+    int top, left, spawnRows, spawnCols;
+    spawnArea(boardRows, boardCols, opts.players, opts.arenaRows > 0, &top, &left, &spawnRows, &spawnCols);
+    if (!spawnFits(spawnRows, spawnCols, opts.players)) {
+        fprintf(stderr, "%s is too small for %d players\r\n", opts.arenaRows > 0 ? "arena" : "terminal", opts.players);
+        return 1;
+    }
 
     tron tronGame;
-    gameInit(&tronGame);
-
-    while (1) {
-        drawScreen(&tronGame);
-        processKeypress(&tronGame);
+    // -1 col cuz WSL seem to overreport by one col, -1 row to leave space for instructions
+    if (opts.arenaRows > 0) arenaGameInit(&tronGame, opts.arenaRows, opts.arenaCols, rows - 1, cols - 1);
+    else gameInit(&tronGame, rows - 1, cols - 1);
+    tronGame.numCycles = opts.players;
+    tronGame.rngState = opts.seed;
+    tronGame.computerEngine = opts.ai;
+    tronGame.aiBudgetNs = 1000000000ULL / opts.tickRate / 4; // leave the rest of the tick to everything else
+    tronGame.aiThreads = opts.aiThreads;
+    tronGame.tt = ttInit(opts.ttMb);
+    if (opts.recordFile != NULL) tronGame.recorder = recorderInit(opts.recordFile, opts.tickRate);
+    tronGame.showInputLag = opts.inputStats;
+    if (opts.spectate != NULL) tronGame.spectators = spectatorsInit(opts.spectate);
+    if (opts.botCommand != NULL) {
+        uint64_t deadlineNs = opts.botDeadlineMs > 0 ? opts.botDeadlineMs * 1000000ULL : 1000000000ULL / opts.tickRate;
+        tronGame.bots = botHubInit(opts.botCommand, deadlineNs, false, opts.botLog);
     }
+    if (opts.hud || opts.traceFile != NULL) {
+        tronGame.prof = profilerInit(opts.traceFile);
+        tronGame.prof->hud = opts.hud;
+    }
+
+    gameLoop(&tronGame, opts.tickRate);
 
     return 0;
 }
 
 /*** Tron Functions ***/
-void gameInit(tron * this) {
-    if (getWindowSize(&this->boardRows, &this->boardCols) == -1) {
-        die("getWindowSize");
-    }
+// everything but the board storage, the window starts in the top left corner
+static void gameInitCommon(tron * this, int viewRows, int viewCols) {
+    this->viewTop = 0;
+    this->viewLeft = 0;
+    this->viewRows = viewRows;
+    this->viewCols = viewCols;
+    this->follow = 0;
+    this->shadowBoard = (uint8_t *) malloc(viewRows * viewCols);
+    this->viewGlyphs = (uint8_t *) malloc(viewRows * viewCols);
+    this->rowsChanged = (uint64_t *) calloc((viewRows + 63) / 64, sizeof(uint64_t));
+    this->dirtyCells = (int *) malloc(sizeof(int) * MAX_DIRTY_CELLS);
+    if (this->shadowBoard == NULL || this->viewGlyphs == NULL || this->rowsChanged == NULL || this->dirtyCells == NULL) die("malloc");
+    this->numDirty = 0;
+    this->fullRepaint = true;
+    this->frameSeq = 0;
+    this->fullSeq = 0;
+    this->statusSeq = 0;
+    this->statusLen = 0;
+    this->drawnSeq = 0;
+    atomic_store(&this->framesDropped, 0);
+    this->render = NULL;
+    this->snapshot = (frameSnapshot *) malloc(sizeof(frameSnapshot));
+    if (this->snapshot == NULL) die("malloc");
+    snapshotInit(this, this->snapshot);
+    frameInit(this);
+    glyphInit(this);
 
-    this->boardCols--; // this is just cuz WSL seem to overreport by one col
-    this->boardRows--; // leave space for instructions
-
-    this->gameBoard = (char **) malloc(sizeof(char *) * this->boardRows);
-    for (int i = 0; i < this->boardRows; i++) {
-        this->gameBoard[i] = (char *) malloc(this->boardCols);
-        memset(this->gameBoard[i], ' ', this->boardCols);
-    }
-    
-    this->player1.dirX = 0;
-    this->player1.dirY = 0;
-    this->player1.posX = this->boardCols * 1 / 3;
-    this->player1.posY = this->boardRows / 2;
-    this->player1.alive = true;
-
-    this->player2.dirX = 0;
-    this->player2.dirY = 0;
-    this->player2.posX = this->boardCols * 2 / 3;
-    this->player2.posY = this->boardRows / 2;
-    this->player2.alive = true;
+    // nobody is on the board until gameStart places them
+    memset(this->cycles, 0, sizeof(this->cycles));
+    for (int i = 0; i < MAX_CYCLES; i++) this->cycles[i].engine = AI_NONE;
+    this->numCycles = 2;
+    memset(this->claims, 0, sizeof(this->claims));
 
     this->curState = START_SCREEN;
+    this->winner = -1;
     this->singlePlayer = false;
     this->numTurn = 0;
+    this->hash = 0;
+    this->rngState = 1;
+    this->randomStart = false;
+    this->computerEngine = AI_CHASER;
+    this->aiBudgetNs = 20000000;
+    this->aiThreads = 1;
+    this->search = NULL;
+    this->tt = NULL;
+    this->mcts = NULL;
+    this->distance = NULL;
+    this->recorder = NULL;
+    this->prof = NULL;
+    this->spectators = NULL;
+    this->bots = NULL;
+    this->undo = NULL;
+    memset(this->turns, 0, sizeof(this->turns));
+    this->showInputLag = false;
+    this->lagTurns = 0;
+    this->lagTotalNs = 0;
+    this->lagMaxNs = 0;
+}
+
+void gameInit(tron * this, int rows, int cols) {
+    boardGameInit(this, rows, cols, rows, cols);
+}
+
+// a normal board with a smaller window onto it, down to 1x1 for games nobody draws (--server's)
+void boardGameInit(tron * this, int rows, int cols, int viewRows, int viewCols) {
+    this->boardRows = rows;
+    this->boardCols = cols;
+
+    int numCells = this->boardRows * this->boardCols;
+    this->wordsPerRow = (this->boardCols + 63) / 64;
+    this->cells = (uint8_t *) malloc(numCells);
+    this->occupied = (uint64_t *) malloc(sizeof(uint64_t) * this->wordsPerRow * this->boardRows);
+    if (this->cells == NULL || this->occupied == NULL) die("malloc");
+    memset(this->cells, CELL_EMPTY, numCells);
+    memset(this->occupied, 0, sizeof(uint64_t) * this->wordsPerRow * this->boardRows);
+    this->arena = NULL;
+    gameInitCommon(this, viewRows < rows ? viewRows : rows, viewCols < cols ? viewCols : cols);
+}
+
+// A board as big as asked for with only a viewRows x viewCols window of it on screen. Nothing
+// here is sized by the arena, so a 100k x 100k one costs what its trails cost.
+void arenaGameInit(tron * this, int rows, int cols, int viewRows, int viewCols) {
+    this->boardRows = rows;
+    this->boardCols = cols;
+    this->wordsPerRow = 0;
+    this->cells = NULL;
+    this->occupied = NULL;
+    this->arena = arenaMapInit();
+    gameInitCommon(this, viewRows < rows ? viewRows : rows, viewCols < cols ? viewCols : cols);
+}
+
+// Start positions sit on a grid of roughly square blocks, one block per cycle, so two cycles
+// get the classic thirds of the board facing each other.
+void spawnGrid(int rows, int cols, int numCycles, int * blockCols, int * blockRows) {
+    int across = 1;
+    while (across * across * rows < numCycles * cols) across++;
+    if (across > numCycles) across = numCycles;
+    *blockCols = across;
+    *blockRows = (numCycles + across - 1) / across;
+}
+
+// The part of the board cycles start in: all of it, except in an arena where they'd never
+// meet and get a box around the middle instead, bigger the more of them there are
+void spawnArea(int rows, int cols, int numCycles, bool arena, int * top, int * left, int * areaRows, int * areaCols) {
+    *areaRows = rows;
+    *areaCols = cols;
+    if (arena) {
+        int scale = (int) ceil(sqrt(numCycles / 2.0));
+        if (*areaRows > ARENA_SPAWN_ROWS * scale) *areaRows = ARENA_SPAWN_ROWS * scale;
+        if (*areaCols > ARENA_SPAWN_COLS * scale) *areaCols = ARENA_SPAWN_COLS * scale;
+    }
+    *top = (rows - *areaRows) / 2;
+    *left = (cols - *areaCols) / 2;
+}
+
+// every spawn block needs an inside, or random starts land on each other
+bool spawnFits(int rows, int cols, int numCycles) {
+    int blockCols, blockRows;
+    spawnGrid(rows, cols, numCycles, &blockCols, &blockRows);
+    return cols / blockCols >= 3 && rows / blockRows >= 3;
+}
+
+void placeCycles(tron * this) {
+    int top, left, rows, cols;
+    spawnArea(this->boardRows, this->boardCols, this->numCycles, this->arena != NULL, &top, &left, &rows, &cols);
+    int blockCols, blockRows;
+    spawnGrid(rows, cols, this->numCycles, &blockCols, &blockRows);
+
+    for (int i = 0; i < this->numCycles; i++) {
+        lightCycle * cycle = &this->cycles[i];
+        int bx = i % blockCols, by = i / blockCols;
+        if (this->randomStart) { // anywhere in their own block
+            int loX = left + cols * bx / blockCols + 1;
+            int hiX = left + cols * (bx + 1) / blockCols - 1;
+            int loY = top + rows * by / blockRows + 1;
+            int hiY = top + rows * (by + 1) / blockRows - 1;
+            if (hiX > left + cols - 2) hiX = left + cols - 2;
+            if (hiY > top + rows - 2) hiY = top + rows - 2;
+            cycle->posX = loX + tronRand(this) % (hiX - loX + 1);
+            cycle->posY = loY + tronRand(this) % (hiY - loY + 1);
+        }
+        else {
+            cycle->posX = left + cols * (bx + 1) / (blockCols + 1);
+            cycle->posY = top + rows * (by + 1) / (blockRows + 1);
+        }
+        // everyone faces the middle
+        cycle->dirX = cycle->posX < left + cols / 2 ? 1 : -1;
+        cycle->dirY = 0;
+        cycle->lastDirX = cycle->dirX;
+        cycle->lastDirY = 0;
+        cycle->alive = true;
+    }
 }
 
 void gameStart(tron * this) {
-    this->player1.dirX = 1;
-    this->player1.dirY = 0;
-    this->player1.posX = this->boardCols * 1 / 3;
-    this->player1.posY = this->boardRows / 2;
-    this->player1.alive = true;
-
-    this->player2.dirX = -1;
-    this->player2.dirY = 0;
-    this->player2.posX = this->boardCols * 2 / 3;
-    this->player2.posY = this->boardRows / 2;
-    this->player2.alive = true;
+    if (this->recorder != NULL) this->recorder->seed = this->rngState;
+    placeCycles(this);
+    gameBegin(this);
+}
 
+// a fresh board around cycles that are already placed, --serve-bot gets them from the game
+void gameBegin(tron * this) {
     this->curState = IN_GAME;
+    this->winner = -1;
     this->numTurn = 0;
+    for (int i = 0; i < MAX_HUMANS; i++) this->turns[i].count = 0; // leftovers from the last game
+
+    if (this->arena != NULL) {
+        arenaClear(this->arena); // the border is implied, nothing to draw
+    }
+    else {
+        memset(this->cells, CELL_EMPTY, this->boardRows * this->boardCols);
+        memset(this->occupied, 0, sizeof(uint64_t) * this->wordsPerRow * this->boardRows);
+        makeBorder(this);
+    }
+    for (int i = 0; i < this->numCycles; i++) setCell(this, this->cycles[i].posX, this->cycles[i].posY, headCell(i));
+    if (this->arena == NULL) this->hash = zobristRebuild(this); // makeBorder wrote rows behind setCell's back
+
+    // new board and new instruction bar, no point tracking cells
+    this->follow = 0;
+    viewCenter(this);
+    this->fullRepaint = true;
+    this->numDirty = 0;
+    if (this->distance != NULL) distanceFieldsInvalidate(this->distance);
+
+    if (this->recorder != NULL) recorderBegin(this);
+    if (this->bots != NULL) botsStart(this);
+}
+
+void makeBorder(tron * this) {
+    // top and bottom rows are whole words in the occupied plane
+    int lastRow = this->boardRows - 1;
+    memset(&this->cells[0], CELL_WALL, this->boardCols);
+    memset(&this->cells[lastRow * this->boardCols], CELL_WALL, this->boardCols);
+    for (int w = 0; w < this->wordsPerRow; w++) {
+        int bitsLeft = this->boardCols - w * 64;
+        uint64_t word = bitsLeft >= 64 ? ~0ULL : (1ULL << bitsLeft) - 1;
+        occupiedRow(this, 0)[w] = word;
+        occupiedRow(this, lastRow)[w] = word;
+    }
+
+    for (int i = 1; i < lastRow; i++) {
+        setCell(this, 0, i, CELL_WALL);
+        setCell(this, this->boardCols - 1, i, CELL_WALL);
+    }
+}
+
+// for when cells were written in bulk (replay keyframes), one word at a time
+void rebuildOccupied(tron * this) {
+    for (int y = 0; y < this->boardRows; y++) {
+        uint8_t * row = &this->cells[y * this->boardCols];
+        uint64_t * words = occupiedRow(this, y);
+        for (int w = 0; w < this->wordsPerRow; w++) {
+            uint64_t word = 0;
+            int end = (w + 1) * 64 < this->boardCols ? (w + 1) * 64 : this->boardCols;
+            for (int x = w * 64; x < end; x++) {
+                if (row[x] != CELL_EMPTY) word |= 1ULL << (x & 63);
+            }
+            words[w] = word;
+        }
+    }
+}
+
+// keeps the occupied plane in sync, always go through here to change a cell
+void setCell(tron * this, int x, int y, uint8_t type) {
+    if (this->arena != NULL) {
+        if (x < 1 || y < 1 || x > this->boardCols - 2 || y > this->boardRows - 2) return; // walls are implied
+        arenaChunk * chunk = arenaChunkAt(this->arena, x, y, type != CELL_EMPTY);
+        if (chunk == NULL) return; // emptying a cell that was never drawn on
+        int cx = x & (ARENA_CHUNK - 1), cy = y & (ARENA_CHUNK - 1);
+        chunk->cells[cy * ARENA_CHUNK + cx] = type;
+        if (type == CELL_EMPTY) chunk->occupied[cy] &= ~(1ULL << cx);
+        else chunk->occupied[cy] |= 1ULL << cx;
+        return;
+    }
+    this->cells[y * this->boardCols + x] = type;
+    uint64_t * word = &this->occupied[y * this->wordsPerRow + (x >> 6)];
+    uint64_t bit = 1ULL << (x & 63);
+    bool was = (*word & bit) != 0;
+    if (type == CELL_EMPTY) *word &= ~bit;
+    else *word |= bit;
+    if (was != (type != CELL_EMPTY)) this->hash ^= zobristKey((uint64_t) y * this->wordsPerRow * 64 + x, ZOBRIST_OCCUPIED);
+}
+
+// the key from scratch, for after bulk writes
+uint64_t zobristRebuild(tron * this) {
+    uint64_t hash = 0;
+    int numWords = this->wordsPerRow * this->boardRows;
+    for (int w = 0; w < numWords; w++) {
+        for (uint64_t word = this->occupied[w]; word != 0; word &= word - 1) {
+            hash ^= zobristKey((uint64_t) w * 64 + __builtin_ctzll(word), ZOBRIST_OCCUPIED);
+        }
+    }
+    for (int i = 0; i < this->numCycles; i++) {
+        lightCycle * cycle = &this->cycles[i];
+        if (cycle->alive) hash ^= zobristHead(i, cycleBit(this, i), dirIndex(cycle->lastDirX, cycle->lastDirY));
+    }
+    return hash;
+}
+
+arenaMap * arenaMapInit(void) {
+    arenaMap * map = (arenaMap *) calloc(1, sizeof(arenaMap));
+    if (map == NULL) die("malloc");
+    map->capacity = 64;
+    map->keys = (uint64_t *) malloc(sizeof(uint64_t) * map->capacity);
+    map->chunks = (arenaChunk **) malloc(sizeof(arenaChunk *) * map->capacity);
+    if (map->keys == NULL || map->chunks == NULL) die("malloc");
+    memset(map->keys, 0xff, sizeof(uint64_t) * map->capacity);
+    map->lastKey = ARENA_EMPTY_KEY;
+    return map;
+}
+
+static inline int arenaSlot(arenaMap * map, uint64_t key) {
+    return (int) ((key * 0x9e3779b97f4a7c15ULL) >> 32) & (map->capacity - 1);
+}
+
+static void arenaGrow(arenaMap * map) {
+    uint64_t * oldKeys = map->keys;
+    arenaChunk ** oldChunks = map->chunks;
+    int oldCapacity = map->capacity;
+    map->capacity *= 2;
+    map->keys = (uint64_t *) malloc(sizeof(uint64_t) * map->capacity);
+    map->chunks = (arenaChunk **) malloc(sizeof(arenaChunk *) * map->capacity);
+    if (map->keys == NULL || map->chunks == NULL) die("malloc");
+    memset(map->keys, 0xff, sizeof(uint64_t) * map->capacity);
+    for (int i = 0; i < oldCapacity; i++) {
+        if (oldKeys[i] == ARENA_EMPTY_KEY) continue;
+        int h = arenaSlot(map, oldKeys[i]);
+        while (map->keys[h] != ARENA_EMPTY_KEY) h = (h + 1) & (map->capacity - 1);
+        map->keys[h] = oldKeys[i];
+        map->chunks[h] = oldChunks[i];
+    }
+    free(oldKeys);
+    free(oldChunks);
+}
+
+// the chunk holding a cell, NULL if nothing was ever drawn there and create is false
+arenaChunk * arenaChunkAt(arenaMap * map, int x, int y, bool create) {
+    uint64_t key = (uint64_t) (y >> ARENA_CHUNK_BITS) << 32 | (uint64_t) (x >> ARENA_CHUNK_BITS);
+    if (key == map->lastKey) return map->last;
+
+    int h = arenaSlot(map, key);
+    while (map->keys[h] != ARENA_EMPTY_KEY && map->keys[h] != key) h = (h + 1) & (map->capacity - 1);
+    if (map->keys[h] == ARENA_EMPTY_KEY) {
+        if (!create) return NULL;
+        if (2 * (map->numChunks + 1) > map->capacity) {
+            arenaGrow(map);
+            return arenaChunkAt(map, x, y, true);
+        }
+        arenaChunk * chunk;
+        if (map->numSpare > 0) {
+            chunk = map->spare[--map->numSpare];
+            memset(chunk, 0, sizeof(arenaChunk));
+        }
+        else {
+            chunk = (arenaChunk *) calloc(1, sizeof(arenaChunk));
+            if (chunk == NULL) die("malloc");
+        }
+        map->keys[h] = key;
+        map->chunks[h] = chunk;
+        map->numChunks++;
+    }
+    map->lastKey = key;
+    map->last = map->chunks[h];
+    return map->last;
+}
+
+// a new game, the chunks are kept for the next one to draw on
+void arenaClear(arenaMap * map) {
+    if (map->numSpare + map->numChunks > map->spareCap) {
+        map->spareCap = (map->numSpare + map->numChunks) * 2;
+        map->spare = (arenaChunk **) realloc(map->spare, sizeof(arenaChunk *) * map->spareCap);
+        if (map->spare == NULL) die("malloc");
+    }
+    for (int i = 0; i < map->capacity; i++) {
+        if (map->keys[i] == ARENA_EMPTY_KEY) continue;
+        map->spare[map->numSpare++] = map->chunks[i];
+        map->keys[i] = ARENA_EMPTY_KEY;
+    }
+    map->numChunks = 0;
+    map->lastKey = ARENA_EMPTY_KEY;
+}
+
+long arenaBytes(arenaMap * map) {
+    return (long) (map->numChunks + map->numSpare) * sizeof(arenaChunk)
+           + (long) map->capacity * (sizeof(uint64_t) + sizeof(arenaChunk *)) + (long) map->spareCap * sizeof(arenaChunk *);
+}
+
+long arenaTrailCells(arenaMap * map) {
+    long cells = 0;
+    for (int i = 0; i < map->capacity; i++) {
+        if (map->keys[i] == ARENA_EMPTY_KEY) continue;
+        for (int y = 0; y < ARENA_CHUNK; y++) cells += __builtin_popcountll(map->chunks[i]->occupied[y]);
+    }
+    return cells;
+}
+
+// everything outside the playing field reads as wall, inside it untouched chunks are empty
+uint8_t arenaGetCell(tron * this, int x, int y) {
+    if (x < 1 || y < 1 || x > this->boardCols - 2 || y > this->boardRows - 2) return CELL_WALL;
+    arenaChunk * chunk = arenaChunkAt(this->arena, x, y, false);
+    if (chunk == NULL) return CELL_EMPTY;
+    return chunk->cells[(y & (ARENA_CHUNK - 1)) * ARENA_CHUNK + (x & (ARENA_CHUNK - 1))];
+}
+
+bool arenaIsOccupied(tron * this, int x, int y) {
+    if (x < 1 || y < 1 || x > this->boardCols - 2 || y > this->boardRows - 2) return true;
+    arenaChunk * chunk = arenaChunkAt(this->arena, x, y, false);
+    if (chunk == NULL) return false;
+    return (chunk->occupied[y & (ARENA_CHUNK - 1)] >> (x & (ARENA_CHUNK - 1))) & 1;
+}
+
+// one step of the simulation, called by gameLoop at a fixed rate regardless of input
+void gameTick(tron * this) {
+    if (this->curState != IN_GAME) return; // an idle tick would only water down the HUD
+    uint64_t t = profStart(this);
+    computerMoves(this);
+    t = profEnd(this, PHASE_AI, t);
+    moveCycles(this);
+    profEnd(this, PHASE_SIM, t);
+}
+
+void computerMoves(tron * this) {
+    if (this->curState != IN_GAME) return;
+    for (int i = 0; i < this->numCycles; i++) {
+        if (this->cycles[i].alive && this->cycles[i].engine != AI_NONE) aiMakeMove(this, i);
+    }
+}
+
+// Everybody moves at once. A cycle crashes if the cell it heads for is already taken, and cycles
+// heading for the same cell all crash there. Next cells go through a small hash (claims) instead
+// of comparing every pair, so a tick stays O(cycles) however many there are.
+void moveCycles(tron * this) {
+    if (this->curState != IN_GAME) return;
+    if (this->recorder != NULL) recorderTick(this);
+    stepCycles(this);
+
+    if (this->recorder != NULL) {
+        if (this->curState != IN_GAME) recorderFinish(this);
+        else if (this->numTurn % REPLAY_KEYFRAME_INTERVAL == 0) recorderKeyframe(this);
+    }
+    if (this->bots != NULL) botsTick(this); // the next move's request goes out now, not at the next tick
+}
+
+// the tick itself, what moveCycles and makeTick share
+void stepCycles(tron * this) {
+    this->numTurn++;
+
+    int slot[MAX_CYCLES];
+    int64_t cell[MAX_CYCLES]; // an arena can have more cells than an int counts
+    for (int i = 0; i < this->numCycles; i++) {
+        lightCycle * cycle = &this->cycles[i];
+        slot[i] = -1;
+        if (!cycle->alive) continue;
+        int nextX = cycle->posX + cycle->dirX;
+        int nextY = cycle->posY + cycle->dirY;
+        if (crashChecker(nextX, nextY, this)) {
+            killCycle(this, i);
+            continue;
+        }
+
+        cell[i] = (int64_t) nextY * this->boardCols + nextX;
+        int h = (int) (((uint32_t) (cell[i] ^ (cell[i] >> 32)) * 0x9e3779b1u) >> (32 - MOVE_CLAIM_BITS));
+        while (this->claims[h] != 0 && cell[this->claims[h] - 1] != cell[i]) h = (h + 1) & (MOVE_CLAIM_SLOTS - 1);
+        if (this->claims[h] == 0) {
+            this->claims[h] = i + 1;
+            slot[i] = h;
+        }
+        else { // head on, the first one there goes down too
+            killCycle(this, this->claims[h] - 1);
+            killCycle(this, i);
+        }
+    }
+
+    for (int i = 0; i < this->numCycles; i++) {
+        if (slot[i] == -1) continue;
+        this->claims[slot[i]] = 0;
+        if (this->cycles[i].alive) updateCyclePos(this, i);
+    }
+
+    deathHandler(this);
+}
+
+undoStack * undoInit(int maxTicks, int maxCycles) {
+    undoStack * u = (undoStack *) malloc(sizeof(undoStack));
+    if (u == NULL) die("malloc");
+    u->entries = (undoEntry *) malloc(sizeof(undoEntry) * maxTicks);
+    u->cycles = (undoCycle *) malloc(sizeof(undoCycle) * maxTicks * maxCycles);
+    if (u->entries == NULL || u->cycles == NULL) die("malloc");
+    u->top = 0;
+    u->maxTicks = maxTicks;
+    u->numCycles = 0;
+    u->maxCycles = maxTicks * maxCycles;
+    return u;
+}
+
+// moveCycles for a search: every live cycle takes a step along dirX/dirY and the tick goes on the
+// undo stack, with nothing recorded or sent to bots. False, and nothing done, with no game going
+// or the stack full. Everything it needs is allocated the first time, after that it never does.
+bool makeTick(tron * this) {
+    if (this->curState != IN_GAME) return false;
+    if (this->undo == NULL) this->undo = undoInit(UNDO_MAX_TICKS, this->numCycles);
+    undoStack * u = this->undo;
+    if (u->top == u->maxTicks || u->numCycles + this->numCycles > u->maxCycles) return false;
+
+    undoEntry * e = &u->entries[u->top++];
+    e->hash = this->hash;
+    e->curState = this->curState;
+    e->winner = this->winner;
+    e->numDirty = this->numDirty;
+    e->fullRepaint = this->fullRepaint;
+    e->firstCycle = u->numCycles;
+    for (int i = 0; i < this->numCycles; i++) {
+        lightCycle * cycle = &this->cycles[i];
+        if (!cycle->alive) continue; // stays exactly as it is
+        undoCycle * c = &u->cycles[u->numCycles++];
+        c->cycle = i;
+        c->posX = cycle->posX;
+        c->posY = cycle->posY;
+        c->dirX = cycle->dirX;
+        c->dirY = cycle->dirY;
+        c->lastDirX = cycle->lastDirX;
+        c->lastDirY = cycle->lastDirY;
+    }
+    e->numCycles = u->numCycles - e->firstCycle;
+
+    stepCycles(this);
+    for (int k = e->firstCycle; k < u->numCycles; k++) {
+        undoCycle * c = &u->cycles[k];
+        c->moved = this->cycles[c->cycle].posX != c->posX || this->cycles[c->cycle].posY != c->posY;
+    }
+    return true;
+}
+
+// takes back the last makeTick
+void unmakeTick(tron * this) {
+    undoStack * u = this->undo;
+    undoEntry * e = &u->entries[--u->top];
+    for (int k = e->firstCycle + e->numCycles - 1; k >= e->firstCycle; k--) {
+        undoCycle * c = &u->cycles[k];
+        lightCycle * cycle = &this->cycles[c->cycle];
+        if (c->moved) {
+            setCell(this, cycle->posX, cycle->posY, CELL_EMPTY);
+            setCell(this, c->posX, c->posY, headCell(c->cycle));
+        }
+        cycle->posX = c->posX;
+        cycle->posY = c->posY;
+        cycle->dirX = c->dirX;
+        cycle->dirY = c->dirY;
+        cycle->lastDirX = c->lastDirX;
+        cycle->lastDirY = c->lastDirY;
+        cycle->alive = true;
+    }
+    u->numCycles = e->firstCycle;
+    this->hash = e->hash; // setCell kept it, but the heads went back without
+    this->curState = e->curState;
+    this->winner = e->winner;
+    this->numDirty = e->numDirty;
+    this->fullRepaint = e->fullRepaint;
+    this->numTurn--;
+
+    // a field synced on a board that was taken back would look current when the turn comes round again
+    distanceFields * df = this->distance;
+    for (int i = 0; df != NULL && i < this->numCycles; i++) {
+        if (df->turn[i] > this->numTurn) df->turn[i] = -1;
+    }
+}
+
+// Several keys can arrive between two ticks now, so a turn only has to be perpendicular to
+// where the cycle actually went last tick. Otherwise up+right while heading left is a u-turn.
+void steerCycle(lightCycle * cycle, int dirX, int dirY) {
+    if (cycle->lastDirX * dirX + cycle->lastDirY * dirY != 0) return;
+    cycle->dirX = dirX;
+    cycle->dirY = dirY;
+}
+
+// the move itself, moveCycles already made sure the cell is free and nobody else wants it
+void updateCyclePos(tron * this, int i) {
+    lightCycle * cycle = &this->cycles[i];
+    if (this->arena == NULL) this->hash ^= zobristHead(i, cycleBit(this, i), dirIndex(cycle->lastDirX, cycle->lastDirY));
+    setCell(this, cycle->posX, cycle->posY, trailCell(i));
+    markDirty(this, cycle->posX, cycle->posY);
+    cycle->posX += cycle->dirX;
+    cycle->posY += cycle->dirY;
+    cycle->lastDirX = cycle->dirX;
+    cycle->lastDirY = cycle->dirY;
+    setCell(this, cycle->posX, cycle->posY, headCell(i));
+    markDirty(this, cycle->posX, cycle->posY);
+    if (this->arena == NULL) this->hash ^= zobristHead(i, cycleBit(this, i), dirIndex(cycle->lastDirX, cycle->lastDirY));
+}
+
+// crashed cycles stay where they are, their head turns into a red X
+void killCycle(tron * this, int i) {
+    lightCycle * cycle = &this->cycles[i];
+    // a three way head on kills the first one there twice
+    if (cycle->alive && this->arena == NULL) this->hash ^= zobristHead(i, cycleBit(this, i), dirIndex(cycle->lastDirX, cycle->lastDirY));
+    cycle->alive = false;
+    cycle->dirX = 0;
+    cycle->dirY = 0;
+    markDirty(this, cycle->posX, cycle->posY);
+}
+
+void deathHandler(tron* this) {
+    int numAlive = 0, last = -1;
+    for (int i = 0; i < this->numCycles; i++) {
+        if (this->cycles[i].alive) {
+            numAlive++;
+            last = i;
+        }
+    }
+    if (numAlive > 1) return;
+
+    this->curState = GAME_OVER;
+    this->winner = numAlive == 1 ? last : -1;
+    this->fullRepaint = true; // the message overlay goes on top
+    for (int i = 0; i < this->numCycles; i++) {
+        this->cycles[i].dirX = 0;
+        this->cycles[i].dirY = 0;
+    }
+}
+
+// closest cycle still in the game by Manhattan distance, -1 if we're the last one
+int nearestOpponent(tron * this, int i) {
+    lightCycle * me = &this->cycles[i];
+    int best = -1, bestDistance = 0;
+    for (int c = 0; c < this->numCycles; c++) {
+        lightCycle * other = &this->cycles[c];
+        if (c == i || !other->alive) continue;
+        int distance = abs(other->posX - me->posX) + abs(other->posY - me->posY);
+        if (best == -1 || distance < bestDistance) {
+            best = c;
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+// How far the target would have to travel to get to a cell, around walls and trails. Cells it
+// can't reach at all come last, Manhattan distance to where it's heading breaks ties.
+static int64_t chaseDistance(tron * this, int target, int x, int y, int destX, int destY) {
+    if (this->arena != NULL) return abs(destX - x) + abs(destY - y); // no arena sized fields, straight lines it is
+    int64_t pathLength = cycleDistance(this, target, x, y);
+    return pathLength * (this->boardRows + this->boardCols) + abs(destX - x) + abs(destY - y);
+}
+
+// goes after the nearest cycle when there are more than two
+void computerMakeMove(tron * this, int i) {
+    int targetNum = nearestOpponent(this, i);
+    if (targetNum == -1) return;
+    lightCycle * computer = &this->cycles[i];
+    lightCycle * target = &this->cycles[targetNum];
+    if (this->arena == NULL) distanceFieldSync(this, targetNum);
+
+    // find destination
+    int destX = target->posX + 4 * target->dirX;
+    if (destX < 1) destX = 1;
+    if (destX > this->boardCols - 2) destX = this->boardCols - 2;
+    
+    int destY = target->posY + 2 * target->dirY;
+    if (destY < 1) destY = 1;
+    if (destY > this->boardRows - 2) destY = this->boardRows - 2;
+
+    // try all direction. First check if no death, then minimize distance to destination
+    // default is not turning
+    int nextX = computer->posX + computer->dirX;
+    int nextY = computer->posY + computer->dirY;
+    int64_t bestDistance = chaseDistance(this, targetNum, nextX, nextY, destX, destY);
+    int64_t potentialDistance;
+    bool gonnaCrash = crashChecker(nextX, nextY, this);
+    bool potentialCrash;
+
+    int ogdirX = computer->dirX;
+    int ogdirY = computer->dirY;
+
+    // test up
+    if (ogdirY == 0) {
+        nextX = computer->posX;
+        nextY = computer->posY - 1;
+        potentialDistance = chaseDistance(this, targetNum, nextX, nextY, destX, destY);
+        potentialCrash = crashChecker(nextX, nextY, this);
+
+        bool turnUp = false;
+        if (gonnaCrash && !potentialCrash) {
+            turnUp = true;
+        }
+        else if (!potentialCrash && potentialDistance < bestDistance) {
+            turnUp = true;
+        }
+
+        if (turnUp) {
+            gonnaCrash = potentialCrash;
+            bestDistance = potentialDistance;
+            computer->dirX = 0;
+            computer->dirY = -1;
+        }
+    }
+    // test down
+    if (ogdirY == 0) {
+        nextX = computer->posX;
+        nextY = computer->posY + 1;
+        potentialDistance = chaseDistance(this, targetNum, nextX, nextY, destX, destY);
+        potentialCrash = crashChecker(nextX, nextY, this);
+
+        bool turnDown = false;
+        if (gonnaCrash && !potentialCrash) {
+            turnDown = true;
+        }
+        else if (!potentialCrash && potentialDistance < bestDistance) {
+            turnDown = true;
+        }
+
+        if (turnDown) {
+            gonnaCrash = potentialCrash;
+            bestDistance = potentialDistance;
+            computer->dirX = 0;
+            computer->dirY = 1;
+        }
+    }
+    // test left
+    if (ogdirX == 0) {
+        nextX = computer->posX - 1;
+        nextY = computer->posY;
+        potentialDistance = chaseDistance(this, targetNum, nextX, nextY, destX, destY);
+        potentialCrash = crashChecker(nextX, nextY, this);
+
+        bool turnLeft = false;
+        if (gonnaCrash && !potentialCrash) {
+            turnLeft = true;
+        }
+        else if (!potentialCrash && potentialDistance < bestDistance) {
+            turnLeft = true;
+        }
+
+        if (turnLeft) {
+            gonnaCrash = potentialCrash;
+            bestDistance = potentialDistance;
+            computer->dirX = -1;
+            computer->dirY = 0;
+        }
+    }
+    // test right
+    if (ogdirX == 0) {
+        nextX = computer->posX + 1;
+        nextY = computer->posY;
+        potentialDistance = chaseDistance(this, targetNum, nextX, nextY, destX, destY);
+        potentialCrash = crashChecker(nextX, nextY, this);
+
+        bool turnRight = false;
+        if (gonnaCrash && !potentialCrash) {
+            turnRight = true;
+        }
+        else if (!potentialCrash && potentialDistance < bestDistance) {
+            turnRight = true;
+        }
+        
+        if (turnRight) {
+            gonnaCrash = potentialCrash;
+            bestDistance = potentialDistance;
+            computer->dirX = 1;
+            computer->dirY = 0;
+        }
+    }
+    
+    return;
+}
+
+// anything non-empty is a crash, including the other cycle's head
+bool crashChecker(int nextX, int nextY, tron * this) {
+    if (nextX < 1 || nextX > this->boardCols - 2
+        || nextY < 1 || nextY > this->boardRows - 2) { // make sure we don't get a seg fault
+        return true;
+    }
+    return isOccupied(this, nextX, nextY);
+}
+
+// xorshift32, plenty for start positions and doesn't touch the global rand() state
+uint32_t tronRand(tron * this) {
+    uint32_t x = this->rngState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    this->rngState = x;
+    return x;
+}
+
+void markDirty(tron * this, int x, int y) {
+    x -= this->viewLeft;
+    y -= this->viewTop;
+    if (x < 0 || y < 0 || x >= this->viewCols || y >= this->viewRows) return; // off screen
+    if (this->numDirty == MAX_DIRTY_CELLS) {
+        this->fullRepaint = true;
+        return;
+    }
+    this->dirtyCells[this->numDirty++] = y * this->viewCols + x;
+}
+
+/*** Distance fields ***/
+distanceFields * distanceFieldsInit(tron * this) {
+    int numCells = this->boardRows * this->boardCols;
+    distanceFields * df = (distanceFields *) calloc(1, sizeof(distanceFields));
+    if (df == NULL) die("malloc");
+    df->orphans = (uint64_t *) malloc(sizeof(uint64_t) * numCells);
+    df->queue = (int *) malloc(sizeof(int) * numCells);
+    if (df->orphans == NULL || df->queue == NULL) die("malloc");
+    distanceFieldsInvalidate(df);
+    return df;
+}
+
+void distanceFieldsInvalidate(distanceFields * df) {
+    for (int i = 0; i < MAX_CYCLES; i++) df->turn[i] = -1;
+}
+
+// Bring cycle i's field up to this->numTurn. One tick behind means every cycle still alive moved
+// one cell since, which is repaired in place, anything else (new game, chaser just switched on,
+// cycle i crashed) is a rebuild.
+void distanceFieldSync(tron * this, int i) {
+    if (this->distance == NULL) this->distance = distanceFieldsInit(this);
+    distanceFields * df = this->distance;
+    if (df->turn[i] == this->numTurn) return;
+    if (df->arrival[i] == NULL) {
+        df->arrival[i] = (uint32_t *) malloc(sizeof(uint32_t) * this->boardRows * this->boardCols);
+        if (df->arrival[i] == NULL) die("malloc");
+    }
+
+    lightCycle * cycle = &this->cycles[i];
+    if (df->turn[i] < 0 || df->turn[i] != this->numTurn - 1 || this->curState != IN_GAME || !cycle->alive) {
+        distanceFieldBfs(this, i);
+    }
+    else if (df->backoff[i] > 0) {
+        df->backoff[i]--;
+        distanceFieldBfs(this, i);
+    }
+    else if (!distanceFieldRepair(this, i)) {
+        df->backoff[i] = DIST_BACKOFF_TICKS;
+        distanceFieldBfs(this, i);
+    }
+    df->turn[i] = this->numTurn;
+}
+
+void distanceFieldBfs(tron * this, int i) {
+    lightCycle * cycle = &this->cycles[i];
+    uint32_t * arrival = this->distance->arrival[i];
+    int * queue = this->distance->queue;
+    int cols = this->boardCols;
+    int offsets[4] = {-cols, cols, -1, 1};
+    memset(arrival, 0xff, sizeof(uint32_t) * this->boardRows * cols);
+
+    int head = 0, tail = 0;
+    int source = cycle->posY * cols + cycle->posX;
+    arrival[source] = this->numTurn;
+    queue[tail++] = source;
+    while (head < tail) {
+        int cell = queue[head++];
+        uint32_t next = arrival[cell] + 1;
+        for (int d = 0; d < 4; d++) {
+            int n = cell + offsets[d];
+            if (this->cells[n] != CELL_EMPTY || arrival[n] != DIST_UNREACHABLE) continue;
+            arrival[n] = next;
+            queue[tail++] = n;
+        }
+    }
+    this->distance->reachable[i] = tail;
+    this->distance->turn[i] = this->numTurn;
+    this->distance->rebuilds++;
+}
+
+static int compareU64(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+// Cells only ever fill up during a game, so distances only grow. What filled up last tick is our
+// old head (now trail) and the new head of every other cycle still going. Every cell left without
+// a neighbour one step closer loses its distance, which may orphan its own children in turn, then
+// the orphans are refilled from the cells that kept theirs. Touches only the orphaned region,
+// and gives up (false, the caller rebuilds) once that's too big a part of the field to pay off.
+bool distanceFieldRepair(tron * this, int i) {
+    distanceFields * df = this->distance;
+    uint32_t * arrival = df->arrival[i];
+    int cols = this->boardCols;
+    int offsets[4] = {-cols, cols, -1, 1};
+    uint64_t * orphans = df->orphans;
+    int numOrphans = 0;
+    int maxOrphans = df->reachable[i] / DIST_MAX_ORPHAN_FRACTION;
+
+    lightCycle * me = &this->cycles[i];
+    int source = me->posY * cols + me->posX;
+    for (int c = 0; c < this->numCycles; c++) {
+        lightCycle * cycle = &this->cycles[c];
+        if (!cycle->alive) continue;
+        int cut = c == i ? source - me->lastDirY * cols - me->lastDirX : cycle->posY * cols + cycle->posX;
+        if (arrival[cut] == DIST_UNREACHABLE) continue;
+        orphans[numOrphans++] = (uint64_t) arrival[cut] << 32 | cut;
+        arrival[cut] = DIST_UNREACHABLE;
+    }
+    int numCut = numOrphans;
+    // the orphan list doubles as the queue, so this walks outwards a layer at a time
+    for (int o = 0; o < numOrphans; o++) {
+        int cell = (int) (uint32_t) orphans[o];
+        uint32_t child = (uint32_t) (orphans[o] >> 32) + 1;
+        for (int d = 0; d < 4; d++) {
+            int n = cell + offsets[d];
+            if (arrival[n] != child || n == source) continue;
+            bool supported = false;
+            for (int e = 0; e < 4 && !supported; e++) supported = arrival[n + offsets[e]] == child - 1;
+            if (supported) continue;
+            arrival[n] = DIST_UNREACHABLE;
+            orphans[numOrphans++] = (uint64_t) child << 32 | n;
+        }
+        if (numOrphans > maxOrphans) return false;
+    }
+    df->repaired += numOrphans;
+    df->repairs++;
+
+    // each orphan's best offer from a surviving neighbour, sorted so the BFS below can merge
+    // them in distance order with the cells it reaches itself
+    int numSeeds = 0;
+    for (int o = numCut; o < numOrphans; o++) {
+        int cell = (int) (uint32_t) orphans[o];
+        uint32_t best = DIST_UNREACHABLE;
+        for (int d = 0; d < 4; d++) {
+            if (arrival[cell + offsets[d]] < best) best = arrival[cell + offsets[d]];
+        }
+        if (best != DIST_UNREACHABLE) orphans[numSeeds++] = (uint64_t) (best + 1) << 32 | cell;
+    }
+    for (int o = 0; o < numSeeds; o++) arrival[(uint32_t) orphans[o]] = orphans[o] >> 32;
+    qsort(orphans, numSeeds, sizeof(uint64_t), compareU64);
+
+    int * queue = df->queue;
+    int head = 0, tail = 0, nextSeed = 0, refilled = 0;
+    while (nextSeed < numSeeds || head < tail) {
+        int cell;
+        if (head < tail && (nextSeed == numSeeds || arrival[queue[head]] <= orphans[nextSeed] >> 32)) {
+            cell = queue[head++];
+        }
+        else {
+            uint64_t seed = orphans[nextSeed++];
+            cell = (int) (uint32_t) seed;
+            if (arrival[cell] != seed >> 32) continue; // the BFS got there by a shorter way
+            refilled++;
+        }
+        uint32_t next = arrival[cell] + 1;
+        for (int d = 0; d < 4; d++) {
+            int n = cell + offsets[d];
+            if (this->cells[n] != CELL_EMPTY || next >= arrival[n]) continue;
+            arrival[n] = next;
+            queue[tail++] = n;
+        }
+    }
+    df->reachable[i] -= numOrphans - refilled - tail;
+    return true;
+}
+
+/*** Flood fill ***/
+floodPlanes * floodInit(int wordsPerRow, int rows) {
+    floodPlanes * fp = (floodPlanes *) calloc(1, sizeof(floodPlanes));
+    if (fp == NULL) die("malloc");
+    size_t numWords = (size_t) wordsPerRow * rows;
+    uint64_t * planes = (uint64_t *) calloc(5 * numWords, sizeof(uint64_t)); // zeroed, and every call leaves them so
+    if (planes == NULL) die("malloc");
+    fp->wordsPerRow = wordsPerRow;
+    fp->rows = rows;
+    fp->mine[0] = planes;
+    fp->mine[1] = planes + numWords;
+    fp->theirs[0] = planes + 2 * numWords;
+    fp->theirs[1] = planes + 3 * numWords;
+    fp->claimed = planes + 4 * numWords;
+    fp->pass = floodPassBest();
+    return fp;
+}
+
+// Same partition as a BFS from both heads: a cell goes to whoever gets there in fewer steps,
+// one both reach on the same step is tied and grows no further. oppBit -1 floods from myBit alone.
+// Passes only cover the rows the fronts could have reached, a band that grows a row each way.
+void floodVoronoi(floodPlanes * fp, const uint64_t * occ, int stride, int myBit, int oppBit, floodResult * r) {
+    int lo = myBit / stride, hi = lo;
+    fp->mine[0][myBit >> 6] |= 1ULL << (myBit & 63);
+    if (oppBit >= 0) {
+        int y = oppBit / stride;
+        if (y < lo) lo = y;
+        if (y > hi) hi = y;
+        fp->theirs[0][oppBit >> 6] |= 1ULL << (oppBit & 63);
+    }
+
+    int w = fp->wordsPerRow, cur = 0;
+    uint64_t grew, touched = 0;
+    do {
+        if (lo > 1) lo--;
+        if (hi < fp->rows - 2) hi++;
+        grew = 0;
+        fp->pass(fp, occ, cur, lo * w, (hi + 1) * w, &grew, &touched);
+        cur ^= 1;
+        fp->passes++;
+    } while (grew != 0);
+
+    // count, and clean up after ourselves while the words are at hand
+    int mine = 0, theirs = 0;
+    for (int k = lo * w; k < (hi + 1) * w; k++) {
+        mine += __builtin_popcountll(fp->mine[cur][k]);
+        theirs += __builtin_popcountll(fp->theirs[cur][k]);
+        fp->mine[0][k] = fp->mine[1][k] = fp->theirs[0][k] = fp->theirs[1][k] = fp->claimed[k] = 0;
+    }
+    r->mine = mine - 1; // the heads are trail, not room
+    r->theirs = oppBit >= 0 ? theirs - 1 : 0;
+    r->separated = touched == 0;
+}
+
+// free cells a head can still get to
+int floodArea(floodPlanes * fp, const uint64_t * occ, int stride, int bit) {
+    floodResult r;
+    floodVoronoi(fp, occ, stride, bit, -1, &r);
+    return r.mine;
+}
+
+// One layer over words [from, to): a side grows into the free neighbours of what it has, cells
+// both grow into are tied. Contact is a cell of one side next to a cell of the other, or a tie.
+void floodPassScalar(floodPlanes * fp, const uint64_t * occ, int cur, int from, int to, uint64_t * grew, uint64_t * touched) {
+    const uint64_t * a = fp->mine[cur];
+    const uint64_t * b = fp->theirs[cur];
+    uint64_t * nextA = fp->mine[cur ^ 1];
+    uint64_t * nextB = fp->theirs[cur ^ 1];
+    uint64_t * claimed = fp->claimed;
+    int w = fp->wordsPerRow;
+    uint64_t g = 0, t = 0;
+    for (int k = from; k < to; k++) {
+        uint64_t reachA = a[k] << 1 | a[k - 1] >> 63 | a[k] >> 1 | a[k + 1] << 63 | a[k - w] | a[k + w];
+        uint64_t reachB = b[k] << 1 | b[k - 1] >> 63 | b[k] >> 1 | b[k + 1] << 63 | b[k - w] | b[k + w];
+        uint64_t open = ~(occ[k] | claimed[k]);
+        uint64_t takeA = reachA & open, takeB = reachB & open;
+        uint64_t tie = takeA & takeB;
+        t |= (reachA & b[k]) | tie;
+        takeA &= ~tie;
+        takeB &= ~tie;
+        nextA[k] = a[k] | takeA;
+        nextB[k] = b[k] | takeB;
+        claimed[k] |= takeA | takeB | tie;
+        g |= takeA | takeB;
+    }
+    *grew |= g;
+    *touched |= t;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+void floodPassSse2(floodPlanes * fp, const uint64_t * occ, int cur, int from, int to, uint64_t * grew, uint64_t * touched) {
+    const uint64_t * a = fp->mine[cur];
+    const uint64_t * b = fp->theirs[cur];
+    uint64_t * nextA = fp->mine[cur ^ 1];
+    uint64_t * nextB = fp->theirs[cur ^ 1];
+    uint64_t * claimed = fp->claimed;
+    int w = fp->wordsPerRow;
+    __m128i g = _mm_setzero_si128(), t = _mm_setzero_si128();
+    int k = from;
+    for (; k + 2 <= to; k += 2) {
+        __m128i av = _mm_loadu_si128((const __m128i *) &a[k]);
+        __m128i bv = _mm_loadu_si128((const __m128i *) &b[k]);
+        __m128i reachA = _mm_or_si128(_mm_or_si128(_mm_slli_epi64(av, 1), _mm_srli_epi64(_mm_loadu_si128((const __m128i *) &a[k - 1]), 63)),
+                         _mm_or_si128(_mm_or_si128(_mm_srli_epi64(av, 1), _mm_slli_epi64(_mm_loadu_si128((const __m128i *) &a[k + 1]), 63)),
+                         _mm_or_si128(_mm_loadu_si128((const __m128i *) &a[k - w]), _mm_loadu_si128((const __m128i *) &a[k + w]))));
+        __m128i reachB = _mm_or_si128(_mm_or_si128(_mm_slli_epi64(bv, 1), _mm_srli_epi64(_mm_loadu_si128((const __m128i *) &b[k - 1]), 63)),
+                         _mm_or_si128(_mm_or_si128(_mm_srli_epi64(bv, 1), _mm_slli_epi64(_mm_loadu_si128((const __m128i *) &b[k + 1]), 63)),
+                         _mm_or_si128(_mm_loadu_si128((const __m128i *) &b[k - w]), _mm_loadu_si128((const __m128i *) &b[k + w]))));
+        __m128i cl = _mm_loadu_si128((const __m128i *) &claimed[k]);
+        __m128i taken = _mm_or_si128(_mm_loadu_si128((const __m128i *) &occ[k]), cl);
+        __m128i takeA = _mm_andnot_si128(taken, reachA), takeB = _mm_andnot_si128(taken, reachB);
+        __m128i tie = _mm_and_si128(takeA, takeB);
+        t = _mm_or_si128(t, _mm_or_si128(_mm_and_si128(reachA, bv), tie));
+        takeA = _mm_andnot_si128(tie, takeA);
+        takeB = _mm_andnot_si128(tie, takeB);
+        _mm_storeu_si128((__m128i *) &nextA[k], _mm_or_si128(av, takeA));
+        _mm_storeu_si128((__m128i *) &nextB[k], _mm_or_si128(bv, takeB));
+        _mm_storeu_si128((__m128i *) &claimed[k], _mm_or_si128(cl, _mm_or_si128(_mm_or_si128(takeA, takeB), tie)));
+        g = _mm_or_si128(g, _mm_or_si128(takeA, takeB));
+    }
+    uint64_t lanes[4];
+    _mm_storeu_si128((__m128i *) &lanes[0], g);
+    _mm_storeu_si128((__m128i *) &lanes[2], t);
+    *grew |= lanes[0] | lanes[1];
+    *touched |= lanes[2] | lanes[3];
+    if (k < to) floodPassScalar(fp, occ, cur, k, to, grew, touched);
+}
+
+__attribute__((target("avx2")))
+void floodPassAvx2(floodPlanes * fp, const uint64_t * occ, int cur, int from, int to, uint64_t * grew, uint64_t * touched) {
+    const uint64_t * a = fp->mine[cur];
+    const uint64_t * b = fp->theirs[cur];
+    uint64_t * nextA = fp->mine[cur ^ 1];
+    uint64_t * nextB = fp->theirs[cur ^ 1];
+    uint64_t * claimed = fp->claimed;
+    int w = fp->wordsPerRow;
+    __m256i g = _mm256_setzero_si256(), t = _mm256_setzero_si256();
+    int k = from;
+    for (; k + 4 <= to; k += 4) {
+        __m256i av = _mm256_loadu_si256((const __m256i *) &a[k]);
+        __m256i bv = _mm256_loadu_si256((const __m256i *) &b[k]);
+        __m256i reachA = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi64(av, 1), _mm256_srli_epi64(_mm256_loadu_si256((const __m256i *) &a[k - 1]), 63)),
+                         _mm256_or_si256(_mm256_or_si256(_mm256_srli_epi64(av, 1), _mm256_slli_epi64(_mm256_loadu_si256((const __m256i *) &a[k + 1]), 63)),
+                         _mm256_or_si256(_mm256_loadu_si256((const __m256i *) &a[k - w]), _mm256_loadu_si256((const __m256i *) &a[k + w]))));
+        __m256i reachB = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi64(bv, 1), _mm256_srli_epi64(_mm256_loadu_si256((const __m256i *) &b[k - 1]), 63)),
+                         _mm256_or_si256(_mm256_or_si256(_mm256_srli_epi64(bv, 1), _mm256_slli_epi64(_mm256_loadu_si256((const __m256i *) &b[k + 1]), 63)),
+                         _mm256_or_si256(_mm256_loadu_si256((const __m256i *) &b[k - w]), _mm256_loadu_si256((const __m256i *) &b[k + w]))));
+        __m256i cl = _mm256_loadu_si256((const __m256i *) &claimed[k]);
+        __m256i taken = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) &occ[k]), cl);
+        __m256i takeA = _mm256_andnot_si256(taken, reachA), takeB = _mm256_andnot_si256(taken, reachB);
+        __m256i tie = _mm256_and_si256(takeA, takeB);
+        t = _mm256_or_si256(t, _mm256_or_si256(_mm256_and_si256(reachA, bv), tie));
+        takeA = _mm256_andnot_si256(tie, takeA);
+        takeB = _mm256_andnot_si256(tie, takeB);
+        _mm256_storeu_si256((__m256i *) &nextA[k], _mm256_or_si256(av, takeA));
+        _mm256_storeu_si256((__m256i *) &nextB[k], _mm256_or_si256(bv, takeB));
+        _mm256_storeu_si256((__m256i *) &claimed[k], _mm256_or_si256(cl, _mm256_or_si256(_mm256_or_si256(takeA, takeB), tie)));
+        g = _mm256_or_si256(g, _mm256_or_si256(takeA, takeB));
+    }
+    *grew |= !_mm256_testz_si256(g, g);
+    *touched |= !_mm256_testz_si256(t, t);
+    if (k < to) floodPassScalar(fp, occ, cur, k, to, grew, touched);
+}
+#endif
+
+floodPassFn floodPassBest(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return floodPassAvx2;
+    if (__builtin_cpu_supports("sse2")) return floodPassSse2;
+#endif
+    return floodPassScalar;
+}
+
+const char * floodPassName(floodPassFn pass) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (pass == floodPassAvx2) return "avx2";
+    if (pass == floodPassSse2) return "sse2";
+#endif
+    return "scalar";
+}
+
+/*** Search AI ***/
+// Alpha-beta over simultaneous moves: we pick a direction, the opponent answers knowing it
+// (pessimistic, but that's what keeps us out of traps), then both cycles move at once.
+// Leaves are scored by space control, i.e. how many cells each cycle reaches first. With more
+// than two cycles the opponent is the nearest one and everybody else is just in the way.
+static const int searchDirX[4] = {0, 0, -1, 1};
+static const int searchDirY[4] = {-1, 1, 0, 0};
+
+// the searches copy the whole board every move, an arena gets the chaser unless a bot was picked
+void aiMakeMove(tron * this, int i) {
+    if (this->arena != NULL && this->cycles[i].engine != AI_NONE && this->cycles[i].engine != AI_BOT) {
+        computerMakeMove(this, i);
+        return;
+    }
+    switch (this->cycles[i].engine) {
+        case AI_CHASER:
+            computerMakeMove(this, i);
+            break;
+        case AI_MINIMAX:
+            minimaxMakeMove(this, i);
+            break;
+        case AI_MCTS:
+            mctsMakeMove(this, i);
+            break;
+        case AI_BOT:
+            botMakeMove(this, i);
+            break;
+        default:
+            break;
+    }
+}
+
+const char * engineName(aiEngine engine) {
+    switch (engine) {
+        case AI_CHASER: return "chaser";
+        case AI_MINIMAX: return "minimax";
+        case AI_MCTS: return "mcts";
+        case AI_BOT: return "bot";
+        default: return "human";
+    }
+}
+
+aiEngine parseEngine(const char * name) {
+    if (strcmp(name, "chaser") == 0) return AI_CHASER;
+    if (strcmp(name, "minimax") == 0) return AI_MINIMAX;
+    if (strcmp(name, "mcts") == 0) return AI_MCTS;
+    if (strcmp(name, "bot") == 0) return AI_BOT;
+    return AI_NONE;
+}
+
+searchContext * searchInit(tron * this) {
+    searchContext * ctx = (searchContext *) malloc(sizeof(searchContext));
+    if (ctx == NULL) die("malloc");
+    ctx->stride = this->wordsPerRow * 64;
+    ctx->numWords = this->wordsPerRow * this->boardRows;
+    ctx->occ = (uint64_t *) malloc(sizeof(uint64_t) * ctx->numWords);
+    if (ctx->occ == NULL) die("malloc");
+    ctx->flood = floodInit(this->wordsPerRow, this->boardRows);
+    ctx->trials = 0;
+    ctx->trialNs[0] = ctx->trialNs[1] = 0;
+    ctx->scoreByBfs = false;
+    ctx->leafNs = 0;
+    ctx->queue = NULL;
+    ctx->dist = NULL;
+    ctx->owner = NULL;
+    ctx->visited = NULL;
+    ctx->generation = 0;
+    return ctx;
+}
+
+static inline bool searchOccupied(searchContext * ctx, int bit) {
+    return (ctx->occ[bit >> 6] >> (bit & 63)) & 1;
+}
+
+static inline void searchSet(searchContext * ctx, int bit) {
+    ctx->occ[bit >> 6] |= 1ULL << (bit & 63);
+}
+
+static inline void searchClear(searchContext * ctx, int bit) {
+    ctx->occ[bit >> 6] &= ~(1ULL << (bit & 63));
+}
+
+// Free cells the searcher gets to first minus the ones the opponent does, off the bit planes
+// or by BFS, whichever was faster on this board's first VORONOI_TRIALS leaves.
+int voronoiScore(searchContext * ctx, int myBit, int oppBit) {
+    bool trial = ctx->trials < VORONOI_TRIALS;
+    bool bfs = trial ? ctx->trials & 1 : ctx->scoreByBfs;
+    uint64_t t = trial ? nowNs() : 0;
+    int score;
+    bool separated;
+    if (bfs) score = voronoiScoreBfs(ctx, myBit, oppBit, &separated);
+    else {
+        floodResult r;
+        floodVoronoi(ctx->flood, ctx->occ, ctx->stride, myBit, oppBit, &r);
+        score = r.mine - r.theirs;
+        separated = r.separated;
+    }
+    if (trial) {
+        ctx->trialNs[bfs] += nowNs() - t;
+        if (++ctx->trials == VORONOI_TRIALS) ctx->scoreByBfs = ctx->trialNs[1] < ctx->trialNs[0];
+    }
+    if (separated) ctx->separated++;
+    return score;
+}
+
+const char * voronoiScorerName(searchContext * ctx) {
+    return ctx->scoreByBfs ? "bfs" : floodPassName(ctx->flood->pass);
+}
+
+// The same score a cell at a time, kept as the reference --bench-flood checks and times the
+// kernel against. Multi source BFS from both heads: cells reached first by one side count for it,
+// cells both reach at the same time count for nobody. Walls surround the board so no bounds checks.
+int voronoiScoreBfs(searchContext * ctx, int myBit, int oppBit, bool * separated) {
+    enum { MINE = 0, THEIRS = 1, TIED = 2 };
+    int offsets[4] = {-ctx->stride, ctx->stride, -1, 1};
+    int count[3] = {0, 0, 0};
+    int numBits = ctx->numWords * 64;
+    if (ctx->queue == NULL) {
+        ctx->queue = (int *) malloc(sizeof(int) * numBits);
+        ctx->visited = (uint32_t *) calloc(numBits, sizeof(uint32_t));
+        ctx->dist = (int *) malloc(sizeof(int) * numBits);
+        ctx->owner = (uint8_t *) malloc(numBits);
+        if (ctx->queue == NULL || ctx->visited == NULL || ctx->dist == NULL || ctx->owner == NULL) die("malloc");
+    }
+    bool touched = false;
+    uint32_t gen = ++ctx->generation;
+    if (gen == 0) { // wrapped, stale stamps could look current
+        memset(ctx->visited, 0, sizeof(uint32_t) * numBits);
+        gen = ctx->generation = 1;
+    }
+
+    int head = 0, tail = 0;
+    ctx->visited[myBit] = gen;
+    ctx->dist[myBit] = 0;
+    ctx->owner[myBit] = MINE;
+    ctx->queue[tail++] = myBit;
+    ctx->visited[oppBit] = gen;
+    ctx->dist[oppBit] = 0;
+    ctx->owner[oppBit] = THEIRS;
+    ctx->queue[tail++] = oppBit;
+
+    while (head < tail) {
+        int cell = ctx->queue[head++];
+        int owner = ctx->owner[cell];
+        if (owner == TIED) {
+            touched = true;
+            continue;
+        }
+        int nextDist = ctx->dist[cell] + 1;
+
+        for (int d = 0; d < 4; d++) {
+            int next = cell + offsets[d];
+            // heads are trail as well, look before skipping
+            if (ctx->visited[next] == gen && ctx->owner[next] != owner && ctx->owner[next] != TIED) touched = true;
+            if (searchOccupied(ctx, next)) continue;
+            if (ctx->visited[next] != gen) {
+                ctx->visited[next] = gen;
+                ctx->dist[next] = nextDist;
+                ctx->owner[next] = owner;
+                ctx->queue[tail++] = next;
+                count[owner]++;
+            }
+            else if (ctx->dist[next] == nextDist && ctx->owner[next] != owner && ctx->owner[next] != TIED) {
+                count[ctx->owner[next]]--;
+                ctx->owner[next] = TIED;
+            }
+        }
+    }
+    *separated = !touched;
+    return count[MINE] - count[THEIRS];
+}
+
+// Answers a node from the table when the entry was searched at least this deep and its bound
+// settles it for this window, otherwise hands back the entry's best move to try first.
+static bool searchProbe(searchContext * ctx, int depth, int ply, int alpha, int beta, int * score, int * move) {
+    ttEntry e;
+    ctx->ttProbes++;
+    if (!ttProbe(ctx->tt, ctx->hash, &e)) return false;
+    ctx->ttHits++;
+    *move = e.move;
+    if (e.depth < depth) return false;
+    // crashes are stored plies from the node, not from whichever root found them
+    int value = e.score;
+    if (value >= SEARCH_DECIDED) value -= ply;
+    else if (value <= -SEARCH_DECIDED) value += ply;
+    if (e.bound == TT_EXACT || (e.bound == TT_LOWER && value >= beta) || (e.bound == TT_UPPER && value <= alpha)) {
+        ctx->ttCutoffs++;
+        *score = value;
+        return true;
+    }
+    return false;
+}
+
+static void searchStore(searchContext * ctx, int depth, int ply, int score, ttBound bound, int move) {
+    if (score >= SEARCH_DECIDED) score += ply;
+    else if (score <= -SEARCH_DECIDED) score -= ply;
+    ttStore(ctx->tt, ctx->hash, depth, score, bound, move, ctx->ttGeneration);
+}
+
+// Every node counts down to a look at the clock, so a tree the table answers is still cut off in time
+static inline bool searchOutOfTime(searchContext * ctx) {
+    if (--ctx->clockCountdown > 0) return ctx->outOfTime;
+    ctx->clockCountdown = SEARCH_CLOCK_NODES;
+    if (nowNs() > ctx->deadline) ctx->outOfTime = true;
+    return ctx->outOfTime;
+}
+
+int searchMax(searchContext * ctx, int depth, int ply, int myDir, int oppDir, int alpha, int beta) {
+    if (searchOutOfTime(ctx)) return 0;
+    int ttMove = 0, score;
+    if (ctx->tt != NULL && searchProbe(ctx, depth, ply, alpha, beta, &score, &ttMove)) return score;
+
+    int order[4] = {0, 1, 2, 3};
+    order[ttMove] = 0;
+    order[0] = ttMove;
+    int alphaStart = alpha;
+    int best = -SEARCH_INF, bestMove = ttMove;
+    for (int i = 0; i < 4; i++) {
+        int m = order[i];
+        if (m == (myDir ^ 1)) continue; // reversing is running into our own trail
+        score = searchMin(ctx, depth, ply, myDir, m, oppDir, alpha, beta);
+        if (ctx->outOfTime) return 0;
+        if (score > best) {
+            best = score;
+            bestMove = m;
+        }
+        if (best > alpha) alpha = best;
+        if (alpha >= beta) break;
+    }
+    if (ctx->tt != NULL) {
+        ttBound bound = best <= alphaStart ? TT_UPPER : best >= beta ? TT_LOWER : TT_EXACT;
+        searchStore(ctx, depth, ply, best, bound, bestMove);
+    }
+    return best;
+}
+
+int searchMin(searchContext * ctx, int depth, int ply, int myDir, int myMove, int oppDir, int alpha, int beta) {
+    int offsets[4] = {-ctx->stride, ctx->stride, -1, 1};
+    int best = SEARCH_INF;
+    int myBit = ctx->myBit;
+    int oppBit = ctx->oppBit;
+    int myNext = myBit + offsets[myMove];
+    uint64_t hash = ctx->hash;
+    uint64_t myStep = zobristKey(myNext, ZOBRIST_OCCUPIED) ^ zobristHead(ctx->me, myBit, myDir) ^ zobristHead(ctx->me, myNext, myMove);
+
+    for (int o = 0; o < 4; o++) {
+        if (o == (oppDir ^ 1)) continue;
+        int oppNext = oppBit + offsets[o];
+        bool myDead = searchOccupied(ctx, myNext);
+        bool oppDead = searchOccupied(ctx, oppNext);
+        if (myNext == oppNext) myDead = oppDead = true;
+
+        int score;
+        if (myDead && oppDead) score = 0;
+        else if (myDead) score = -SEARCH_WIN + ply; // lose as late as possible
+        else if (oppDead) score = SEARCH_WIN - ply; // and win as early as possible
+        else {
+            searchSet(ctx, myNext);
+            searchSet(ctx, oppNext);
+            ctx->myBit = myNext;
+            ctx->oppBit = oppNext;
+            ctx->hash = hash ^ myStep ^ zobristKey(oppNext, ZOBRIST_OCCUPIED) ^ zobristHead(ctx->opp, oppBit, oppDir) ^
+                        zobristHead(ctx->opp, oppNext, o);
+
+            if (depth <= 1) score = searchLeaf(ctx);
+            else score = searchMax(ctx, depth - 1, ply + 1, myMove, o, alpha, beta);
+
+            ctx->hash = hash;
+            ctx->myBit = myBit;
+            ctx->oppBit = oppBit;
+            searchClear(ctx, myNext);
+            searchClear(ctx, oppNext);
+            if (ctx->outOfTime) return 0;
+        }
+
+        if (score < best) best = score;
+        if (best < beta) beta = best;
+        if (alpha >= beta) break;
+    }
+    return best;
+}
+
+// Evaluated once and remembered at depth 0, the next tick's search starts a ply further on and
+// meets most of this one's leaves again
+int searchLeaf(searchContext * ctx) {
+    if (searchOutOfTime(ctx)) return 0;
+    ttEntry e;
+    if (ctx->tt != NULL) {
+        ctx->ttProbes++;
+        if (ttProbe(ctx->tt, ctx->hash, &e)) {
+            ctx->ttHits++;
+            if (e.depth == 0) {
+                ctx->ttCutoffs++;
+                return e.score;
+            }
+        }
+    }
+    // the clock every time here, a leaf is most of the work and takes milliseconds on a big board
+    uint64_t start = nowNs();
+    if (start + ctx->leafNs > ctx->deadline) {
+        ctx->outOfTime = true;
+        return 0;
+    }
+    ctx->nodes++;
+    int score = voronoiScore(ctx, ctx->myBit, ctx->oppBit);
+    uint64_t took = nowNs() - start;
+    ctx->leafNs = took > ctx->leafNs ? took : (ctx->leafNs * 15 + took) / 16; // slow ones count in full
+    if (ctx->tt != NULL) ttStore(ctx->tt, ctx->hash, 0, score, TT_EXACT, 0, ctx->ttGeneration);
+    return score;
+}
+
+int dirIndex(int dirX, int dirY) {
+    for (int d = 0; d < 4; d++) {
+        if (searchDirX[d] == dirX && searchDirY[d] == dirY) return d;
+    }
+    return 3;
+}
+
+void minimaxMakeMove(tron * this, int i) {
+    int move = minimaxSearch(this, i, SEARCH_MAX_DEPTH, this->aiBudgetNs);
+    if (move == -1) return;
+    this->cycles[i].dirX = searchDirX[move];
+    this->cycles[i].dirY = searchDirY[move];
+}
+
+// Iterative deepening until the time budget runs out, the answer is decided, or the search
+// stops learning anything. Only fully searched depths count, except that running out during
+// depth 1 plays the best root move it finished, or failing that one that isn't straight into
+// a wall. The budget is never waited out. Returns the move for cycle i, or -1 with nobody left
+// to play against.
+int minimaxSearch(tron * this, int i, int maxDepth, uint64_t budgetNs) {
+    int oppIndex = nearestOpponent(this, i);
+    if (oppIndex == -1) return -1;
+    lightCycle * me = &this->cycles[i];
+    lightCycle * opp = &this->cycles[oppIndex];
+    if (this->search == NULL) this->search = searchInit(this);
+    searchContext * ctx = this->search;
+
+    memcpy(ctx->occ, this->occupied, sizeof(uint64_t) * ctx->numWords);
+    ctx->myBit = me->posY * ctx->stride + me->posX;
+    ctx->oppBit = opp->posY * ctx->stride + opp->posX;
+    ctx->deadline = nowNs() + budgetNs;
+    ctx->clockCountdown = SEARCH_CLOCK_NODES;
+    ctx->outOfTime = false;
+    ctx->nodes = 0;
+    ctx->separated = 0;
+    ctx->depthReached = 0;
+
+    // the board's key plus whose side the scores are from, the other cycles stay where they are
+    ctx->me = i;
+    ctx->opp = oppIndex;
+    ctx->hash = this->hash ^ zobristKey((uint64_t) i, ZOBRIST_SEARCHER);
+    ctx->tt = this->tt;
+    ctx->ttProbes = 0;
+    ctx->ttHits = 0;
+    ctx->ttCutoffs = 0;
+
+    int offsets[4] = {-ctx->stride, ctx->stride, -1, 1};
+    int myDir = dirIndex(me->lastDirX, me->lastDirY);
+    int oppDir = dirIndex(opp->lastDirX, opp->lastDirY);
+    int bestMove = dirIndex(me->dirX, me->dirY);
+    int order[4] = {0, 1, 2, 3};
+
+    ttEntry e;
+    if (ctx->tt != NULL) {
+        ctx->ttGeneration = (uint8_t) (atomic_fetch_add(&ctx->tt->generation, 1) + 1);
+        // last tick's search usually went through here already
+        if (ttProbe(ctx->tt, ctx->hash, &e) && e.depth > 0 && e.move != (myDir ^ 1)) bestMove = e.move;
+    }
+
+    for (int depth = 1; depth <= maxDepth; depth++) {
+        // best move from the previous depth goes first, it's usually still best
+        for (int k = 0; k < 4; k++) {
+            if (order[k] == bestMove) {
+                order[k] = order[0];
+                order[0] = bestMove;
+            }
+        }
+
+        int alpha = -SEARCH_INF;
+        int depthBest = -1;
+        for (int k = 0; k < 4; k++) {
+            int m = order[k];
+            if (m == (myDir ^ 1)) continue;
+            int score = searchMin(ctx, depth, 1, myDir, m, oppDir, alpha, SEARCH_INF);
+            if (ctx->outOfTime) break;
+            if (depthBest == -1 || score > alpha) {
+                alpha = score;
+                depthBest = m;
+            }
+        }
+        if (ctx->outOfTime) {
+            if (depth == 1 && depthBest != -1) bestMove = depthBest;
+            break;
+        }
+
+        bestMove = depthBest;
+        ctx->depthReached = depth;
+        if (ctx->tt != NULL) searchStore(ctx, depth, 1, alpha, TT_EXACT, bestMove);
+        if (alpha >= SEARCH_WIN - SEARCH_MAX_DEPTH || alpha <= -SEARCH_WIN + SEARCH_MAX_DEPTH) break; // decided
+        if (nowNs() > ctx->deadline) break;
+    }
+    if (ctx->depthReached == 0 && (bestMove == (myDir ^ 1) || searchOccupied(ctx, ctx->myBit + offsets[bestMove]))) {
+        for (int m = 0; m < 4; m++) {
+            if (m == (myDir ^ 1) || searchOccupied(ctx, ctx->myBit + offsets[m])) continue;
+            bestMove = m;
+            break;
+        }
+    }
+    return bestMove;
+}
+
+// megabytes rounded down to a power of two of slots, NULL for none at all
+transTable * ttInit(int megabytes) {
+    if (megabytes <= 0) return NULL;
+    uint64_t numSlots = 1;
+    while (numSlots * 2 * sizeof(ttSlot) <= (uint64_t) megabytes << 20) numSlots *= 2;
+    transTable * tt = (transTable *) malloc(sizeof(transTable));
+    if (tt == NULL) die("malloc");
+    tt->slots = (ttSlot *) calloc(numSlots, sizeof(ttSlot)); // all zero is TT_NONE everywhere
+    if (tt->slots == NULL) die("malloc");
+    tt->mask = numSlots - 1;
+    atomic_init(&tt->generation, 0);
+    return tt;
+}
+
+bool ttProbe(transTable * tt, uint64_t key, ttEntry * e) {
+    ttSlot * slot = &tt->slots[key & tt->mask];
+    uint64_t data = atomic_load_explicit(&slot->data, memory_order_relaxed);
+    uint64_t check = atomic_load_explicit(&slot->check, memory_order_relaxed);
+    if ((check ^ data) != key || ((data >> 40) & 3) == TT_NONE) return false; // another position, or torn
+    e->score = (int32_t) (uint32_t) data;
+    e->depth = (int) ((data >> 32) & 0xff);
+    e->bound = (ttBound) ((data >> 40) & 3);
+    e->move = (int) ((data >> 42) & 3);
+    return true;
+}
+
+// data is score | depth << 32 | bound << 40 | move << 42 | generation << 48. One slot per key, a
+// deeper result from the same search keeps it, anything older gives way.
+void ttStore(transTable * tt, uint64_t key, int depth, int score, ttBound bound, int move, uint8_t generation) {
+    ttSlot * slot = &tt->slots[key & tt->mask];
+    uint64_t old = atomic_load_explicit(&slot->data, memory_order_relaxed);
+    if (((old >> 40) & 3) != TT_NONE && (uint8_t) (old >> 48) == generation && (int) ((old >> 32) & 0xff) > depth) return;
+    uint64_t data = (uint64_t) (uint32_t) score | (uint64_t) depth << 32 | (uint64_t) bound << 40 |
+                    (uint64_t) move << 42 | (uint64_t) generation << 48;
+    atomic_store_explicit(&slot->data, data, memory_order_relaxed);
+    atomic_store_explicit(&slot->check, key ^ data, memory_order_relaxed);
+}
+
+/*** Monte Carlo AI ***/
+// Root parallel MCTS: every worker grows its own tree from the current position and adds its
+// root results into shared atomic counters, so threads never wait on each other mid search.
+// Moves are relative (straight/left/right), the same three directions computerMakeMove tries.
+// Both sides pick with their own UCB1 statistics at every node (decoupled UCT), children are
+// keyed by the joint move, and playouts are random but skip moves that crash immediately.
+
+// absolute direction (searchDirX/Y index) after making relative move rel from heading dir
+static inline int mctsTurn(int dir, int rel) {
+    if (rel == 0) return dir;
+    if (dir < 2) return rel == 1 ? 2 : 3;
+    return rel == 1 ? 0 : 1;
+}
+
+static inline uint32_t mctsRand(mctsWorker * w) {
+    uint32_t x = w->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    w->rng = x;
+    return x;
+}
+
+static inline bool mctsOccupied(mctsWorker * w, int bit) {
+    return (w->occ[bit >> 6] >> (bit & 63)) & 1;
+}
+
+static inline void mctsOccupy(mctsWorker * w, int bit) {
+    w->occ[bit >> 6] |= 1ULL << (bit & 63);
+    w->touched[w->numTouched++] = bit;
+}
+
+mctsContext * mctsInit(tron * this, int numWorkers) {
+    mctsContext * ctx = (mctsContext *) calloc(1, sizeof(mctsContext));
+    if (ctx == NULL) die("malloc");
+    ctx->numWords = this->wordsPerRow * this->boardRows;
+    ctx->stride = this->wordsPerRow * 64;
+    ctx->numWorkers = numWorkers;
+    ctx->workers = (mctsWorker *) calloc(numWorkers, sizeof(mctsWorker));
+    if (ctx->workers == NULL) die("malloc");
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_cond_init(&ctx->start, NULL);
+    pthread_cond_init(&ctx->done, NULL);
+
+    for (int i = 0; i < numWorkers; i++) {
+        mctsWorker * w = &ctx->workers[i];
+        w->ctx = ctx;
+        w->occ = (uint64_t *) malloc(sizeof(uint64_t) * ctx->numWords);
+        w->touched = (int *) malloc(sizeof(int) * (2 * MCTS_MAX_PLIES + 2));
+        w->nodes = (mctsNode *) malloc(sizeof(mctsNode) * MCTS_MAX_NODES);
+        if (w->occ == NULL || w->touched == NULL || w->nodes == NULL) die("malloc");
+        w->rng = 0x9e3779b9u * (i + 1);
+        // worker 0 is whoever calls mctsMakeMove, the rest sit in the pool
+        if (i > 0 && pthread_create(&w->thread, NULL, mctsWorkerMain, w) != 0) die("pthread_create");
+    }
+    return ctx;
+}
+
+void * mctsWorkerMain(void * arg) {
+    mctsWorker * w = (mctsWorker *) arg;
+    mctsContext * ctx = w->ctx;
+    int seenJob = 0;
+
+    pthread_mutex_lock(&ctx->lock);
+    while (1) {
+        while (!ctx->quit && ctx->jobId == seenJob) pthread_cond_wait(&ctx->start, &ctx->lock);
+        if (ctx->quit) break;
+        seenJob = ctx->jobId;
+        pthread_mutex_unlock(&ctx->lock);
+
+        mctsSearch(w);
+
+        pthread_mutex_lock(&ctx->lock);
+        if (--ctx->running == 0) pthread_cond_signal(&ctx->done);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+static int mctsNewNode(mctsWorker * w) {
+    if (w->numNodes == MCTS_MAX_NODES) return -1;
+    mctsNode * node = &w->nodes[w->numNodes];
+    memset(node, 0, sizeof(mctsNode));
+    for (int i = 0; i < 9; i++) node->child[i] = -1;
+    return w->numNodes++;
+}
+
+static int mctsSelect(uint32_t visits, const uint32_t * moveVisits, const float * moveValue) {
+    int best = 0;
+    float bestUcb = -1.0f;
+    float logVisits = logf((float) visits + 1.0f);
+    for (int m = 0; m < 3; m++) {
+        if (moveVisits[m] == 0) return m; // try everything once first
+        float ucb = moveValue[m] / moveVisits[m] + MCTS_EXPLORATION * sqrtf(logVisits / moveVisits[m]);
+        if (ucb > bestUcb) {
+            bestUcb = ucb;
+            best = m;
+        }
+    }
+    return best;
+}
+
+// both cycles step at once, returns our reward if that ended the game or -1 if it goes on
+static float mctsStep(mctsWorker * w, int * myBit, int * oppBit, int myDir, int oppDir) {
+    mctsContext * ctx = w->ctx;
+    int offsets[4] = {-ctx->stride, ctx->stride, -1, 1};
+    int myNext = *myBit + offsets[myDir];
+    int oppNext = *oppBit + offsets[oppDir];
+    bool myDead = mctsOccupied(w, myNext);
+    bool oppDead = mctsOccupied(w, oppNext);
+    if (myNext == oppNext) myDead = oppDead = true;
+
+    if (myDead && oppDead) return 0.5f;
+    if (myDead) return 0.0f;
+    if (oppDead) return 1.0f;
+    mctsOccupy(w, myNext);
+    mctsOccupy(w, oppNext);
+    *myBit = myNext;
+    *oppBit = oppNext;
+    return -1.0f;
+}
+
+// random moves for both sides, avoiding anything that crashes right away when possible
+static float mctsPlayout(mctsWorker * w, int myBit, int oppBit, int myDir, int oppDir, int plies) {
+    mctsContext * ctx = w->ctx;
+    int offsets[4] = {-ctx->stride, ctx->stride, -1, 1};
+
+    for (; plies < MCTS_MAX_PLIES; plies++) {
+        int dirs[2] = {myDir, oppDir};
+        int heads[2] = {myBit, oppBit};
+        for (int p = 0; p < 2; p++) {
+            int safe[3], numSafe = 0;
+            for (int rel = 0; rel < 3; rel++) {
+                int d = mctsTurn(dirs[p], rel);
+                if (!mctsOccupied(w, heads[p] + offsets[d])) safe[numSafe++] = d;
+            }
+            if (numSafe > 0) dirs[p] = safe[mctsRand(w) % numSafe];
+        }
+        myDir = dirs[0];
+        oppDir = dirs[1];
+        float result = mctsStep(w, &myBit, &oppBit, myDir, oppDir);
+        if (result >= 0.0f) return result;
+    }
+    return 0.5f; // nobody died within the horizon
+}
+
+void mctsSearch(mctsWorker * w) {
+    mctsContext * ctx = w->ctx;
+    w->numNodes = 0;
+    w->playouts = 0;
+    int root = mctsNewNode(w);
+    memcpy(w->occ, ctx->rootOcc, sizeof(uint64_t) * ctx->numWords);
+
+    int path[MCTS_MAX_PLIES][3]; // node, my move, opp move
+    for (long iter = 0; ; iter++) {
+        if ((iter & 15) == 0 && nowNs() > ctx->deadline) break;
+
+        int myBit = ctx->myBit, oppBit = ctx->oppBit;
+        int myDir = ctx->myDir, oppDir = ctx->oppDir;
+        int depth = 0;
+        int nodeIndex = root;
+        float reward = -1.0f;
+        w->numTouched = 0;
+
+        // selection and expansion
+        while (depth < MCTS_MAX_PLIES) {
+            mctsNode * node = &w->nodes[nodeIndex];
+            int m = mctsSelect(node->visits, node->myVisits, node->myValue);
+            int o = mctsSelect(node->visits, node->oppVisits, node->oppValue);
+            path[depth][0] = nodeIndex;
+            path[depth][1] = m;
+            path[depth][2] = o;
+            depth++;
+
+            myDir = mctsTurn(myDir, m);
+            oppDir = mctsTurn(oppDir, o);
+            reward = mctsStep(w, &myBit, &oppBit, myDir, oppDir);
+            if (reward >= 0.0f) break;
+
+            int next = node->child[m * 3 + o];
+            if (next == -1) {
+                next = mctsNewNode(w);
+                if (next != -1) w->nodes[nodeIndex].child[m * 3 + o] = next;
+                reward = mctsPlayout(w, myBit, oppBit, myDir, oppDir, depth);
+                break;
+            }
+            nodeIndex = next;
+        }
+        if (reward < 0.0f) reward = 0.5f;
+
+        // backpropagation
+        for (int i = 0; i < depth; i++) {
+            mctsNode * node = &w->nodes[path[i][0]];
+            node->visits++;
+            node->myVisits[path[i][1]]++;
+            node->myValue[path[i][1]] += reward;
+            node->oppVisits[path[i][2]]++;
+            node->oppValue[path[i][2]] += 1.0f - reward;
+        }
+        for (int i = 0; i < w->numTouched; i++) {
+            int bit = w->touched[i];
+            w->occ[bit >> 6] &= ~(1ULL << (bit & 63));
+        }
+        w->playouts++;
+    }
+
+    // fold this tree's root into the shared counters, rewards in half points
+    mctsNode * rootNode = &w->nodes[root];
+    for (int m = 0; m < 3; m++) {
+        atomic_fetch_add_explicit(&ctx->rootVisits[m], rootNode->myVisits[m], memory_order_relaxed);
+        atomic_fetch_add_explicit(&ctx->rootScore[m], (long) (rootNode->myValue[m] * 2.0f), memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&ctx->playouts, w->playouts, memory_order_relaxed);
+}
+
+void mctsMakeMove(tron * this, int i) {
+    int oppIndex = nearestOpponent(this, i);
+    if (oppIndex == -1) return;
+    lightCycle * me = &this->cycles[i];
+    lightCycle * opp = &this->cycles[oppIndex];
+    if (this->mcts == NULL) this->mcts = mctsInit(this, this->aiThreads);
+    mctsContext * ctx = this->mcts;
+
+    ctx->rootOcc = this->occupied;
+    ctx->myBit = me->posY * ctx->stride + me->posX;
+    ctx->oppBit = opp->posY * ctx->stride + opp->posX;
+    ctx->myDir = dirIndex(me->lastDirX, me->lastDirY);
+    ctx->oppDir = dirIndex(opp->lastDirX, opp->lastDirY);
+    ctx->deadline = nowNs() + this->aiBudgetNs;
+    for (int m = 0; m < 3; m++) {
+        atomic_store(&ctx->rootVisits[m], 0);
+        atomic_store(&ctx->rootScore[m], 0);
+    }
+    atomic_store(&ctx->playouts, 0);
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->jobId++;
+    ctx->running = ctx->numWorkers - 1;
+    pthread_cond_broadcast(&ctx->start);
+    pthread_mutex_unlock(&ctx->lock);
+
+    mctsSearch(&ctx->workers[0]);
+
+    pthread_mutex_lock(&ctx->lock);
+    while (ctx->running > 0) pthread_cond_wait(&ctx->done, &ctx->lock);
+    pthread_mutex_unlock(&ctx->lock);
+
+    // most visited wins, the usual robust choice
+    int best = 0;
+    for (int m = 1; m < 3; m++) {
+        long visits = atomic_load(&ctx->rootVisits[m]);
+        long bestVisits = atomic_load(&ctx->rootVisits[best]);
+        if (visits > bestVisits || (visits == bestVisits && atomic_load(&ctx->rootScore[m]) > atomic_load(&ctx->rootScore[best]))) {
+            best = m;
+        }
+    }
+    int dir = mctsTurn(ctx->myDir, best);
+    me->dirX = searchDirX[dir];
+    me->dirY = searchDirY[dir];
+}
+
+/*** Replay ***/
+// A recording is the header, then 2 bits per cycle per tick (the direction index each cycle
+// tried to move in), then keyframes every REPLAY_KEYFRAME_INTERVAL ticks and a table of where
+// they are. Keyframes are run length encoded cells plus the cycles, so seeking restores the
+// nearest one at or before the target and only simulates the ticks in between.
+static void putU8(abuf * ab, uint8_t v) { abAppend(ab, (const char *) &v, 1); }
+static void putU16(abuf * ab, uint16_t v) { abAppend(ab, (const char *) &v, 2); }
+static void putU32(abuf * ab, uint32_t v) { abAppend(ab, (const char *) &v, 4); }
+static void putU64(abuf * ab, uint64_t v) { abAppend(ab, (const char *) &v, 8); }
+static void putVarint(abuf * ab, uint32_t v) {
+    while (v >= 0x80) {
+        putU8(ab, (uint8_t) (v | 0x80));
+        v >>= 7;
+    }
+    putU8(ab, (uint8_t) v);
+}
+
+static bool readBytes(replayReader * r, void * out, int len) {
+    if (r->end - r->p < len) {
+        r->bad = true;
+        memset(out, 0, len);
+        return false;
+    }
+    memcpy(out, r->p, len);
+    r->p += len;
+    return true;
+}
+static uint8_t getU8(replayReader * r) { uint8_t v; readBytes(r, &v, 1); return v; }
+static uint16_t getU16(replayReader * r) { uint16_t v; readBytes(r, &v, 2); return v; }
+static uint32_t getU32(replayReader * r) { uint32_t v; readBytes(r, &v, 4); return v; }
+static uint64_t getU64(replayReader * r) { uint64_t v; readBytes(r, &v, 8); return v; }
+static uint32_t getVarint(replayReader * r) {
+    uint32_t v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t b = getU8(r);
+        v |= (uint32_t) (b & 0x7f) << shift;
+        if (!(b & 0x80)) return v;
+    }
+    r->bad = true;
+    return 0;
+}
+
+static void putCycle(abuf * ab, lightCycle * cycle) {
+    putU16(ab, (uint16_t) cycle->posX);
+    putU16(ab, (uint16_t) cycle->posY);
+    putU8(ab, (uint8_t) dirIndex(cycle->dirX, cycle->dirY));
+    putU8(ab, (uint8_t) dirIndex(cycle->lastDirX, cycle->lastDirY));
+    putU8(ab, cycle->alive);
+}
+
+static void getCycle(replayReader * r, lightCycle * cycle) {
+    cycle->posX = getU16(r);
+    cycle->posY = getU16(r);
+    int dir = getU8(r) & 3;
+    int lastDir = getU8(r) & 3;
+    cycle->dirX = searchDirX[dir];
+    cycle->dirY = searchDirY[dir];
+    cycle->lastDirX = searchDirX[lastDir];
+    cycle->lastDirY = searchDirY[lastDir];
+    cycle->alive = getU8(r) != 0;
+}
+
+recorder * recorderInit(const char * path, int tickRate) {
+    recorder * rec = (recorder *) calloc(1, sizeof(recorder));
+    if (rec == NULL) die("malloc");
+    rec->path = path;
+    rec->tickRate = tickRate;
+    abInit(&rec->moves, 4096);
+    abInit(&rec->keyframes, 65536);
+    abInit(&rec->keyframeTable, 1024);
+    return rec;
+}
+
+void recorderBegin(tron * this) {
+    recorder * rec = this->recorder;
+    rec->moves.len = 0;
+    rec->keyframes.len = 0;
+    rec->keyframeTable.len = 0;
+    rec->numKeyframes = 0;
+    rec->numTicks = 0;
+    recorderKeyframe(this);
+}
+
+void recorderKeyframe(tron * this) {
+    recorder * rec = this->recorder;
+    putU32(&rec->keyframeTable, (uint32_t) this->numTurn);
+    putU64(&rec->keyframeTable, (uint64_t) rec->keyframes.len);
+    rec->numKeyframes++;
+
+    abuf * ab = &rec->keyframes;
+    putU32(ab, (uint32_t) this->numTurn);
+    putU8(ab, (uint8_t) this->curState);
+    putU8(ab, (uint8_t) (this->winner + 1));
+    for (int i = 0; i < this->numCycles; i++) putCycle(ab, &this->cycles[i]);
+
+    int numCells = this->boardRows * this->boardCols;
+    for (int i = 0; i < numCells; ) {
+        int run = 1;
+        while (i + run < numCells && this->cells[i + run] == this->cells[i]) run++;
+        putU8(ab, this->cells[i]);
+        putVarint(ab, run);
+        i += run;
+    }
+}
+
+// called by moveCycles with the directions the cycles are about to try
+void recorderTick(tron * this) {
+    recorder * rec = this->recorder;
+    for (int i = 0; i < this->numCycles; i++) {
+        long bit = ((long) rec->numTicks * this->numCycles + i) * 2;
+        if (bit / 8 >= rec->moves.len) putU8(&rec->moves, 0);
+        rec->moves.b[bit / 8] |= (char) (dirIndex(this->cycles[i].dirX, this->cycles[i].dirY) << (bit % 8));
+    }
+    rec->numTicks++;
+}
+
+void recorderFinish(tron * this) {
+    recorder * rec = this->recorder;
+    rec->matchNumber++;
+    recorderKeyframe(this); // the final position, so seeking to the end is instant
+    if (rec->path == NULL) return; // self-play takes the buffers into its own file
+
+    char path[4096];
+    if (rec->matchNumber == 1) snprintf(path, sizeof(path), "%s", rec->path);
+    else snprintf(path, sizeof(path), "%s.%d", rec->path, rec->matchNumber);
+
+    abuf header = ABUF_INIT;
+    abInit(&header, 128);
+    uint64_t headerLen = REPLAY_HEADER_BYTES;
+    abAppend(&header, REPLAY_MAGIC, 4);
+    putU16(&header, REPLAY_VERSION);
+    putU16(&header, (uint16_t) this->boardRows);
+    putU16(&header, (uint16_t) this->boardCols);
+    putU16(&header, (uint16_t) rec->tickRate);
+    putU8(&header, (uint8_t) this->numCycles);
+    putU8(&header, (uint8_t) (this->winner + 1));
+    putU32(&header, rec->seed);
+    putU32(&header, (uint32_t) rec->numTicks);
+    putU32(&header, REPLAY_KEYFRAME_INTERVAL);
+    putU32(&header, (uint32_t) rec->numKeyframes);
+    putU64(&header, headerLen);                                             // moves
+    putU64(&header, headerLen + rec->moves.len);                            // keyframes
+    putU64(&header, headerLen + rec->moves.len + rec->keyframes.len);       // keyframe table
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1
+        || writeAll(fd, header.b, header.len) == -1
+        || writeAll(fd, rec->moves.b, rec->moves.len) == -1
+        || writeAll(fd, rec->keyframes.b, rec->keyframes.len) == -1
+        || writeAll(fd, rec->keyframeTable.b, rec->keyframeTable.len) == -1) {
+        die("recording");
+    }
+    close(fd);
+    abFree(&header);
+}
+
+bool replayLoad(replay * rp, const char * path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return false;
+    off_t size = lseek(fd, 0, SEEK_END);
+    lseek(fd, 0, SEEK_SET);
+    rp->data = (uint8_t *) malloc(size > 0 ? size : 1);
+    bool ok = rp->data != NULL && size >= REPLAY_HEADER_BYTES && read(fd, rp->data, size) == size;
+    close(fd);
+    if (!ok) return false;
+    rp->size = size;
+
+    replayReader r = {rp->data, rp->data + size, false};
+    if (memcmp(rp->data, REPLAY_MAGIC, 4) != 0) return false;
+    r.p += 4;
+    if (getU16(&r) != REPLAY_VERSION) return false;
+    rp->rows = getU16(&r);
+    rp->cols = getU16(&r);
+    rp->tickRate = getU16(&r);
+    rp->numCycles = getU8(&r);
+    rp->winner = getU8(&r) - 1;
+    getU32(&r); // seed, informational
+    rp->numTicks = getU32(&r);
+    rp->keyframeInterval = getU32(&r);
+    rp->numKeyframes = getU32(&r);
+    uint64_t movesOffset = getU64(&r);
+    uint64_t keyframesOffset = getU64(&r);
+    uint64_t tableOffset = getU64(&r);
+    // sections in order and inside the file, compared so nothing a bad file says can wrap around
+    if (r.bad || rp->numKeyframes == 0 || rp->numCycles < 2 || rp->numCycles > MAX_CYCLES
+        || movesOffset > keyframesOffset || keyframesOffset > tableOffset || tableOffset > (uint64_t) size
+        || ((uint64_t) rp->numTicks * rp->numCycles * 2 + 7) / 8 > keyframesOffset - movesOffset
+        || (uint64_t) rp->numKeyframes * 12 > (uint64_t) size - tableOffset) {
+        return false;
+    }
+    rp->moves = rp->data + movesOffset;
+    rp->keyframes = rp->data + keyframesOffset;
+    rp->keyframesLen = tableOffset - keyframesOffset;
+    rp->table = rp->data + tableOffset;
+    return rp->rows >= 5 && rp->cols >= 8 && rp->tickRate > 0;
+}
+
+static uint32_t replayKeyframeTick(replay * rp, int k) {
+    uint32_t tick;
+    memcpy(&tick, rp->table + k * 12, 4);
+    return tick;
+}
+
+// last keyframe at or before tick, keyframes are in tick order
+int replayFindKeyframe(replay * rp, int tick) {
+    int lo = 0, hi = rp->numKeyframes - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if ((int) replayKeyframeTick(rp, mid) <= tick) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+bool replayRestoreKeyframe(replay * rp, tron * this, int k) {
+    uint64_t offset;
+    memcpy(&offset, rp->table + k * 12 + 4, 8);
+    if (offset >= rp->keyframesLen) return false;
+    replayReader r = {rp->keyframes + offset, rp->keyframes + rp->keyframesLen, false};
+
+    // everything below indexes the board, so nothing is taken from a keyframe that doesn't fit it
+    uint32_t numTurn = getU32(&r);
+    int state = getU8(&r);
+    int winner = getU8(&r) - 1;
+    lightCycle cycles[MAX_CYCLES];
+    for (int i = 0; i < this->numCycles; i++) {
+        cycles[i] = this->cycles[i]; // engine and the rest the file doesn't have
+        getCycle(&r, &cycles[i]);
+        if (cycles[i].posX >= this->boardCols || cycles[i].posY >= this->boardRows) return false;
+    }
+    if (r.bad || numTurn > INT32_MAX || (state != IN_GAME && state != GAME_OVER) || winner >= this->numCycles) return false;
+    this->numTurn = (int) numTurn;
+    this->curState = (gameState) state;
+    this->winner = winner;
+    memcpy(this->cycles, cycles, sizeof(lightCycle) * this->numCycles);
+
+    int numCells = this->boardRows * this->boardCols;
+    for (int i = 0; i < numCells && !r.bad; ) {
+        uint8_t value = getU8(&r);
+        uint32_t run = getVarint(&r);
+        if (run == 0 || run > (uint32_t) (numCells - i)) return false;
+        memset(&this->cells[i], value, run);
+        i += run;
+    }
+    rebuildOccupied(this);
+    this->hash = zobristRebuild(this);
+    this->fullRepaint = true;
+    this->numDirty = 0;
+    if (this->distance != NULL) distanceFieldsInvalidate(this->distance);
+    return !r.bad;
+}
+
+void replayStep(replay * rp, tron * this) {
+    if (this->numTurn >= (int) rp->numTicks || this->curState != IN_GAME) return;
+    for (int i = 0; i < this->numCycles; i++) {
+        long bit = ((long) this->numTurn * this->numCycles + i) * 2;
+        int dir = (rp->moves[bit / 8] >> (bit % 8)) & 3;
+        this->cycles[i].dirX = searchDirX[dir];
+        this->cycles[i].dirY = searchDirY[dir];
+    }
+    moveCycles(this);
+}
+
+// restore a keyframe only when it's closer than where we already are, so the tron has to
+// hold some position of this replay already (replayRestoreKeyframe it first)
+void replaySeek(replay * rp, tron * this, int tick) {
+    if (tick < 0) tick = 0;
+    if (tick > (int) rp->numTicks) tick = rp->numTicks;
+    int k = replayFindKeyframe(rp, tick);
+    int keyTick = replayKeyframeTick(rp, k);
+    if (tick < this->numTurn || keyTick > this->numTurn) {
+        if (!replayRestoreKeyframe(rp, this, k)) return;
+    }
+    while (this->numTurn < tick && this->curState == IN_GAME) replayStep(rp, this);
+}
+
+int runReplay(options * opts) {
+    replay rp;
+    if (!replayLoad(&rp, opts->replayFile)) {
+        fprintf(stderr, "%s: not a readable michaelTron recording\n", opts->replayFile);
+        return 1;
+    }
+
+    enableRawMode();
+    int rows, cols;
+    if (getWindowSize(&rows, &cols) == -1) die("getWindowSize");
+    if (rows - 1 < rp.rows || cols - 1 < rp.cols) {
+        write(STDOUT_FILENO, "\x1b[2J\x1b[H", 7);
+        printf("terminal is too small for this recording (needs %dx%d)\r\n", rp.rows + 1, rp.cols + 1);
+        return 1;
+    }
+
+    tron tronGame;
+    gameInit(&tronGame, rp.rows, rp.cols);
+    tronGame.numCycles = rp.numCycles;
+    if (!replayRestoreKeyframe(&rp, &tronGame, 0)) die("replay keyframe");
+
+    int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timerFd == -1) die("timerfd_create");
+    struct itimerspec period;
+    period.it_interval.tv_sec = 0;
+    period.it_interval.tv_nsec = 1000000000L / REPLAY_FPS;
+    period.it_value = period.it_interval;
+    if (timerfd_settime(timerFd, 0, &period, NULL) == -1) die("timerfd_settime");
+    struct pollfd fds[2] = {
+        {STDIN_FILENO, POLLIN, 0},
+        {timerFd, POLLIN, 0}
+    };
+
+    double speed = opts->replaySpeed;
+    double pending = 0.0; // ticks owed to the playback clock
+    bool paused = false;
+    char lastStatus[160] = "";
+
+    while (1) {
+        buildFrame(&tronGame);
+        char status[160];
+        int statusLen = snprintf(status, sizeof(status),
+                                 "\x1b[%d;1H\x1b[7mReplay tick %d/%u x%g%s | Space: pause | Arrows: seek | 0-9: jump | +/-: speed | Ctrl-Q to quit\x1b[m\x1b[K",
+                                 tronGame.boardRows + 1, tronGame.numTurn, rp.numTicks, speed, paused ? " (paused)" : "");
+        if (statusLen > (int) sizeof(status) - 1) statusLen = sizeof(status) - 1;
+        if (tronGame.frame.len > 0 || strcmp(status, lastStatus) != 0) {
+            abAppend(&tronGame.frame, status, statusLen);
+            writeAll(STDOUT_FILENO, tronGame.frame.b, tronGame.frame.len);
+            memcpy(lastStatus, status, statusLen + 1);
+        }
+
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) continue;
+            die("poll");
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int keys[KEY_READ_SIZE + 1];
+            int numKeys = readKeys(&stdinKeys, STDIN_FILENO, keys);
+            for (int k = 0; k < numKeys; k++) {
+                int c = keys[k];
+                int tick = tronGame.numTurn;
+                switch (c) {
+                    case CTRL_KEY('q'):
+                        write(STDOUT_FILENO, "\x1b[2J", 4);
+                        write(STDOUT_FILENO, "\x1b[H", 3);
+                        exit(0);
+                    case ' ': paused = !paused; break;
+                    case '+': if (speed < 1024) speed *= 2; break;
+                    case '-': if (speed > 1.0 / 64) speed /= 2; break;
+                    case ARROW_RIGHT: replaySeek(&rp, &tronGame, tick + REPLAY_SEEK_STEP); break;
+                    case ARROW_LEFT: replaySeek(&rp, &tronGame, tick - REPLAY_SEEK_STEP); break;
+                    case '.': replaySeek(&rp, &tronGame, tick + 1); break;
+                    case ',': replaySeek(&rp, &tronGame, tick - 1); break;
+                    case HOME_KEY: replaySeek(&rp, &tronGame, 0); break;
+                    case END_KEY: replaySeek(&rp, &tronGame, rp.numTicks); break;
+                    default:
+                        if (c >= '0' && c <= '9') replaySeek(&rp, &tronGame, (int) ((long) rp.numTicks * (c - '0') / 10));
+                        break;
+                }
+            }
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t expirations;
+            if (read(timerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+            if (paused) continue;
+            pending += expirations * rp.tickRate * speed / REPLAY_FPS;
+            int ticks = (int) pending;
+            pending -= ticks;
+            if (ticks > 0) replaySeek(&rp, &tronGame, tronGame.numTurn + ticks);
+        }
+    }
+}
+
+/*** Netplay ***/
+netSession * netSessionInit(tron * this, int fd, bool host) {
+    netSession * net = (netSession *) calloc(1, sizeof(netSession));
+    if (net == NULL) die("malloc");
+    net->fd = fd;
+    net->host = host;
+    net->local = host ? 0 : 1;
+    abInit(&net->packet, NET_MAX_PACKET);
+
+    int numCells = this->boardRows * this->boardCols;
+    int numWords = this->wordsPerRow * this->boardRows;
+    for (int i = 0; i < NET_SNAPSHOTS; i++) {
+        netSnapshot * s = &net->snapshots[i];
+        s->tick = -1;
+        s->cells = (uint8_t *) malloc(numCells);
+        s->occupied = (uint64_t *) malloc(sizeof(uint64_t) * numWords);
+        if (s->cells == NULL || s->occupied == NULL) die("malloc");
+    }
+    net->remoteConfirmed = -1;
+    net->localAcked = -1;
+    net->rollbackTo = -1;
+    net->remoteChecksumTick = -1;
+    net->desyncTick = -1;
+    net->lastHeardNs = nowNs();
+    return net;
+}
+
+// FNV-1a a word at a time over the board, then the cycles. Cheap enough to run every tick on a
+// terminal sized board, and any difference in where anybody went changes it.
+uint64_t tronChecksum(tron * this) {
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    int numCells = this->boardRows * this->boardCols;
+    int i = 0;
+    for (; i + 8 <= numCells; i += 8) {
+        uint64_t word;
+        memcpy(&word, &this->cells[i], 8);
+        h = (h ^ word) * prime;
+    }
+    for (; i < numCells; i++) h = (h ^ this->cells[i]) * prime;
+    for (int c = 0; c < this->numCycles; c++) {
+        lightCycle * cycle = &this->cycles[c];
+        uint64_t v = (uint64_t) cycle->posX | (uint64_t) cycle->posY << 16 | (uint64_t) cycle->alive << 32;
+        h = (h ^ v) * prime;
+    }
+    h = (h ^ ((uint64_t) this->numTurn << 8 | (uint64_t) this->curState)) * prime;
+    return h ^ (h >> 32);
+}
+
+void netBeginMatch(tron * this, netSession * net, int match) {
+    net->match = match;
+    net->matchOver = false;
+    net->wantsMatch = false;
+    net->tick = 0;
+    net->remoteConfirmed = -1;
+    net->localAcked = -1;
+    net->rollbackTo = -1;
+    net->remoteTick = 0;
+    net->remoteAdvantage = 0;
+    net->syncStall = 0;
+    net->syncCooldown = 0;
+    net->remoteChecksumTick = -1;
+    net->desyncTick = -1;
+    for (int i = 0; i < NET_SNAPSHOTS; i++) net->snapshots[i].tick = -1;
+    gameStart(this);
+}
+
+void netSave(tron * this, netSession * net, int tick) {
+    netSnapshot * s = &net->snapshots[tick % NET_SNAPSHOTS];
+    s->tick = tick;
+    memcpy(s->cells, this->cells, this->boardRows * this->boardCols);
+    memcpy(s->occupied, this->occupied, sizeof(uint64_t) * this->wordsPerRow * this->boardRows);
+    memcpy(s->cycles, this->cycles, sizeof(s->cycles));
+    s->numTurn = this->numTurn;
+    s->hash = this->hash;
+    s->curState = this->curState;
+    s->winner = this->winner;
+    s->rngState = this->rngState;
+}
+
+// Cells that differ from the snapshot go on the dirty list, so a rollback only repaints what
+// the wrong guess actually drew
+void netRestore(tron * this, netSession * net, int tick) {
+    netSnapshot * s = &net->snapshots[tick % NET_SNAPSHOTS];
+    int numCells = this->boardRows * this->boardCols;
+    for (int i = 0; i < numCells; i++) {
+        if ((i & 7) == 0 && i + 8 <= numCells) { // skip identical words, nearly all of them
+            uint64_t now, then;
+            memcpy(&now, &this->cells[i], 8);
+            memcpy(&then, &s->cells[i], 8);
+            if (now == then) {
+                i += 7;
+                continue;
+            }
+        }
+        if (this->cells[i] != s->cells[i]) markDirty(this, i % this->boardCols, i / this->boardCols);
+    }
+    for (int c = 0; c < MAX_HUMANS; c++) { // an undone crash keeps its cell but loses the X
+        if (this->cycles[c].alive != s->cycles[c].alive) markDirty(this, this->cycles[c].posX, this->cycles[c].posY);
+    }
+    if (this->curState != s->curState) this->fullRepaint = true;
+
+    memcpy(this->cells, s->cells, numCells);
+    memcpy(this->occupied, s->occupied, sizeof(uint64_t) * this->wordsPerRow * this->boardRows);
+    memcpy(this->cycles, s->cycles, sizeof(s->cycles));
+    this->numTurn = s->numTurn;
+    this->hash = s->hash;
+    this->curState = s->curState;
+    this->winner = s->winner;
+    this->rngState = s->rngState;
+}
+
+// One tick on the inputs as known right now. Past remoteConfirmed the remote keeps doing
+// whatever it last did, which is also what a cycle does when nobody touches the keys.
+void netSimulate(tron * this, netSession * net, int tick) {
+    int remote = 1 - net->local;
+    int slot = tick & (NET_RING - 1);
+    if (tick <= net->remoteConfirmed) net->predicted[slot] = net->remoteInput[slot];
+    else if (tick > 0) net->predicted[slot] = net->predicted[(tick - 1) & (NET_RING - 1)];
+    else net->predicted[slot] = (uint8_t) dirIndex(this->cycles[remote].dirX, this->cycles[remote].dirY);
+
+    uint8_t inputs[MAX_HUMANS];
+    inputs[net->local] = net->localInput[slot];
+    inputs[remote] = net->predicted[slot];
+    for (int c = 0; c < MAX_HUMANS; c++) {
+        if (!this->cycles[c].alive) continue;
+        this->cycles[c].dirX = searchDirX[inputs[c]];
+        this->cycles[c].dirY = searchDirY[inputs[c]];
+    }
+    moveCycles(this);
+    net->checksums[slot] = tronChecksum(this);
+}
+
+void netRollback(tron * this, netSession * net) {
+    int from = net->rollbackTo;
+    net->rollbackTo = -1;
+
+    // a key pressed since the last tick isn't an input yet, carry it over
+    lightCycle * me = &this->cycles[net->local];
+    bool steering = me->alive && this->curState == IN_GAME;
+    int dirX = me->dirX, dirY = me->dirY;
+
+    netRestore(this, net, from);
+    for (int t = from; t < net->tick; t++) {
+        if (t > from) netSave(this, net, t);
+        netSimulate(this, net, t);
+    }
+    if (steering && me->alive && this->curState == IN_GAME) {
+        me->dirX = dirX;
+        me->dirY = dirY;
+    }
+
+    int depth = net->tick - from;
+    net->rollbacks++;
+    net->resimulated += depth;
+    if (depth > net->maxRollback) net->maxRollback = depth;
+}
+
+// Called on every timer tick: fix up the past if the peer said something new, compare
+// checksums, keep the two clocks together, simulate the next tick and tell the peer about it
+void netTick(tron * this, netSession * net) {
+    if (net->match > 0 && !net->matchOver) {
+        if (net->rollbackTo != -1) netRollback(this, net);
+
+        int confirmed = net->remoteConfirmed < net->tick - 1 ? net->remoteConfirmed : net->tick - 1;
+        int t = net->remoteChecksumTick;
+        if (t >= 0 && t <= confirmed && net->tick - t <= NET_RING) {
+            if (net->checksums[t & (NET_RING - 1)] != net->remoteChecksum) {
+                net->desyncTick = t;
+                net->matchOver = true;
+                this->curState = GAME_OVER;
+                this->winner = -1;
+                this->fullRepaint = true;
+            }
+            net->remoteChecksumTick = -1;
+        }
+    }
+
+    if (net->match > 0 && !net->matchOver) {
+        // Waiting is the only option once the guesses would run past the snapshots. Otherwise
+        // the peer that's further ahead of the other gives up a tick now and then, each side
+        // then sees its own inputs arrive at the other about as late as the other's arrive here.
+        bool stall = net->tick - net->remoteConfirmed > NET_MAX_ROLLBACK || net->tick - net->localAcked >= NET_RING;
+        int lead = (net->tick - net->remoteTick) - net->remoteAdvantage;
+        if (!stall) {
+            if (net->syncStall > 0) {
+                net->syncStall--;
+                stall = true;
+            }
+            else if (net->syncCooldown > 0) {
+                net->syncCooldown--;
+            }
+            else if (lead >= 2) { // half the gap closes it, the peer's view moves the other way
+                net->syncStall = lead / 2 - 1;
+                net->syncCooldown = NET_SYNC_COOLDOWN;
+                stall = true;
+            }
+        }
+
+        if (stall) {
+            net->stalls++;
+        }
+        else {
+            lightCycle * me = &this->cycles[net->local];
+            int slot = net->tick & (NET_RING - 1);
+            if (me->alive && this->curState == IN_GAME) net->localInput[slot] = (uint8_t) dirIndex(me->dirX, me->dirY);
+            else net->localInput[slot] = net->localInput[(net->tick - 1) & (NET_RING - 1)];
+            netSave(this, net, net->tick);
+            netSimulate(this, net, net->tick);
+            net->tick++;
+        }
+
+        // over for real once nothing that could still arrive would change how it ended
+        int confirmed = net->remoteConfirmed < net->tick - 1 ? net->remoteConfirmed : net->tick - 1;
+        if (this->curState == GAME_OVER && this->numTurn - 1 <= confirmed) net->matchOver = true;
+    }
+
+    netSendInput(net);
+}
+
+// the host starts matches, once the joiner has every input of the last one
+bool netCanStart(netSession * net) {
+    if (!net->host || !net->connected) return false;
+    if (net->match == 0) return true;
+    return net->matchOver && net->localAcked >= net->tick - 1;
+}
+
+// Every packet repeats all the inputs the peer hasn't acknowledged yet, so a lost packet
+// costs nothing but a rollback a tick later
+void netSendInput(netSession * net) {
+    abuf * ab = &net->packet;
+    ab->len = 0;
+    abAppend(ab, NET_MAGIC, 4);
+    putU8(ab, NET_VERSION);
+    putU8(ab, NET_INPUT);
+    putU16(ab, (uint16_t) net->match);
+    putU8(ab, net->wantsMatch ? NET_FLAG_WANTS_MATCH : 0);
+    putU32(ab, (uint32_t) net->tick);
+    putU16(ab, (uint16_t) (int16_t) (net->tick - net->remoteTick));
+
+    uint64_t now = nowNs();
+    putU32(ab, (uint32_t) (now / 1000000));
+    uint32_t echo = 0; // the peer's clock, plus however long we sat on it
+    if (net->echoMs != 0) echo = net->echoMs + (uint32_t) ((now - net->echoReceivedNs) / 1000000);
+    putU32(ab, echo);
+
+    putU32(ab, (uint32_t) (net->remoteConfirmed + 1));
+    int confirmed = net->remoteConfirmed < net->tick - 1 ? net->remoteConfirmed : net->tick - 1;
+    putU32(ab, (uint32_t) (confirmed + 1));
+    putU64(ab, confirmed >= 0 ? net->checksums[confirmed & (NET_RING - 1)] : 0);
+
+    int first = net->localAcked + 1;
+    putU32(ab, (uint32_t) first);
+    putU8(ab, (uint8_t) (net->tick - first));
+    for (int t = first; t < net->tick; t++) putU8(ab, net->localInput[t & (NET_RING - 1)]);
+    netSend(net);
+}
+
+void netSendWelcome(tron * this, netSession * net) {
+    abuf * ab = &net->packet;
+    ab->len = 0;
+    abAppend(ab, NET_MAGIC, 4);
+    putU8(ab, NET_VERSION);
+    putU8(ab, NET_WELCOME);
+    putU16(ab, (uint16_t) this->boardRows);
+    putU16(ab, (uint16_t) this->boardCols);
+    putU16(ab, (uint16_t) net->tickRate);
+    putU32(ab, net->seed);
+    netSend(net);
+}
+
+void netSend(netSession * net) {
+    if (net->delayNs == 0) {
+        send(net->fd, net->packet.b, net->packet.len, 0); // UDP, a lost packet is just lost
+        return;
+    }
+    if (net->numDelayed == NET_DELAY_SLOTS) return; // as good as dropped, the next one repeats it
+    netDelayed * d = &net->delayed[(net->delayedHead + net->numDelayed) % NET_DELAY_SLOTS];
+    d->due = nowNs() + net->delayNs;
+    d->len = net->packet.len;
+    memcpy(d->data, net->packet.b, net->packet.len);
+    net->numDelayed++;
+}
+
+void netFlush(netSession * net) {
+    uint64_t now = nowNs();
+    while (net->numDelayed > 0 && net->delayed[net->delayedHead].due <= now) {
+        netDelayed * d = &net->delayed[net->delayedHead];
+        send(net->fd, d->data, d->len, 0);
+        net->delayedHead = (net->delayedHead + 1) % NET_DELAY_SLOTS;
+        net->numDelayed--;
+    }
+}
+
+void netReceive(tron * this, netSession * net, const uint8_t * data, int len) {
+    replayReader r = {data, data + len, false};
+    char magic[4];
+    readBytes(&r, magic, 4);
+    if (r.bad || memcmp(magic, NET_MAGIC, 4) != 0 || getU8(&r) != NET_VERSION) return;
+    int type = getU8(&r);
+    if (type == NET_HELLO && net->host) { // our WELCOME got lost
+        netSendWelcome(this, net);
+        return;
+    }
+    if (type != NET_INPUT) return;
+
+    int match = getU16(&r);
+    int flags = getU8(&r);
+    int tick = (int) getU32(&r);
+    int advantage = (int16_t) getU16(&r);
+    uint32_t sentMs = getU32(&r);
+    uint32_t echoMs = getU32(&r);
+    int ack = (int) getU32(&r) - 1;
+    int checksumTick = (int) getU32(&r) - 1;
+    uint64_t checksum = getU64(&r);
+    int first = (int) getU32(&r);
+    int count = getU8(&r);
+    if (r.bad || r.end - r.p < count) return;
+
+    uint64_t now = nowNs();
+    net->connected = true;
+    net->lastHeardNs = now;
+    net->echoMs = sentMs;
+    net->echoReceivedNs = now;
+    if (echoMs != 0) {
+        double sample = (double) ((uint32_t) (now / 1000000) - echoMs);
+        net->rttMs = net->rttMs == 0.0 ? sample : net->rttMs * 0.9 + sample * 0.1;
+    }
+
+    if (!net->host && match > net->match) netBeginMatch(this, net, match);
+    if (net->host && (flags & NET_FLAG_WANTS_MATCH) && netCanStart(net)) netBeginMatch(this, net, net->match + 1);
+    if (match != net->match || net->match == 0) return;
+
+    if (tick > net->remoteTick) {
+        net->remoteTick = tick;
+        net->remoteAdvantage = advantage;
+    }
+    if (ack > net->localAcked && ack < net->tick) net->localAcked = ack;
+    for (int k = 0; k < count; k++) {
+        int t = first + k;
+        if (t != net->remoteConfirmed + 1) continue; // old news
+        int slot = t & (NET_RING - 1);
+        uint8_t dir = r.p[k] & 3;
+        net->remoteInput[slot] = dir;
+        net->remoteConfirmed = t;
+        // guessed wrong about a tick we already simulated
+        if (t < net->tick && net->predicted[slot] != dir && (net->rollbackTo == -1 || t < net->rollbackTo)) net->rollbackTo = t;
+    }
+    if (checksumTick >= 0) {
+        net->remoteChecksumTick = checksumTick;
+        net->remoteChecksum = checksum;
+    }
+}
+
+// Blocks until the two peers agree on a board: the host waits for a HELLO and plays on the
+// smaller of the two terminals, the joiner knocks until the WELCOME comes back. Returns the
+// socket connected to the peer, or -1 when the user gave up with Ctrl-Q.
+int netHandshake(options * opts, int * rows, int * cols, int * tickRate, uint32_t * seed) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) die("socket");
+
+    if (opts->netHost) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons((uint16_t) opts->netPort);
+        if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) die("bind");
+    }
+    else {
+        char host[256];
+        snprintf(host, sizeof(host), "%s", opts->netJoin);
+        char * port = strrchr(host, ':');
+        if (port == NULL) die("--join HOST:PORT");
+        *port++ = '\0';
+        struct addrinfo hints, * res;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        if (getaddrinfo(host, port, &hints, &res) != 0) die("getaddrinfo");
+        int ok = connect(fd, res->ai_addr, res->ai_addrlen);
+        freeaddrinfo(res);
+        if (ok == -1) die("connect");
+    }
+
+    struct pollfd fds[2] = {
+        {STDIN_FILENO, POLLIN, 0},
+        {fd, POLLIN, 0}
+    };
+    while (1) {
+        if (!opts->netHost) {
+            abuf hello = ABUF_INIT;
+            abInit(&hello, 16);
+            abAppend(&hello, NET_MAGIC, 4);
+            putU8(&hello, NET_VERSION);
+            putU8(&hello, NET_HELLO);
+            putU16(&hello, (uint16_t) *rows);
+            putU16(&hello, (uint16_t) *cols);
+            send(fd, hello.b, hello.len, 0); // refused until the host is up, keep knocking
+            abFree(&hello);
+        }
+
+        if (poll(fds, 2, NET_HELLO_MS) == -1) {
+            if (errno == EINTR) continue;
+            die("poll");
+        }
+        if (fds[0].revents & POLLIN) {
+            int keys[KEY_READ_SIZE + 1];
+            int numKeys = readKeys(&stdinKeys, STDIN_FILENO, keys);
+            for (int k = 0; k < numKeys; k++) {
+                if (keys[k] == CTRL_KEY('q')) {
+                    close(fd);
+                    return -1;
+                }
+            }
+        }
+        if (!(fds[1].revents & POLLIN)) continue;
+
+        uint8_t buf[NET_MAX_PACKET];
+        struct sockaddr_storage from;
+        socklen_t fromLen = sizeof(from);
+        int n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *) &from, &fromLen);
+        if (n <= 0) continue;
+        replayReader r = {buf, buf + n, false};
+        char magic[4];
+        readBytes(&r, magic, 4);
+        if (memcmp(magic, NET_MAGIC, 4) != 0 || getU8(&r) != NET_VERSION) continue;
+        int type = getU8(&r);
+
+        if (opts->netHost && type == NET_HELLO) {
+            int theirRows = getU16(&r), theirCols = getU16(&r);
+            if (r.bad) continue;
+            if (theirRows < *rows) *rows = theirRows;
+            if (theirCols < *cols) *cols = theirCols;
+            if (connect(fd, (struct sockaddr *) &from, fromLen) == -1) die("connect");
+            return fd; // the WELCOME goes out once the session exists
+        }
+        if (!opts->netHost && type == NET_WELCOME) {
+            int hostRows = getU16(&r), hostCols = getU16(&r);
+            int hostTickRate = getU16(&r);
+            uint32_t hostSeed = getU32(&r);
+            if (r.bad || hostRows > *rows || hostCols > *cols || hostTickRate < 1 || hostTickRate > MAX_TICK_RATE) continue;
+            *rows = hostRows;
+            *cols = hostCols;
+            *tickRate = hostTickRate;
+            *seed = hostSeed;
+            return fd;
+        }
+    }
+}
+
+static int netStatus(tron * this, netSession * net, char * out, int size) {
+    char text[256];
+    int len;
+    double quiet = (nowNs() - net->lastHeardNs) / 1e9;
+    if (!net->connected) {
+        len = snprintf(text, sizeof(text), "Net %s | waiting for the other player | Ctrl-Q to quit", net->host ? "host" : "join");
+    }
+    else if (net->desyncTick >= 0) {
+        len = snprintf(text, sizeof(text), "DESYNC: checksums differ at tick %d | %sCtrl-Q to quit", net->desyncTick,
+                       net->host ? "Space: new match | " : "");
+    }
+    else {
+        const char * hint = "";
+        bool between = net->match == 0 || net->matchOver;
+        if (net->host && netCanStart(net)) hint = "Space: new match | ";
+        else if (!net->host && between) hint = net->wantsMatch ? "asked the host for a match | " : "Space: ask for a match | ";
+        char quietNote[48] = "";
+        if (quiet * 1000 > NET_QUIET_MS) snprintf(quietNote, sizeof(quietNote), "quiet for %.0f s | ", quiet);
+        len = snprintf(text, sizeof(text), "You: player %d, WASD/arrows | rtt %.0f ms | rollbacks %ld (max %d ticks) | stalls %ld | %s%sCtrl-Q to quit",
+                       net->local + 1, net->rttMs, net->rollbacks, net->maxRollback, net->stalls, quietNote, hint);
+    }
+    if (len > (int) sizeof(text) - 1) len = sizeof(text) - 1;
+    if (len > this->boardCols) len = this->boardCols;
+    return snprintf(out, size, "\x1b[%d;1H\x1b[7m%.*s\x1b[m\x1b[K", this->boardRows + 1, len, text);
+}
+
+int runNetplay(options * opts) {
+    enableRawMode();
+    int rows, cols;
+    if (getWindowSize(&rows, &cols) == -1) die("getWindowSize");
+    rows--; // same margins as a local game
+    cols--;
+    int tickRate = opts->tickRate;
+    uint32_t seed = opts->seed;
+
+    write(STDOUT_FILENO, "\x1b[2J\x1b[H", 7);
+    if (opts->netHost) printf("waiting for a player on port %d (Ctrl-Q to give up)\r\n", opts->netPort);
+    else printf("joining %s (Ctrl-Q to give up)\r\n", opts->netJoin);
+    fflush(stdout);
+    int fd = netHandshake(opts, &rows, &cols, &tickRate, &seed);
+    if (fd == -1) {
+        write(STDOUT_FILENO, "\x1b[2J\x1b[H", 7);
+        return 0;
+    }
+    if (!spawnFits(rows, cols, 2)) {
+        write(STDOUT_FILENO, "\x1b[2J\x1b[H", 7);
+        printf("the two terminals only have %dx%d in common, too small to play\r\n", rows, cols);
+        return 1;
+    }
+
+    tron tronGame;
+    gameInit(&tronGame, rows, cols);
+    tronGame.rngState = seed;
+    netSession * net = netSessionInit(&tronGame, fd, opts->netHost);
+    net->tickRate = tickRate;
+    net->seed = seed;
+    net->delayNs = (uint64_t) opts->netDelayMs * 1000000ULL;
+    if (net->delayNs > 0) {
+        net->delayed = (netDelayed *) malloc(sizeof(netDelayed) * NET_DELAY_SLOTS);
+        if (net->delayed == NULL) die("malloc");
+    }
+    if (net->host) netSendWelcome(&tronGame, net);
+
+    int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timerFd == -1) die("timerfd_create");
+    long tickNs = 1000000000L / tickRate;
+    struct itimerspec period;
+    period.it_interval.tv_sec = tickNs / 1000000000L;
+    period.it_interval.tv_nsec = tickNs % 1000000000L;
+    period.it_value = period.it_interval;
+    if (timerfd_settime(timerFd, 0, &period, NULL) == -1) die("timerfd_settime");
+    struct pollfd fds[3] = {
+        {STDIN_FILENO, POLLIN, 0},
+        {timerFd, POLLIN, 0},
+        {fd, POLLIN, 0}
+    };
+
+    char lastStatus[320] = "";
+    while (1) {
+        netFlush(net);
+        buildFrame(&tronGame);
+        char status[320];
+        int statusLen = netStatus(&tronGame, net, status, sizeof(status));
+        if (statusLen > (int) sizeof(status) - 1) statusLen = sizeof(status) - 1;
+        if (tronGame.frame.len > 0 || strcmp(status, lastStatus) != 0) {
+            abAppend(&tronGame.frame, status, statusLen);
+            writeAll(STDOUT_FILENO, tronGame.frame.b, tronGame.frame.len);
+            memcpy(lastStatus, status, statusLen + 1);
+        }
+
+        int timeout = -1; // held back packets need a wakeup of their own
+        if (net->numDelayed > 0) {
+            uint64_t due = net->delayed[net->delayedHead].due, now = nowNs();
+            timeout = due <= now ? 0 : (int) ((due - now + 999999) / 1000000);
+        }
+        if (poll(fds, 3, timeout) == -1) {
+            if (errno == EINTR) continue;
+            die("poll");
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int keys[KEY_READ_SIZE + 1];
+            int numKeys = readKeys(&stdinKeys, STDIN_FILENO, keys);
+            lightCycle * me = &tronGame.cycles[net->local];
+            bool steer = tronGame.curState == IN_GAME && me->alive;
+            for (int k = 0; k < numKeys; k++) {
+                switch (keys[k]) {
+                    case CTRL_KEY('q'):
+                        write(STDOUT_FILENO, "\x1b[2J", 4);
+                        write(STDOUT_FILENO, "\x1b[H", 3);
+                        exit(0);
+                    case 'w': case 'W': case ARROW_UP: if (steer) steerCycle(me, 0, -1); break;
+                    case 'a': case 'A': case ARROW_LEFT: if (steer) steerCycle(me, -1, 0); break;
+                    case 's': case 'S': case ARROW_DOWN: if (steer) steerCycle(me, 0, 1); break;
+                    case 'd': case 'D': case ARROW_RIGHT: if (steer) steerCycle(me, 1, 0); break;
+                    case ' ':
+                    case '1':
+                    case '2':
+                        if (netCanStart(net)) netBeginMatch(&tronGame, net, net->match + 1);
+                        else if (!net->host && (net->match == 0 || net->matchOver)) net->wantsMatch = true;
+                        break;
+                }
+            }
+        }
+
+        if (fds[2].revents & POLLIN) {
+            uint8_t buf[NET_MAX_PACKET];
+            int n;
+            while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) netReceive(&tronGame, net, buf, n);
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t expirations;
+            if (read(timerFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                if (expirations > MAX_CATCHUP_TICKS) expirations = MAX_CATCHUP_TICKS;
+                while (expirations--) netTick(&tronGame, net);
+            }
+        }
+    }
+}
+
+/*** Spectators ***/
+// digits are a TCP port on localhost, anything else the path of a Unix socket
+int spectatorAddress(const char * where, struct sockaddr_storage * addr, socklen_t * len) {
+    memset(addr, 0, sizeof(*addr));
+    if (where[0] != '\0' && strspn(where, "0123456789") == strlen(where)) {
+        struct sockaddr_in * in = (struct sockaddr_in *) addr;
+        in->sin_family = AF_INET;
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        in->sin_port = htons((uint16_t) atoi(where));
+        *len = sizeof(*in);
+        return AF_INET;
+    }
+    struct sockaddr_un * un = (struct sockaddr_un *) addr;
+    un->sun_family = AF_UNIX;
+    snprintf(un->sun_path, sizeof(un->sun_path), "%s", where);
+    *len = sizeof(*un);
+    return AF_UNIX;
+}
+
+// nonblocking, --server's too
+int listenOn(const char * where, int backlog) {
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
+    int family = spectatorAddress(where, &addr, &addrLen);
+    int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) die("socket");
+    if (family == AF_INET) {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+    else unlink(where); // left behind by an earlier run
+    if (bind(fd, (struct sockaddr *) &addr, addrLen) == -1) die("bind");
+    if (listen(fd, backlog) == -1) die("listen");
+    return fd;
+}
+
+spectatorServer * spectatorsInit(const char * where) {
+    int fd = listenOn(where, SPECTATOR_BACKLOG);
+    spectatorServer * spec = (spectatorServer *) calloc(1, sizeof(spectatorServer));
+    if (spec == NULL) die("malloc");
+    spec->listenFd = fd;
+    abInit(&spec->full, 1024);
+    return spec;
+}
+
+// After every frame: let newcomers in, drain whoever is behind, hand the frame to everyone
+// who's caught up, then one full repaint for all who need one
+void spectatorsServe(tron * this, spectatorServer * spec, const frameSnapshot * snap) {
+    uint64_t now = nowNs();
+    int fd;
+    while ((fd = accept4(spec->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // fails harmlessly on a Unix socket
+        if (spec->numViewers == spec->cap) {
+            spec->cap = spec->cap ? spec->cap * 2 : 16;
+            spec->viewers = (viewer *) realloc(spec->viewers, sizeof(viewer) * spec->cap);
+            if (spec->viewers == NULL) die("realloc");
+        }
+        viewer * v = &spec->viewers[spec->numViewers++];
+        memset(v, 0, sizeof(*v));
+        v->fd = fd;
+        v->state = VIEWER_NEEDS_FULL;
+        spec->joined++;
+        atomic_store(&spec->watching, spec->numViewers);
+    }
+
+    bool wantFull = false;
+    for (int i = 0; i < spec->numViewers; ) {
+        viewer * v = &spec->viewers[i];
+        bool ok = true;
+        if (v->state == VIEWER_BEHIND) {
+            int len = v->tailLen;
+            v->tailLen = 0;
+            v->state = VIEWER_NEEDS_FULL; // whatever it missed meanwhile, unless the tail still doesn't fit
+            uint64_t since = v->behindSince;
+            ok = viewerWrite(v, v->tail, len, now);
+            if (v->state == VIEWER_BEHIND) {
+                v->behindSince = since;
+                if (now - since > SPECTATOR_STALL_NS) ok = false;
+            }
+            else spec->resyncs++;
+        }
+        else if (v->state == VIEWER_SYNCED && this->frame.len > 0) {
+            ok = viewerWrite(v, this->frame.b, this->frame.len, now);
+        }
+        if (!ok) {
+            viewerDrop(spec, i);
+            continue;
+        }
+        if (v->state == VIEWER_NEEDS_FULL) wantFull = true;
+        i++;
+    }
+    if (!wantFull) return;
+
+    // snap is what the frame above drew, so this leaves shadowBoard as it was
+    spec->full.len = 0;
+    abAppend(&spec->full, "\x1b[2J", 4); // their terminal may be bigger than ours
+    this->frameAttr = ATTR_UNKNOWN;
+    drawFullScreen(this, &spec->full, snap);
+    for (int i = 0; i < spec->numViewers; ) {
+        viewer * v = &spec->viewers[i];
+        if (v->state == VIEWER_NEEDS_FULL) {
+            v->state = VIEWER_SYNCED;
+            if (!viewerWrite(v, spec->full.b, spec->full.len, now)) {
+                viewerDrop(spec, i);
+                continue;
+            }
+        }
+        i++;
+    }
+}
+
+// As much as the socket takes right now, the rest waits in the viewer's tail. False when the
+// viewer has gone away.
+bool viewerWrite(viewer * v, const char * buf, int len, uint64_t now) {
+    int sent = 0;
+    while (sent < len) {
+        ssize_t n = send(v->fd, buf + sent, len - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) sent += n;
+        else if (n == -1 && errno == EINTR) continue;
+        else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        else return false;
+    }
+    if (sent == len) return true;
+
+    int rest = len - sent;
+    if (rest > v->tailCap) {
+        v->tail = (char *) realloc(v->tail, rest);
+        if (v->tail == NULL) die("realloc");
+        v->tailCap = rest;
+    }
+    memmove(v->tail, buf + sent, rest); // buf can be the old tail
+    v->tailLen = rest;
+    v->state = VIEWER_BEHIND;
+    v->behindSince = now;
+    return true;
+}
+
+void viewerDrop(spectatorServer * spec, int i) {
+    viewer * v = &spec->viewers[i];
+    close(v->fd);
+    free(v->tail);
+    spec->viewers[i] = spec->viewers[--spec->numViewers];
+    spec->dropped++;
+    atomic_store(&spec->watching, spec->numViewers);
+}
+
+// A viewer for --spectate, for terminals without nc: everything that comes in goes straight to
+// the screen until the game ends or Ctrl-Q
+int runWatch(options * opts) {
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
+    int family = spectatorAddress(opts->watch, &addr, &addrLen);
+    int fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *) &addr, addrLen) == -1) {
+        perror("connect");
+        return 1;
+    }
+    enableRawMode();
+
+    struct pollfd fds[2] = {
+        {STDIN_FILENO, POLLIN, 0},
+        {fd, POLLIN, 0}
+    };
+    char buf[65536];
+    while (1) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) continue;
+            die("poll");
+        }
+        if (fds[0].revents & POLLIN) {
+            int keys[KEY_READ_SIZE + 1];
+            int numKeys = readKeys(&stdinKeys, STDIN_FILENO, keys);
+            for (int k = 0; k < numKeys; k++) {
+                if (keys[k] == CTRL_KEY('q')) fds[1].fd = -1;
+            }
+        }
+        if (fds[1].fd == -1) break;
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n <= 0) break; // the game is over
+            writeAll(STDOUT_FILENO, buf, (int) n);
+        }
+    }
+    close(fd);
+    write(STDOUT_FILENO, "\x1b[2J\x1b[H\x1b[?25h", 13);
+    return 0;
+}
+
+/*** Input & Output ***/
+// input
+void inputStart(inputQueue * q) {
+    atomic_store(&q->head, 0);
+    atomic_store(&q->tail, 0);
+    atomic_store(&q->dropped, 0);
+    q->wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (q->wakeFd == -1) die("eventfd");
+    if (pthread_create(&q->thread, NULL, inputThreadMain, q) != 0) die("pthread_create");
+}
+
+// Sleeps in poll() until stdin has something, timestamps it, decodes every key that came
+// with it and wakes the game thread once for the lot. Half an escape sequence only gets
+// a short wait for the rest before it counts as a lone Esc.
+void * inputThreadMain(void * arg) {
+    inputQueue * q = (inputQueue *) arg;
+    struct pollfd fd = {STDIN_FILENO, POLLIN, 0};
+    while (1) {
+        int ready = poll(&fd, 1, stdinKeys.state == KEY_GROUND ? -1 : KEY_ESC_TIMEOUT_MS);
+        if (ready == -1) {
+            if (errno == EINTR) continue;
+            die("poll");
+        }
+        uint64_t readNs = nowNs();
+        int keys[KEY_READ_SIZE + 1];
+        int numKeys = ready == 0 ? keyParserFlush(&stdinKeys, keys) : readKeys(&stdinKeys, STDIN_FILENO, keys);
+        bool pushed = false;
+        for (int k = 0; k < numKeys; k++) pushed |= inputPush(q, keys[k], readNs);
+        if (pushed) {
+            uint64_t one = 1;
+            if (write(q->wakeFd, &one, sizeof(one)) == -1 && errno != EAGAIN) die("write");
+        }
+    }
+    return NULL;
+}
+
+bool inputPush(inputQueue * q, int key, uint64_t readNs) {
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&q->tail, memory_order_acquire) == INPUT_QUEUE_SIZE) {
+        atomic_fetch_add(&q->dropped, 1);
+        return false;
+    }
+    q->events[head & (INPUT_QUEUE_SIZE - 1)] = (inputEvent) {key, readNs};
+    atomic_store_explicit(&q->head, head + 1, memory_order_release); // publishes the event
+    return true;
+}
+
+bool inputPop(inputQueue * q, inputEvent * ev) {
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&q->head, memory_order_acquire)) return false;
+    *ev = q->events[tail & (INPUT_QUEUE_SIZE - 1)];
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release); // hands the slot back
+    return true;
+}
+
+// Ticks come from a timerfd so the game runs at the same speed no matter how fast keys
+// arrive or the terminal takes frames, those go out on the render thread. Keys are handled as
+// soon as the input thread wakes us, but turns only queue up per player and get applied at the
+// start of the next tick, one each.
+void gameLoop(tron * tronGame, int tickRate) {
+    static inputQueue input; // 4 KB of ring, no need for it on the stack
+    inputStart(&input);
+
+    int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timerFd == -1) die("timerfd_create");
+
+    long tickNs = 1000000000L / tickRate;
+    struct itimerspec period;
+    period.it_interval.tv_sec = tickNs / 1000000000L;
+    period.it_interval.tv_nsec = tickNs % 1000000000L;
+    period.it_value = period.it_interval;
+    if (timerfd_settime(timerFd, 0, &period, NULL) == -1) die("timerfd_settime");
+
+    struct pollfd fds[2 + 2 * MAX_CYCLES] = {
+        {input.wakeFd, POLLIN, 0},
+        {timerFd, POLLIN, 0}
+    };
+
+    renderStart(tronGame);
+    while (1) {
+        renderPublish(tronGame); // no-op when nothing changed, never waits for the terminal
+
+        // bots' answers are read as they come in, so their round trips are what they took
+        int numFds = 2;
+        if (tronGame->bots != NULL) numFds += botPollFds(tronGame->bots, fds + 2);
+        if (poll(fds, numFds, -1) == -1) {
+            if (errno == EINTR) continue;
+            die("poll");
+        }
+        if (numFds > 2) botPolled(tronGame->bots, fds + 2, numFds - 2);
+
+        uint64_t wakes;
+        if (fds[0].revents & POLLIN) read(input.wakeFd, &wakes, sizeof(wakes));
+        // the ring gets drained on every wakeup, a key that raced the timer still makes this tick
+        inputEvent ev;
+        uint64_t t = profStart(tronGame);
+        int numKeys = 0;
+        for (; inputPop(&input, &ev); numKeys++) processKeypress(tronGame, ev.key, ev.readNs);
+        if (numKeys > 0) profEnd(tronGame, PHASE_INPUT, t);
+
+        if (fds[1].revents & POLLIN) {
+            uint64_t expirations;
+            if (read(timerFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                if (expirations > MAX_CATCHUP_TICKS) expirations = MAX_CATCHUP_TICKS;
+                while (expirations--) {
+                    applyQueuedTurns(tronGame);
+                    gameTick(tronGame);
+                }
+            }
+        }
+    }
+}
+
+// a turn the cycle is already taking is dropped, a full buffer drops the newest
+void queueTurn(tron * tronGame, int player, int dirX, int dirY, uint64_t readNs) {
+    turnBuffer * buf = &tronGame->turns[player];
+    int lastX = buf->count > 0 ? buf->dirX[buf->count - 1] : tronGame->cycles[player].dirX;
+    int lastY = buf->count > 0 ? buf->dirY[buf->count - 1] : tronGame->cycles[player].dirY;
+    if ((lastX == dirX && lastY == dirY) || buf->count == MAX_QUEUED_TURNS) return;
+    buf->dirX[buf->count] = dirX;
+    buf->dirY[buf->count] = dirY;
+    buf->readNs[buf->count] = readNs;
+    buf->count++;
+}
+
+// Takes the oldest turn each human can make, U-turns pressed as two quick keys come out over
+// two ticks instead of the second key bouncing off. Reversals are thrown away.
+void applyQueuedTurns(tron * tronGame) {
+    if (tronGame->curState != IN_GAME) return;
+    uint64_t now = nowNs();
+    for (int p = 0; p < MAX_HUMANS && p < tronGame->numCycles; p++) {
+        turnBuffer * buf = &tronGame->turns[p];
+        lightCycle * cycle = &tronGame->cycles[p];
+        int taken = 0;
+        while (taken < buf->count) {
+            int dirX = buf->dirX[taken], dirY = buf->dirY[taken];
+            uint64_t readNs = buf->readNs[taken++];
+            if (cycle->lastDirX * dirX + cycle->lastDirY * dirY != 0) continue;
+            steerCycle(cycle, dirX, dirY);
+            uint64_t lag = now - readNs;
+            tronGame->lagTurns++;
+            tronGame->lagTotalNs += lag;
+            if (lag > tronGame->lagMaxNs) tronGame->lagMaxNs = lag;
+            break;
+        }
+        buf->count -= taken;
+        memmove(buf->dirX, buf->dirX + taken, buf->count);
+        memmove(buf->dirY, buf->dirY + taken, buf->count);
+        memmove(buf->readNs, buf->readNs + taken, buf->count * sizeof(uint64_t));
+    }
+}
+
+void processKeypress(tron * tronGame, int c, uint64_t readNs) {
+    bool inGame = tronGame->curState == IN_GAME;
+
+    switch (c) {
+        case CTRL_KEY('q'):
+            renderStop(tronGame);
+            write(STDOUT_FILENO, "\x1b[2J", 4); 
+            write(STDOUT_FILENO, "\x1b[H", 3);
+            exit(0);
+            break;
+        case '1':
+        case '2':
+            if (!inGame) { // player 1 is always at the keyboard, the computer takes everyone else
+                tronGame->singlePlayer = c == '1' ? true : false;
+                for (int i = 1; i < tronGame->numCycles; i++) {
+                    bool human = i == 1 && !tronGame->singlePlayer;
+                    tronGame->cycles[i].engine = human ? AI_NONE : tronGame->computerEngine;
+                }
+                gameStart(tronGame);
+            }
+            break;
+        case ' ':
+            if (!inGame) {
+                gameStart(tronGame);
+            }
+            break;
+        case 'h':
+        case 'H': { // timing HUD, the profiler only exists while something wants it
+            profiler * prof = tronGame->prof;
+            if (prof == NULL) prof = tronGame->prof = profilerInit(NULL);
+            prof->hud = !prof->hud;
+            // snapshots on their way to be drawn may point at it, so with a render thread it stays
+            // allocated and profOn keeps the probes off it
+            if (!prof->hud && prof->trace == NULL && tronGame->render == NULL) {
+                profilerFree(prof);
+                tronGame->prof = NULL;
+            }
+            tronGame->fullRepaint = true;
+            break;
+        }
+        case 'f':
+        case 'F':
+            if (tronGame->arena != NULL) { // watch the next cycle still going
+                for (int k = 1; k <= tronGame->numCycles; k++) {
+                    int i = (tronGame->follow + k) % tronGame->numCycles;
+                    if (!tronGame->cycles[i].alive && inGame) continue;
+                    tronGame->follow = i;
+                    break;
+                }
+                viewCenter(tronGame);
+                tronGame->fullRepaint = true;
+            }
+            break;
+        case 'c':
+        case 'C':
+            if (!inGame) { // pick the difficulty for the next single player game, or the bot
+                aiEngine last = tronGame->bots != NULL ? AI_BOT : AI_MCTS;
+                tronGame->computerEngine = tronGame->computerEngine == last ? AI_CHASER : tronGame->computerEngine + 1;
+                tronGame->fullRepaint = true;
+            }
+            break;
+        case 'w':
+        case 'W':
+            if (inGame) queueTurn(tronGame, 0, 0, -1, readNs);
+            break;
+        case 'a':
+        case 'A':
+            if (inGame) queueTurn(tronGame, 0, -1, 0, readNs);
+            break;
+        case 's':
+        case 'S':
+            if (inGame) queueTurn(tronGame, 0, 0, 1, readNs);
+            break;
+        case 'd':
+        case 'D':
+            if (inGame) queueTurn(tronGame, 0, 1, 0, readNs);
+            break;
+        case ARROW_UP:
+            if (inGame && !tronGame->singlePlayer) queueTurn(tronGame, 1, 0, -1, readNs);
+            break;
+        case ARROW_LEFT:
+            if (inGame && !tronGame->singlePlayer) queueTurn(tronGame, 1, -1, 0, readNs);
+            break;
+        case ARROW_DOWN:
+            if (inGame && !tronGame->singlePlayer) queueTurn(tronGame, 1, 0, 1, readNs);
+            break;
+        case ARROW_RIGHT:
+            if (inGame && !tronGame->singlePlayer) queueTurn(tronGame, 1, 1, 0, readNs);
+            break;
+    }
+}
+
+// output
+void abInit(struct abuf * ab, int cap) {
+    ab->b = (char *) malloc(cap);
+    if (ab->b == NULL) die("malloc");
+    ab->len = 0;
+    ab->cap = cap;
+}
+
+void abAppend(struct abuf * ab, const char * s, int len) {
+    if (ab->len + len > ab->cap) {
+        // buffers are sized for the worst case up front, this is only a safety net
+        int newCap = ab->cap * 2 + len;
+        char * new = (char *) realloc(ab->b, newCap);
+        if (new == NULL) return;
+        ab->b = new;
+        ab->cap = newCap;
+    }
+
+    memcpy(&ab->b[ab->len], s, len);
+    ab->len += len;
+}
+
+int writeAll(int fd, const char * buf, int len) {
+    int written = 0;
+    while (written < len) {
+        int n = write(fd, buf + written, len - written);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        written += n;
+    }
+    return written;
+}
+
+// blocking, false at the end of the file
+bool readAll(int fd, void * buf, int len) {
+    int got = 0;
+    while (got < len) {
+        ssize_t n = read(fd, (char *) buf + got, len - got);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        got += n;
+    }
+    return true;
+}
+
+// Worst case is a full repaint of nothing but trail cells, plus the per row extras
+// (message overlay, clear line) and the instruction bar. Sized once, reused forever.
+void frameInit(tron * this) {
+    int rowBytes = this->viewCols * MAX_GLYPH_BYTES + this->viewCols + 96;
+    int dirtyBytes = MAX_DIRTY_CELLS * (MAX_CURSOR_MOVE_BYTES + MAX_GLYPH_BYTES) + this->viewCols + 64; // + a HUD refresh
+    int fullBytes = this->viewRows * rowBytes + this->viewCols + 32;
+    abInit(&this->frame, fullBytes > dirtyBytes ? fullBytes : dirtyBytes);
+}
+
+void snapshotInit(tron * this, frameSnapshot * snap) {
+    snap->glyphs = (uint8_t *) malloc(this->viewRows * this->viewCols);
+    snap->rowsChanged = (uint64_t *) calloc((this->viewRows + 63) / 64, sizeof(uint64_t));
+    if (snap->glyphs == NULL || snap->rowsChanged == NULL) die("malloc");
+    snap->seq = 0;
+    snap->prof = NULL;
+}
+
+// The simulation's half of a frame: viewGlyphs catches up with the cells marked dirty and goes
+// into snap with whatever else drawing it takes. False, and snap untouched, with nothing new.
+bool snapshotTake(tron * this, frameSnapshot * snap) {
+    viewFollow(this);
+    int rowWords = (this->viewRows + 63) / 64;
+    bool full = this->fullRepaint, changed = false;
+    if (full) {
+        for (int y = 0; y < this->viewRows; y++) {
+            for (int x = 0; x < this->viewCols; x++) {
+                this->viewGlyphs[y * this->viewCols + x] = cellGlyph(this, this->viewLeft + x, this->viewTop + y);
+            }
+        }
+    }
+    else {
+        for (int i = 0; i < this->numDirty; i++) {
+            int cell = this->dirtyCells[i];
+            uint8_t glyph = cellGlyph(this, this->viewLeft + cell % this->viewCols, this->viewTop + cell / this->viewCols);
+            if (glyph == this->viewGlyphs[cell]) continue; // marked twice, or back to what it was
+            this->viewGlyphs[cell] = glyph;
+            int y = cell / this->viewCols;
+            this->rowsChanged[y >> 6] |= 1ULL << (y & 63);
+        }
+        for (int w = 0; w < rowWords; w++) changed |= this->rowsChanged[w] != 0;
+    }
+    this->numDirty = 0;
+    this->fullRepaint = false;
+
+    profiler * prof = this->prof;
+    uint64_t now = 0;
+    bool hudDue = prof != NULL && prof->hud && (now = nowNs()) - prof->hudDrawnNs >= PROF_HUD_REFRESH_NS;
+    if (!full && !changed && !hudDue) return false;
+
+    snap->seq = ++this->frameSeq;
+    if (full) this->fullSeq = snap->seq;
+    if (full || hudDue) { // the bar is drawn on full repaints, its numbers are as of then
+        this->statusLen = statusBarText(this, this->statusText, sizeof(this->statusText));
+        this->statusSeq = snap->seq;
+        if (hudDue) prof->hudDrawnNs = now;
+    }
+    memcpy(snap->glyphs, this->viewGlyphs, this->viewRows * this->viewCols);
+    memcpy(snap->rowsChanged, this->rowsChanged, sizeof(uint64_t) * rowWords);
+    memset(this->rowsChanged, 0, sizeof(uint64_t) * rowWords);
+    snap->fullSeq = this->fullSeq;
+    snap->statusSeq = this->statusSeq;
+    snap->curState = this->curState;
+    snap->winner = this->winner;
+    snap->statusLen = this->statusLen;
+    memcpy(snap->status, this->statusText, this->statusLen);
+    snap->prof = profOn(prof) ? prof : NULL;
+    return true;
+}
+
+// Both halves at once, for the loops that draw on their own thread. The frame is left empty
+// when nothing changed.
+void buildFrame(tron * this) {
+    this->frame.len = 0;
+    if (snapshotTake(this, this->snapshot)) frameBuild(this, this->snapshot, &this->frame);
+}
+
+// Build, write and fan out a snapshot, on the render thread when gameLoop has one
+void drawScreen(tron * this, const frameSnapshot * snap) {
+    profiler * prof = snap->prof;
+    uint64_t t = prof != NULL ? nowNs() : 0, built = 0;
+    frameBuild(this, snap, &this->frame);
+    if (this->frame.len > 0) {
+        if (prof != NULL) profRecord(prof, PHASE_BUILD, t, built = nowNs());
+        writeAll(STDOUT_FILENO, this->frame.b, this->frame.len);
+    }
+    if (this->spectators != NULL) spectatorsServe(this, this->spectators, snap); // newcomers get let in either way
+    if (this->frame.len > 0 && prof != NULL) { // nothing changed isn't worth a sample
+        profRecord(prof, PHASE_WRITE, built, nowNs());
+        profFrame(prof, t, this->frame.len);
+    }
+}
+
+// The drawing half: only cells that differ from what's on screen are sent (cursor positioned),
+// so a tick costs a few dozen bytes instead of the whole board. Snapshots that were skipped
+// could have changed any row, after one of those every row gets compared.
+void frameBuild(tron * this, const frameSnapshot * snap, struct abuf * ab) {
+    ab->len = 0;
+    this->frameAttr = ATTR_UNKNOWN; // others write to the terminal between frames
+    bool skipped = snap->seq != this->drawnSeq + 1;
+    if (skipped && this->drawnSeq > 0) atomic_fetch_add(&this->framesDropped, snap->seq - this->drawnSeq - 1);
+
+    if (snap->fullSeq > this->drawnSeq) drawFullScreen(this, ab, snap);
+    else {
+        drawChangedRows(this, ab, snap, skipped);
+        if (snap->statusSeq > this->drawnSeq) {
+            char buf[32];
+            int len = snprintf(buf, sizeof(buf), "\x1b[%d;1H", this->viewRows + 1);
+            abAppend(ab, buf, len);
+            drawStatusBar(this, ab, snap);
+        }
+    }
+    this->drawnSeq = snap->seq;
+}
+
+// Keeps the followed cycle in the window. Once it gets within a quarter of the window of an
+// edge the window jumps to centre it again, so scrolling is a full repaint every few dozen
+// ticks rather than every tick. A crashed cycle hands over to whoever is closest.
+void viewFollow(tron * this) {
+    if (this->viewRows == this->boardRows && this->viewCols == this->boardCols) return;
+    if (!this->cycles[this->follow].alive && this->curState == IN_GAME) {
+        int next = nearestOpponent(this, this->follow);
+        if (next != -1) this->follow = next;
+    }
+    // one axis at a time, a cycle running along the border would otherwise drag the window
+    // along the other axis every tick
+    lightCycle * cycle = &this->cycles[this->follow];
+    int x = cycle->posX - this->viewLeft, y = cycle->posY - this->viewTop;
+    int marginX = this->viewCols / 4, marginY = this->viewRows / 4;
+    int left = this->viewLeft, top = this->viewTop;
+    if (x < marginX || x >= this->viewCols - marginX) left = cycle->posX - this->viewCols / 2;
+    if (y < marginY || y >= this->viewRows - marginY) top = cycle->posY - this->viewRows / 2;
+    viewMove(this, left, top);
+}
+
+void viewCenter(tron * this) {
+    lightCycle * cycle = &this->cycles[this->follow];
+    viewMove(this, cycle->posX - this->viewCols / 2, cycle->posY - this->viewRows / 2);
+}
+
+// the window can't leave the board
+void viewMove(tron * this, int left, int top) {
+    if (left > this->boardCols - this->viewCols) left = this->boardCols - this->viewCols;
+    if (top > this->boardRows - this->viewRows) top = this->boardRows - this->viewRows;
+    if (left < 0) left = 0;
+    if (top < 0) top = 0;
+    if (left == this->viewLeft && top == this->viewTop) return;
+    this->viewLeft = left;
+    this->viewTop = top;
+    this->fullRepaint = true;
+    this->numDirty = 0;
+}
+
+// what a cell looks like on screen: the cell value itself, except dead cycles show up as an X
+uint8_t cellGlyph(tron * this, int x, int y) {
+    uint8_t cell = getCell(this, x, y);
+    if (isHeadCell(cell) && !this->cycles[cellOwner(cell)].alive) return GLYPH_DEAD;
+    return cell;
+}
+
+// SGR only goes out when the attributes change, a trail is one byte a cell
+void drawGlyph(tron * this, struct abuf * ab, uint8_t glyph) {
+    setAttr(this, ab, this->glyphAttr[glyph]);
+    abAppend(ab, &this->glyphChar[glyph], 1);
+}
+
+void setAttr(tron * this, struct abuf * ab, int attr) {
+    if (attr == this->frameAttr) return;
+    abAppend(ab, this->attrBytes[attr], this->attrLen[attr]);
+    this->frameAttr = attr;
+}
+
+// A full row of glyphs. Blanks at the end are left to the erase line that follows, long runs of
+// them in between are erased in place and skipped over.
+void drawRow(tron * this, struct abuf * ab, const uint8_t * glyphs, int n) {
+    int end = n;
+    while (end > 0 && glyphs[end - 1] == CELL_EMPTY) end--;
+    for (int j = 0; j < end;) {
+        int run = 0;
+        while (glyphs[j + run] == CELL_EMPTY) run++; // can't run off, glyphs[end - 1] isn't blank
+        if (run < BLANK_RUN_MIN) {
+            drawGlyph(this, ab, glyphs[j++]);
+            continue;
+        }
+        char buf[32];
+        int len = snprintf(buf, sizeof(buf), "\x1b[%dX\x1b[%dC", run, run); // ECH fills with the current background
+        setAttr(this, ab, ATTR_DEFAULT);
+        abAppend(ab, buf, len);
+        j += run;
+    }
+}
+
+char cycleLabel(int i) {
+    if (i < 9) return '1' + i;
+    if (i < 35) return 'a' + i - 9;
+    if (i < 61) return 'A' + i - 35;
+    return '@';
+}
+
+// Cycle colours repeat once the palette runs out, red is kept for crashes. Every attribute
+// starts from a reset so it can follow any other.
+void glyphInit(tron * this) {
+    static const char * colors[NUM_COLORS] = {"36", "33", "35", "32", "34", "37", "96", "93", "95", "92", "94", "97"};
+    this->attrLen[ATTR_DEFAULT] = snprintf(this->attrBytes[ATTR_DEFAULT], MAX_SGR_BYTES + 1, "\x1b[m");
+    this->attrLen[ATTR_DEAD] = snprintf(this->attrBytes[ATTR_DEAD], MAX_SGR_BYTES + 1, "\x1b[0;31m");
+    for (int c = 0; c < NUM_COLORS; c++) {
+        this->attrLen[2 + 2 * c] = snprintf(this->attrBytes[2 + 2 * c], MAX_SGR_BYTES + 1, "\x1b[0;7;%sm", colors[c]);
+        this->attrLen[3 + 2 * c] = snprintf(this->attrBytes[3 + 2 * c], MAX_SGR_BYTES + 1, "\x1b[0;%sm", colors[c]);
+    }
+
+    memset(this->glyphChar, ' ', sizeof(this->glyphChar));
+    memset(this->glyphAttr, ATTR_DEFAULT, sizeof(this->glyphAttr));
+    this->glyphChar[CELL_WALL] = '*';
+    this->glyphChar[GLYPH_DEAD] = 'X';
+    this->glyphAttr[GLYPH_DEAD] = ATTR_DEAD;
+    for (int i = 0; i < MAX_CYCLES; i++) {
+        this->glyphAttr[trailCell(i)] = 2 + 2 * (i % NUM_COLORS);
+        this->glyphChar[headCell(i)] = cycleLabel(i);
+        this->glyphAttr[headCell(i)] = 3 + 2 * (i % NUM_COLORS);
+    }
+    this->frameAttr = ATTR_UNKNOWN;
+}
+
+void drawChangedRows(tron * this, struct abuf * ab, const frameSnapshot * snap, bool allRows) {
+    int cursorX = -1, cursorY = -1; // where the terminal cursor sits after our last write
+
+    for (int y = 0; y < this->viewRows; y++) {
+        if (!allRows && !((snap->rowsChanged[y >> 6] >> (y & 63)) & 1)) continue;
+        if (snap->curState != IN_GAME && y == this->viewRows / 3) continue; // don't punch holes in the message
+        const uint8_t * want = &snap->glyphs[y * this->viewCols];
+        uint8_t * shown = &this->shadowBoard[y * this->viewCols];
+        for (int x = 0; x < this->viewCols; x++) {
+            if (want[x] == shown[x]) continue;
+            if (x != cursorX || y != cursorY) {
+                char buf[32];
+                int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y + 1, x + 1);
+                abAppend(ab, buf, len);
+            }
+            drawGlyph(this, ab, want[x]);
+            shown[x] = want[x];
+            cursorX = x + 1;
+            cursorY = y;
+        }
+    }
+}
+
+void drawFullScreen(tron * this, struct abuf * ab, const frameSnapshot * snap) {
+    abAppend(ab, "\x1b[?25l", 6); //hide cursor
+
+    // draw board
+    abAppend(ab, "\x1b[H", 3);
+    for (int i = 0; i < this->viewRows; i++) {
+        uint8_t * row = &this->shadowBoard[i * this->viewCols];
+        memcpy(row, &snap->glyphs[i * this->viewCols], this->viewCols);
+        drawRow(this, ab, row, this->viewCols);
+        setAttr(this, ab, ATTR_DEFAULT); // the message and the erase below are in plain colours
+
+        // Potential message overlay
+        if (snap->curState != IN_GAME && i == this->viewRows / 3) {
+            abAppend(ab, "\r", 1);
+            char message[80];
+            int msgLen = 0;
+            switch (snap->curState) {
+                case START_SCREEN:
+                    msgLen = snprintf(message, sizeof(message), "Michael's Tron -- ver %s(start by pressing 1/2 to select # of player)", MICHAEL_TRON_VER);
+                    break;
+                case GAME_OVER:
+                    if (snap->winner >= 0) { // in the winner's colour
+                        int attr = this->glyphAttr[headCell(snap->winner)];
+                        const char * color = this->attrBytes[attr];
+                        int colorLen = this->attrLen[attr];
+                        msgLen = snprintf(message, sizeof(message), "%.*sPlayer %d Win \x1b[0m(restart by pressing 1/2 to select # of player)",
+                                          colorLen, color, snap->winner + 1);
+                    }
+                    else {
+                        msgLen = snprintf(message, sizeof(message), "\x1b[32mDraw \x1b[0m(restart by pressing 1/2 to select # of player)");
+                    }
+                    break;
+                default:
+                    break;
+            }
+            
+            int padding = (this->viewCols - msgLen) / 2;
+            for (int z = padding; z > 0; z--) abAppend(ab, " ", 1);
+
+            if (msgLen > this->viewCols) msgLen = this->viewCols;
+            abAppend(ab, message, msgLen);
+
+            // the overlay covers part of the row, the shadow no longer matches what's on screen there
+            memset(&this->shadowBoard[i * this->viewCols], GLYPH_UNKNOWN, this->viewCols);
+        }
+        
+        abAppend(ab, "\x1b[K", 3);  // clear line right of cursor (optional in our case)
+        abAppend(ab, "\r\n", 2);
+    }
+    drawStatusBar(this, ab, snap);
+}
+
+void drawStatusBar(tron * this, struct abuf * ab, const frameSnapshot * snap) {
+    setAttr(this, ab, ATTR_DEFAULT);
+    abAppend(ab, "\x1b[7m", 4); // invert color
+    abAppend(ab, snap->status, snap->statusLen > this->viewCols ? this->viewCols : snap->statusLen);
+    abAppend(ab, "\x1b[m\x1b[K", 6); // and nothing left over from a longer one
+    this->frameAttr = ATTR_DEFAULT;
+}
+
+// the instruction bar under the board, or the timing HUD in its place, for snapshotTake
+int statusBarText(tron * this, char * buf, int size) {
+    if (this->prof != NULL && this->prof->hud) {
+        int len = profHudText(this->prof, buf, size);
+        long dropped = atomic_load(&this->framesDropped);
+        if (this->render != NULL && len < size) len += snprintf(buf + len, size - len, " | %ld frames dropped", dropped);
+        return len < size ? len : size - 1;
+    }
+    char instruction[200];
+    char player2[64];
+    char where[128] = "";
+    int len = 0;
+    if (this->singlePlayer) len = snprintf(player2, sizeof(player2), "Computer (%s)", engineName(this->cycles[1].engine));
+    else len = snprintf(player2, sizeof(player2), "Arrow keys");
+    if (this->numCycles > 2) snprintf(player2 + len, sizeof(player2) - len, " | Players 3-%d: computer", this->numCycles);
+    if (this->arena != NULL) {
+        snprintf(where, sizeof(where), "Watching %d at %d,%d, F: next | ", this->follow + 1,
+                 this->cycles[this->follow].posX, this->cycles[this->follow].posY);
+    }
+    else if (this->showInputLag && this->lagTurns > 0) {
+        snprintf(where, sizeof(where), "Input lag avg %.1f ms, max %.1f ms | ",
+                 this->lagTotalNs / 1e6 / this->lagTurns, this->lagMaxNs / 1e6);
+    }
+    if (this->spectators != NULL) { // as of the last full repaint, that's when the bar is drawn
+        len = strlen(where);
+        snprintf(where + len, sizeof(where) - len, "%d watching | ", atomic_load(&this->spectators->watching));
+    }
+    if (this->bots != NULL && this->bots->replies > 0) {
+        botHub * hub = this->bots;
+        len = strlen(where);
+        snprintf(where + len, sizeof(where) - len, "Bot %.1f ms avg, %ld missed | ", hub->rttTotalNs / 1e6 / hub->replies,
+                 hub->timeouts);
+    }
+    int instLen = snprintf(instruction, sizeof(instruction), "Player 1: WASD | Player 2: %s | %s%s%s%sCtrl-Q to quit", player2, where,
+                           this->curState != IN_GAME ? "C: computer is " : "",
+                           this->curState != IN_GAME ? engineName(this->computerEngine) : "",
+                           this->curState != IN_GAME ? " | " : "");
+    if (instLen > (int) sizeof(instruction) - 1) instLen = sizeof(instruction) - 1;
+    if (instLen > size - 1) instLen = size - 1;
+    memcpy(buf, instruction, instLen);
+    return instLen;
+}
+
+/*** Render thread ***/
+void renderStart(tron * this) {
+    renderThread * r = (renderThread *) calloc(1, sizeof(renderThread));
+    if (r == NULL) die("malloc");
+    for (int k = 0; k < RENDER_BUFFERS; k++) snapshotInit(this, &r->buffers[k]);
+    r->back = 0;
+    r->front = 1;
+    atomic_store(&r->pending, 2);
+    atomic_store(&r->stop, false);
+    r->wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (r->wakeFd == -1) die("eventfd");
+    this->render = r;
+    if (pthread_create(&r->thread, NULL, renderThreadMain, this) != 0) die("pthread_create");
+}
+
+// Hands the renderer whatever changed, swapping back for the pending buffer. A pending one the
+// renderer never took comes back as the next back buffer and is dropped.
+void renderPublish(tron * this) {
+    renderThread * r = this->render;
+    if (!snapshotTake(this, &r->buffers[r->back])) return;
+    r->back = atomic_exchange(&r->pending, r->back | RENDER_FRESH) & ~RENDER_FRESH;
+    uint64_t one = 1;
+    write(r->wakeFd, &one, sizeof(one));
+}
+
+// before anything else writes to the terminal for good
+void renderStop(tron * this) {
+    renderThread * r = this->render;
+    if (r == NULL) return;
+    atomic_store(&r->stop, true);
+    uint64_t one = 1;
+    write(r->wakeFd, &one, sizeof(one));
+    pthread_join(r->thread, NULL);
+    this->render = NULL;
+}
+
+// Draws the newest snapshot whenever there is one, however long the terminal takes to swallow
+// it. Spectators knocking between frames get let in off the last one drawn.
+void * renderThreadMain(void * arg) {
+    tron * this = (tron *) arg;
+    renderThread * r = this->render;
+    spectatorServer * spec = this->spectators;
+    struct pollfd fds[2] = {
+        {r->wakeFd, POLLIN, 0},
+        {spec != NULL ? spec->listenFd : -1, POLLIN, 0}
+    };
+    while (!atomic_load(&r->stop)) {
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) continue;
+            die("poll");
+        }
+        uint64_t wakes;
+        if (fds[0].revents & POLLIN) read(r->wakeFd, &wakes, sizeof(wakes));
+        if (atomic_load(&r->pending) & RENDER_FRESH) {
+            r->front = atomic_exchange(&r->pending, r->front) & ~RENDER_FRESH;
+            drawScreen(this, &r->buffers[r->front]);
+        }
+        else if ((fds[1].revents & POLLIN) && this->drawnSeq > 0) {
+            this->frame.len = 0;
+            spectatorsServe(this, spec, &r->buffers[r->front]);
+        }
+    }
+    return NULL;
+}
+
+/*** Profiling ***/
+profiler * activeTrace; // closed by profilerAtExit, Ctrl-Q leaves through exit()
+
+profiler * profilerInit(const char * tracePath) {
+    profiler * prof = (profiler *) calloc(1, sizeof(profiler));
+    if (prof == NULL) die("malloc");
+    pthread_mutex_init(&prof->lock, NULL);
+    if (tracePath != NULL) {
+        prof->trace = fopen(tracePath, "w");
+        if (prof->trace == NULL) die("fopen");
+        prof->traceOriginNs = nowNs();
+        prof->traceFirst = true;
+        fprintf(prof->trace, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+        activeTrace = prof;
+        atexit(profilerAtExit);
+    }
+    return prof;
+}
+
+void profilerFree(profiler * prof) {
+    if (prof == activeTrace) profilerAtExit();
+    free(prof);
+}
+
+void profilerAtExit(void) {
+    if (activeTrace == NULL) return;
+    fprintf(activeTrace->trace, "\n]}\n");
+    fclose(activeTrace->trace);
+    activeTrace->trace = NULL;
+    activeTrace = NULL;
+}
+
+static void profPush(profRing * ring, uint64_t value) {
+    ring->values[ring->next] = value;
+    ring->next = (ring->next + 1) % PROF_WINDOW;
+    if (ring->count < PROF_WINDOW) ring->count++;
+}
+
+// One complete event per phase, microseconds since the trace started as chrome://tracing wants.
+// Drawing goes on a track of its own, it has a thread of its own in gameLoop.
+static void profTraceEvent(profiler * prof, const char * name, int tid, uint64_t start, uint64_t end) {
+    fprintf(prof->trace, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+            prof->traceFirst ? "" : ",\n", name, tid, (start - prof->traceOriginNs) / 1e3, (end - start) / 1e3);
+    prof->traceFirst = false;
+}
+
+void profRecord(profiler * prof, profPhase phase, uint64_t start, uint64_t end) {
+    static const char * const names[NUM_PHASES] = {"input", "ai", "sim", "build", "write"};
+    pthread_mutex_lock(&prof->lock);
+    profPush(&prof->phases[phase], end - start);
+    if (phase == PHASE_AI) profPush(&prof->ticks, start);
+    if (prof->trace != NULL) profTraceEvent(prof, names[phase], phase >= PHASE_BUILD ? 2 : 1, start, end);
+    pthread_mutex_unlock(&prof->lock);
+}
+
+// bytes of a frame that went out, a counter track next to the phases in the trace
+void profFrame(profiler * prof, uint64_t start, int bytes) {
+    pthread_mutex_lock(&prof->lock);
+    profPush(&prof->frameBytes, bytes);
+    if (prof->trace != NULL) {
+        fprintf(prof->trace, ",\n{\"name\": \"frame bytes\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": {\"bytes\": %d}}",
+                (start - prof->traceOriginNs) / 1e3, bytes);
+    }
+    pthread_mutex_unlock(&prof->lock);
+}
+
+// over the window, sorting a copy is nothing at a few hundred samples four times a second
+uint64_t profPercentile(profRing * ring, int pct) {
+    if (ring->count == 0) return 0;
+    uint64_t sorted[PROF_WINDOW];
+    memcpy(sorted, ring->values, sizeof(uint64_t) * ring->count);
+    qsort(sorted, ring->count, sizeof(uint64_t), compareU64);
+    return sorted[(ring->count - 1) * pct / 100];
+}
+
+int profHudText(profiler * prof, char * buf, int size) {
+    static const char * const names[NUM_PHASES] = {"in", "ai", "sim", "build", "write"};
+    pthread_mutex_lock(&prof->lock);
+    profRing * ticks = &prof->ticks;
+    double rate = 0;
+    if (ticks->count > 1) {
+        uint64_t newest = ticks->values[(ticks->next + PROF_WINDOW - 1) % PROF_WINDOW];
+        uint64_t oldest = ticks->values[ticks->count < PROF_WINDOW ? 0 : ticks->next];
+        if (newest > oldest) rate = (ticks->count - 1) * 1e9 / (newest - oldest);
+    }
+    int len = snprintf(buf, size, "%.1f Hz | us p50/p99", rate);
+    for (int p = 0; p < NUM_PHASES && len < size; p++) {
+        double p50 = profPercentile(&prof->phases[p], 50) / 1e3, p99 = profPercentile(&prof->phases[p], 99) / 1e3;
+        len += snprintf(buf + len, size - len, " %s %.*f/%.*f", names[p], p50 < 10 ? 1 : 0, p50, p99 < 10 ? 1 : 0, p99);
+    }
+    profRing * bytes = &prof->frameBytes;
+    uint64_t total = 0;
+    for (int i = 0; i < bytes->count; i++) total += bytes->values[i];
+    if (len < size) {
+        len += snprintf(buf + len, size - len, " | %.0f B/frame | H: hide", bytes->count > 0 ? (double) total / bytes->count : 0.0);
+    }
+    pthread_mutex_unlock(&prof->lock);
+    return len < size ? len : size - 1;
+}
+
+/*** Bots ***/
+botHub * botHubInit(const char * command, uint64_t deadlineNs, bool wait, const char * logPath) {
+    botHub * hub = (botHub *) calloc(1, sizeof(botHub));
+    if (hub == NULL) die("malloc");
+    hub->command = command;
+    hub->deadlineNs = deadlineNs;
+    hub->wait = wait;
+    abInit(&hub->msg, sizeof(botHeader) + sizeof(botStart) + MAX_CYCLES * sizeof(botCycle));
+    if (logPath != NULL) {
+        hub->log = fopen(logPath, "w");
+        if (hub->log == NULL) die("fopen");
+        fprintf(hub->log, "match,cycle,seq,rtt_us,result\n");
+    }
+    signal(SIGPIPE, SIG_IGN); // a bot that quit shows up as EPIPE instead
+    return hub;
+}
+
+// The bot's stderr is still ours, on a terminal CMD had better send it somewhere else
+botPlayer * botSpawn(const char * command, int cycle) {
+    int toBot[2], fromBot[2];
+    if (pipe2(toBot, O_CLOEXEC) == -1 || pipe2(fromBot, O_CLOEXEC) == -1) die("pipe2");
+    pid_t pid = fork();
+    if (pid == -1) die("fork");
+    if (pid == 0) { // dup2's copies stay open across the exec, everything else of ours closes
+        dup2(toBot[0], STDIN_FILENO);
+        dup2(fromBot[1], STDOUT_FILENO);
+        execl("/bin/sh", "sh", "-c", command, (char *) NULL);
+        _exit(127);
+    }
+    close(toBot[0]);
+    close(fromBot[1]);
+
+    botPlayer * bot = (botPlayer *) calloc(1, sizeof(botPlayer));
+    if (bot == NULL) die("malloc");
+    bot->cycle = cycle;
+    bot->pid = pid;
+    bot->toFd = toBot[1];
+    bot->fromFd = fromBot[0];
+    fcntl(bot->toFd, F_SETFL, O_NONBLOCK);
+    fcntl(bot->fromFd, F_SETFL, O_NONBLOCK);
+    abInit(&bot->out, 256);
+    return bot;
+}
+
+// a client already on the end of a nonblocking socket, nothing to start
+botPlayer * botAttach(int fd, int cycle) {
+    botPlayer * bot = (botPlayer *) calloc(1, sizeof(botPlayer));
+    if (bot == NULL) die("malloc");
+    bot->cycle = cycle;
+    bot->toFd = fd;
+    bot->fromFd = fd;
+    abInit(&bot->out, 256);
+    return bot;
+}
+
+// A match begins: everybody gets a START, bot processes are started for cycles that never had one
+void botsStart(tron * this) {
+    botHub * hub = this->bots;
+    hub->match++;
+    abuf * msg = &hub->msg;
+    msg->len = sizeof(botHeader); // filled in per bot
+    botStart start = {this->boardRows, this->boardCols};
+    abAppend(msg, (const char *) &start, sizeof(start));
+    for (int i = 0; i < this->numCycles; i++) {
+        lightCycle * cycle = &this->cycles[i];
+        botCycle c = {cycle->posX, cycle->posY, (uint8_t) dirIndex(cycle->lastDirX, cycle->lastDirY), cycle->alive, {0, 0}};
+        abAppend(msg, (const char *) &c, sizeof(c));
+        hub->told[i] = cycle->alive ? c.heading : BOT_CRASHED;
+    }
+
+    for (int i = 0; i < MAX_CYCLES; i++) {
+        bool plays = i < this->numCycles && this->cycles[i].engine == AI_BOT;
+        if (plays && hub->players[i] == NULL) hub->players[i] = botSpawn(hub->command, i);
+        botPlayer * bot = hub->players[i];
+        if (bot == NULL) continue;
+        bot->playing = plays;
+        if (!plays) continue;
+        botHeader h = {BOT_START, (uint8_t) i, (uint16_t) this->numCycles, 0};
+        botRequest(hub, bot, &h);
+    }
+}
+
+// After every tick: the cycles that turned or crashed go to every bot in the match, as the
+// request for its next move while its cycle is going, as the END once the match is over
+void botsTick(tron * this) {
+    botHub * hub = this->bots;
+    abuf * msg = &hub->msg;
+    msg->len = sizeof(botHeader);
+    int count = 0;
+    for (int i = 0; i < this->numCycles; i++) {
+        lightCycle * cycle = &this->cycles[i];
+        uint8_t what = cycle->alive ? (uint8_t) dirIndex(cycle->lastDirX, cycle->lastDirY) : BOT_CRASHED;
+        if (what == hub->told[i]) continue;
+        botEvent e = {(uint8_t) i, what};
+        abAppend(msg, (const char *) &e, sizeof(e));
+        hub->told[i] = what;
+        count++;
+    }
+
+    for (int i = 0; i < this->numCycles; i++) {
+        botPlayer * bot = hub->players[i];
+        if (bot == NULL || !bot->playing) continue;
+        if (this->curState != IN_GAME) {
+            botHeader h = {BOT_END, (uint8_t) i, (uint16_t) count, (uint32_t) (this->winner + 1)};
+            memcpy(msg->b, &h, sizeof(h));
+            botWrite(bot, msg->b, msg->len);
+            bot->playing = false;
+        }
+        else if (this->cycles[i].alive) { // a crashed one hears nothing more until the END
+            botHeader h = {BOT_TICK, (uint8_t) i, (uint16_t) count, 0};
+            botRequest(hub, bot, &h);
+        }
+    }
+}
+
+// hub->msg with the header stamped with the bot's next seq, the clock starts now
+void botRequest(botHub * hub, botPlayer * bot, botHeader * h) {
+    h->seq = ++bot->seq;
+    bot->decided = false;
+    bot->answered = false;
+    bot->sentNs[bot->seq & (BOT_RING - 1)] = nowNs();
+    memcpy(hub->msg.b, h, sizeof(*h));
+    botWrite(bot, hub->msg.b, hub->msg.len);
+}
+
+void botWrite(botPlayer * bot, const char * buf, int len) {
+    if (bot->gone) return;
+    abAppend(&bot->out, buf, len);
+    botFlush(bot);
+}
+
+// As much as the pipe takes right now. A bot that leaves a megabyte of requests unread is hung.
+void botFlush(botPlayer * bot) {
+    int sent = 0;
+    while (!bot->gone && sent < bot->out.len) {
+        ssize_t n = write(bot->toFd, bot->out.b + sent, bot->out.len - sent);
+        if (n > 0) sent += n;
+        else if (n == -1 && errno == EINTR) continue;
+        else if (n == -1 && errno == EAGAIN) break;
+        else botGone(bot);
+    }
+    if (bot->gone) return;
+    memmove(bot->out.b, bot->out.b + sent, bot->out.len - sent);
+    bot->out.len -= sent;
+    if (bot->out.len > BOT_MAX_BACKLOG) botGone(bot);
+}
+
+void botGone(botPlayer * bot) {
+    if (bot->gone) return;
+    bot->gone = true;
+    close(bot->toFd);
+    if (bot->fromFd != bot->toFd) close(bot->fromFd);
+    if (bot->pid > 0) {
+        kill(bot->pid, SIGKILL);
+        waitpid(bot->pid, NULL, 0);
+    }
+    bot->out.len = 0;
+}
+
+// Every reply that has come in, whatever it answers. now is when they were read. Only the
+// answer to the latest request counts, and only while its move is still to be made.
+void botReceive(botHub * hub, botPlayer * bot, uint64_t now) {
+    uint8_t buf[64 * sizeof(botReply)];
+    while (!bot->gone) {
+        ssize_t n = read(bot->fromFd, buf, sizeof(buf));
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && errno == EAGAIN) return;
+        if (n <= 0) {
+            botGone(bot);
+            return;
+        }
+        for (ssize_t k = 0; k < n; ) {
+            int take = (int) sizeof(botReply) - bot->inLen;
+            if (take > n - k) take = (int) (n - k);
+            memcpy(bot->in + bot->inLen, buf + k, take);
+            bot->inLen += take;
+            k += take;
+            if (bot->inLen < (int) sizeof(botReply)) break;
+            bot->inLen = 0;
+
+            botReply r;
+            memcpy(&r, bot->in, sizeof(r));
+            if (r.seq > bot->seq || bot->seq - r.seq >= BOT_RING) continue; // never asked, or too long ago to time
+            uint64_t rtt = now - bot->sentNs[r.seq & (BOT_RING - 1)];
+            profPush(&hub->rtt, rtt);
+            hub->replies++;
+            hub->rttTotalNs += rtt;
+            if (rtt > hub->rttMaxNs) hub->rttMaxNs = rtt;
+            if (r.seq == bot->seq && !bot->decided && !bot->answered && rtt <= hub->deadlineNs) {
+                bot->answered = true;
+                bot->move = r.move;
+                bot->rttNs = rtt;
+            }
+            else {
+                hub->late++;
+                if (hub->log != NULL) fprintf(hub->log, "%d,%d,%u,%.1f,late\n", hub->match, bot->cycle, r.seq, rtt / 1e3);
+            }
+        }
+    }
+}
+
+// Takes the answer to the request that went out after the last tick. Headless has the time to
+// wait for it, a game on screen only looks at what the poll in gameLoop already read.
+void botMakeMove(tron * this, int i) {
+    botHub * hub = this->bots;
+    botPlayer * bot = hub->players[i];
+    if (bot == NULL || !bot->playing) return;
+    uint64_t due = bot->sentNs[bot->seq & (BOT_RING - 1)] + hub->deadlineNs;
+    if (!hub->polled) botReceive(hub, bot, nowNs());
+    while (hub->wait && !bot->answered && !bot->gone) {
+        uint64_t now = nowNs();
+        if (now >= due) break;
+        struct pollfd fds[2] = {
+            {bot->fromFd, POLLIN, 0},
+            {bot->out.len > 0 ? bot->toFd : -1, POLLOUT, 0}
+        };
+        struct timespec left = {(time_t) ((due - now) / 1000000000ULL), (long) ((due - now) % 1000000000ULL)};
+        if (ppoll(fds, 2, &left, NULL) == -1 && errno != EINTR) die("ppoll");
+        if (fds[1].revents) botFlush(bot);
+        botReceive(hub, bot, nowNs());
+    }
+
+    bot->decided = true;
+    if (bot->answered) {
+        hub->moves++;
+        if (bot->move < 4) steerCycle(&this->cycles[i], searchDirX[bot->move], searchDirY[bot->move]);
+        if (hub->log != NULL) fprintf(hub->log, "%d,%d,%u,%.1f,ok\n", hub->match, i, bot->seq, bot->rttNs / 1e3);
+    }
+    else {
+        hub->timeouts++;
+        if (hub->log != NULL) fprintf(hub->log, "%d,%d,%u,,timeout\n", hub->match, i, bot->seq);
+    }
+}
+
+// gameLoop sleeps on the bots too: their replies, and their stdin while requests wait for room
+int botPollFds(botHub * hub, struct pollfd * fds) {
+    int n = 0;
+    for (int i = 0; i < MAX_CYCLES; i++) {
+        botPlayer * bot = hub->players[i];
+        if (bot == NULL || bot->gone) continue;
+        fds[n++] = (struct pollfd) {bot->fromFd, POLLIN, 0};
+        if (bot->out.len > 0) fds[n++] = (struct pollfd) {bot->toFd, POLLOUT, 0};
+    }
+    return n;
+}
+
+// fds as botPollFds filled them, nothing has touched the bots in between
+void botPolled(botHub * hub, struct pollfd * fds, int n) {
+    uint64_t now = nowNs();
+    for (int i = 0, k = 0; i < MAX_CYCLES && k < n; i++) {
+        botPlayer * bot = hub->players[i];
+        if (bot == NULL || bot->gone) continue;
+        bool writing = bot->out.len > 0;
+        if (fds[k++].revents) botReceive(hub, bot, now);
+        if (writing && fds[k++].revents) botFlush(bot);
+    }
+}
+
+// end of stdin is the bots' cue to go, the rest are told
+void botsStop(botHub * hub) {
+    for (int i = 0; i < MAX_CYCLES; i++) {
+        botPlayer * bot = hub->players[i];
+        if (bot == NULL || bot->gone) continue;
+        close(bot->toFd);
+        if (bot->fromFd != bot->toFd) close(bot->fromFd);
+        if (bot->pid > 0) {
+            kill(bot->pid, SIGTERM);
+            waitpid(bot->pid, NULL, 0);
+        }
+        bot->gone = true;
+    }
+    if (hub->log != NULL) fclose(hub->log);
+    hub->log = NULL;
+}
+
+// bytes after a header, -1 for a message that can't be right
+int botBodySize(const botHeader * h) {
+    if (h->count > MAX_CYCLES) return -1;
+    if (h->type == BOT_START) return sizeof(botStart) + sizeof(botCycle) * h->count;
+    if (h->type == BOT_TICK || h->type == BOT_END) return sizeof(botEvent) * h->count;
+    return -1;
+}
+
+// A message from the game applied to the board a bot keeps from the deltas alone, this already
+// the size a START says. ai drives the bot's own cycle. False for nonsense.
+bool botFollow(tron * this, const botHeader * h, const uint8_t * body, aiEngine ai) {
+    int you = h->you;
+    if (h->type == BOT_START) {
+        const botCycle * cycles = (const botCycle *) (body + sizeof(botStart));
+        if (h->count < 2 || you >= h->count) return false;
+        this->numCycles = h->count;
+        for (int i = 0; i < h->count; i++) {
+            lightCycle * cycle = &this->cycles[i];
+            botCycle c;
+            memcpy(&c, &cycles[i], sizeof(c));
+            int d = c.heading & 3;
+            cycle->posX = c.posX;
+            cycle->posY = c.posY;
+            cycle->dirX = cycle->lastDirX = searchDirX[d];
+            cycle->dirY = cycle->lastDirY = searchDirY[d];
+            cycle->alive = c.alive;
+            cycle->engine = i == you ? ai : AI_NONE;
+        }
+        gameBegin(this);
+        return true;
+    }
+    if (h->type == BOT_END) return true; // nothing to answer
+    if (you >= this->numCycles) return false;
+    for (int i = 0; i < this->numCycles; i++) { // whoever isn't listed went straight on
+        lightCycle * cycle = &this->cycles[i];
+        cycle->dirX = cycle->lastDirX;
+        cycle->dirY = cycle->lastDirY;
+    }
+    for (int k = 0; k < h->count; k++) {
+        botEvent e;
+        memcpy(&e, body + k * sizeof(botEvent), sizeof(e));
+        int i = e.cycle;
+        if (i >= this->numCycles || !this->cycles[i].alive) continue;
+        if (e.what == BOT_CRASHED) killCycle(this, i); // before the move, so it stays put
+        else {
+            this->cycles[i].dirX = searchDirX[e.what & 3];
+            this->cycles[i].dirY = searchDirY[e.what & 3];
+        }
+    }
+    moveCycles(this);
+    return true;
+}
+
+// the answer to a START or TICK botFollow just took in
+botReply botAnswer(tron * this, const botHeader * h) {
+    botReply reply = {h->seq, BOT_KEEP_GOING, {0, 0, 0}};
+    if (this->curState == IN_GAME && this->cycles[h->you].alive) {
+        aiMakeMove(this, h->you);
+        reply.move = (uint8_t) dirIndex(this->cycles[h->you].dirX, this->cycles[h->you].dirY);
+    }
+    return reply;
+}
+
+// --serve-bot: the other end of the protocol. --ai's engine plays from a board it keeps from the
+// deltas alone, like any outside bot has to, so this is the reference for writing one as well as
+// a stand in for trying the game's side.
+int runBotServer(options * opts) {
+    tron tronGame;
+    bool ready = false;
+    botHeader h;
+    uint8_t body[sizeof(botStart) + MAX_CYCLES * sizeof(botCycle)];
+    while (readAll(STDIN_FILENO, &h, sizeof(h))) {
+        int size = botBodySize(&h);
+        if (size < 0 || !readAll(STDIN_FILENO, body, size)) break;
+        if (h.type == BOT_START) {
+            botStart start;
+            memcpy(&start, body, sizeof(start));
+            if (!ready) {
+                if ((int64_t) start.rows * start.cols > BOT_SERVE_MAX_CELLS) arenaGameInit(&tronGame, start.rows, start.cols, 1, 1);
+                else boardGameInit(&tronGame, start.rows, start.cols, 1, 1);
+                tronGame.aiBudgetNs = (uint64_t) opts->aiBudgetMs * 1000000ULL;
+                tronGame.aiThreads = opts->aiThreads;
+                tronGame.tt = ttInit(opts->ttMb);
+                ready = true;
+            }
+            else if (start.rows != tronGame.boardRows || start.cols != tronGame.boardCols) break; // one board per run
+        }
+        else if (!ready) break;
+        if (!botFollow(&tronGame, &h, body, opts->ai)) break;
+        if (h.type == BOT_END) continue;
+
+        botReply reply = botAnswer(&tronGame, &h);
+        if (writeAll(STDOUT_FILENO, (const char *) &reply, sizeof(reply)) == -1) break;
+    }
+    return 0;
+}
+
+/*** Game server ***/
+static volatile sig_atomic_t stopRequested; // Ctrl-C, the final numbers still get printed
+
+static void stopOnSignal(int sig) {
+    (void) sig;
+    stopRequested = 1;
+}
+
+static void catchStopSignals(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stopOnSignal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+}
+
+// a socket per client, ulimit -n's soft limit is often a thousand or so
+void raiseFdLimit(void) {
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+}
+
+int runServer(options * opts) {
+    raiseFdLimit();
+    catchStopSignals();
+    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    gameServer server;
+    server.opts = opts;
+    server.listenFd = listenOn(opts->server, SERVER_BACKLOG);
+    server.periodNs = 1000000000ULL / opts->tickRate;
+    server.epoch = nowNs();
+    atomic_init(&server.stop, false);
+    server.numShards = opts->threads;
+    server.shards = (serverShard *) calloc(server.numShards, sizeof(serverShard));
+    if (server.shards == NULL) die("malloc");
+    for (int i = 0; i < server.numShards; i++) {
+        serverShard * shard = &server.shards[i];
+        shard->server = &server;
+        shard->index = i;
+        shard->filling = -1;
+        shard->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (shard->epollFd == -1) die("epoll_create1");
+        pthread_mutex_init(&shard->lock, NULL);
+        if (pthread_create(&shard->thread, NULL, serverShardMain, shard) != 0) die("pthread_create");
+    }
+    printf("%d player matches on %dx%d boards at %d Hz, %d shards on %d cores, clients connect to %s\n",
+           opts->players, opts->rows, opts->cols, opts->tickRate, server.numShards, cores < server.numShards ? cores : server.numShards,
+           opts->server);
+    fflush(stdout);
+
+    uint64_t nextReport = server.epoch + SERVER_REPORT_NS;
+    while (!stopRequested) {
+        uint64_t now = nowNs();
+        if (opts->seconds > 0 && now - server.epoch >= opts->seconds * 1000000000ULL) break;
+        if (now >= nextReport) {
+            serverReport(&server, (now - server.epoch) / 1e9, false);
+            nextReport += SERVER_REPORT_NS;
+        }
+        struct timespec nap = {0, 50000000};
+        nanosleep(&nap, NULL);
+    }
+    atomic_store(&server.stop, true); // seen by every shard at its next tick
+    for (int i = 0; i < server.numShards; i++) pthread_join(server.shards[i].thread, NULL);
+    serverReport(&server, (nowNs() - server.epoch) / 1e9, true);
+
+    for (int i = 0; i < server.numShards; i++) {
+        serverShard * shard = &server.shards[i];
+        for (int k = 0; k < shard->numMatches; k++) botsStop(shard->matches[k]->game.bots);
+        close(shard->timerFd);
+        close(shard->epollFd);
+    }
+    close(server.listenFd);
+    return 0;
+}
+
+void * serverShardMain(void * arg) {
+    serverShard * shard = (serverShard *) arg;
+    gameServer * server = shard->server;
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(shard->index % (int) sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus); // best effort, the tick times tell
+
+    // tick 1 is due a period after the epoch, for every shard alike
+    shard->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (shard->timerFd == -1) die("timerfd_create");
+    uint64_t first = server->epoch + server->periodNs;
+    struct itimerspec spec = {
+        {(time_t) (server->periodNs / 1000000000ULL), (long) (server->periodNs % 1000000000ULL)},
+        {(time_t) (first / 1000000000ULL), (long) (first % 1000000000ULL)}
+    };
+    if (timerfd_settime(shard->timerFd, TFD_TIMER_ABSTIME, &spec, NULL) == -1) die("timerfd_settime");
+
+    struct epoll_event ev = {EPOLLIN, {.u64 = SERVER_TIMER}};
+    if (epoll_ctl(shard->epollFd, EPOLL_CTL_ADD, shard->timerFd, &ev) == -1) die("epoll_ctl");
+    ev = (struct epoll_event) {EPOLLIN | EPOLLEXCLUSIVE, {.u64 = SERVER_LISTEN}};
+    if (epoll_ctl(shard->epollFd, EPOLL_CTL_ADD, server->listenFd, &ev) == -1) die("epoll_ctl");
+
+    struct epoll_event events[SERVER_EVENTS];
+    uint64_t expirations = 0;
+    while (!atomic_load(&server->stop)) {
+        int n = epoll_wait(shard->epollFd, events, SERVER_EVENTS, expirations > 0 ? 0 : -1);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            die("epoll_wait");
+        }
+        for (int k = 0; k < n; k++) {
+            uint64_t data = events[k].data.u64;
+            if (data == SERVER_LISTEN) serverAccept(shard);
+            else if (data == SERVER_TIMER) {
+                uint64_t e;
+                if (read(shard->timerFd, &e, sizeof(e)) == sizeof(e)) expirations += e;
+            }
+            else serverEvent(shard, data, events[k].events);
+        }
+        // A tick goes after every reply already in, and a full batch may not have been all of them.
+        // With thousands of sockets the timer is often in the first batch.
+        if (expirations > 0 && n < SERVER_EVENTS) {
+            serverTick(shard, expirations);
+            expirations = 0;
+        }
+    }
+    return NULL;
+}
+
+void serverAccept(serverShard * shard) {
+    for (int k = 0; k < SERVER_ACCEPT_BATCH; k++) {
+        int fd = accept4(shard->server->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) return; // taken by another shard, or nobody left
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // fails harmlessly on a Unix socket
+        struct epoll_event ev = {0, {.u64 = 0}}; // serverSeat says what for
+        if (epoll_ctl(shard->epollFd, EPOLL_CTL_ADD, fd, &ev) == -1) die("epoll_ctl");
+        atomic_fetch_add(&shard->clients, 1);
+        serverSeat(shard, botAttach(fd, 0));
+    }
+}
+
+int serverMatchNew(serverShard * shard) {
+    if (shard->numSpare > 0) return shard->spare[--shard->numSpare];
+    if (shard->numMatches == shard->cap) {
+        shard->cap = shard->cap ? shard->cap * 2 : 64;
+        shard->matches = (serverMatch **) realloc(shard->matches, sizeof(serverMatch *) * shard->cap);
+        shard->spare = (int *) realloc(shard->spare, sizeof(int) * shard->cap);
+        if (shard->matches == NULL || shard->spare == NULL) die("realloc");
+    }
+    gameServer * server = shard->server;
+    options * opts = server->opts;
+    serverMatch * m = (serverMatch *) calloc(1, sizeof(serverMatch));
+    if (m == NULL) die("malloc");
+    tron * game = &m->game;
+    boardGameInit(game, opts->rows, opts->cols, 1, 1); // nobody draws it
+    game->numCycles = opts->players;
+    for (int i = 0; i < game->numCycles; i++) game->cycles[i].engine = AI_BOT;
+    game->randomStart = true;
+    game->rngState = matchSeed(opts->seed + shard->index, shard->numMatches);
+    game->bots = botHubInit(NULL, server->periodNs, false, NULL);
+    game->bots->polled = true;
+    shard->matches[shard->numMatches] = m;
+    return shard->numMatches++;
+}
+
+// into the match newcomers are filling, which begins on the next tick once it's full
+void serverSeat(serverShard * shard, botPlayer * bot) {
+    if (shard->filling == -1) shard->filling = serverMatchNew(shard);
+    int index = shard->filling;
+    serverMatch * m = shard->matches[index];
+    botHub * hub = m->game.bots;
+    int seat = 0;
+    while (hub->players[seat] != NULL) seat++;
+    hub->players[seat] = bot;
+    bot->cycle = seat;
+    bot->playing = false;
+    struct epoll_event ev = {EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, {.u64 = (uint64_t) index << 8 | (uint64_t) seat}};
+    if (epoll_ctl(shard->epollFd, EPOLL_CTL_MOD, bot->fromFd, &ev) == -1) die("epoll_ctl");
+    if (++m->seated == m->game.numCycles) shard->filling = -1;
+}
+
+// botGone has closed its socket already
+static void serverDrop(serverShard * shard, botPlayer * bot) {
+    abFree(&bot->out);
+    free(bot);
+    atomic_fetch_sub(&shard->clients, 1);
+}
+
+// a match somebody left before it was over or before it began: the rest go to another one
+static void serverDissolve(serverShard * shard, int index) {
+    serverMatch * m = shard->matches[index];
+    botHub * hub = m->game.bots;
+    botPlayer * stayed[MAX_CYCLES];
+    int numStayed = 0;
+    for (int i = 0; i < m->game.numCycles; i++) {
+        botPlayer * bot = hub->players[i];
+        hub->players[i] = NULL;
+        if (bot == NULL) continue;
+        if (bot->gone) serverDrop(shard, bot);
+        else stayed[numStayed++] = bot;
+    }
+    m->seated = 0;
+    m->game.curState = START_SCREEN;
+    if (shard->filling == index) shard->filling = -1;
+    shard->spare[shard->numSpare++] = index;
+    for (int k = 0; k < numStayed; k++) serverSeat(shard, stayed[k]);
+}
+
+static bool serverDeserted(serverMatch * m) {
+    for (int i = 0; i < m->game.numCycles; i++) {
+        if (!m->game.bots->players[i]->gone) return false;
+    }
+    return true;
+}
+
+// Replies read off a client's socket, and room in it for requests that were waiting
+void serverEvent(serverShard * shard, uint64_t data, uint32_t events) {
+    int index = (int) (data >> 8);
+    int seat = (int) (data & 0xff);
+    serverMatch * m = shard->matches[index];
+    botHub * hub = m->game.bots;
+    botPlayer * bot = hub->players[seat];
+    if (bot == NULL || bot->gone) return; // left earlier in the same batch
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) botReceive(hub, bot, nowNs());
+    if (events & EPOLLOUT) botFlush(bot);
+    if (!bot->gone || m->game.curState != START_SCREEN) return; // mid match its cycle rides on to the END
+    hub->players[seat] = NULL;
+    m->seated--;
+    serverDrop(shard, bot);
+    if (index != shard->filling) serverDissolve(shard, index); // it was full, nobody else will fill it
+}
+
+// One tick of every match in the shard, on the shared schedule. Matches that ended last tick
+// go again, full ones begin.
+void serverTick(serverShard * shard, uint64_t expirations) {
+    gameServer * server = shard->server;
+    shard->tick += expirations;
+    int playing = 0;
+    long played = 0, moves = 0, timeouts = 0;
+    for (int i = 0; i < shard->numMatches; i++) {
+        serverMatch * m = shard->matches[i];
+        tron * game = &m->game;
+        if (game->curState == IN_GAME && serverDeserted(m)) serverDissolve(shard, i); // nobody to play it out for
+        else if (game->curState == IN_GAME) {
+            computerMoves(game); // what epoll has read by now
+            moveCycles(game);    // and the next requests go out
+        }
+        else if (game->curState == GAME_OVER) {
+            played++;
+            serverMatchOver(shard, i);
+        }
+        else if (m->seated == game->numCycles) gameStart(game); // botsStart sends the STARTs
+        if (game->curState == IN_GAME) playing++;
+        moves += game->bots->moves;
+        timeouts += game->bots->timeouts;
+        game->bots->moves = 0;
+        game->bots->timeouts = 0;
+    }
+
+    uint64_t due = server->epoch + shard->tick * server->periodNs;
+    uint64_t now = nowNs();
+    uint64_t late = now > due ? now - due : 0;
+    long missed = (long) expirations - 1 + (late >= server->periodNs ? 1 : 0);
+    atomic_store(&shard->playing, playing);
+    atomic_fetch_add(&shard->played, played);
+    atomic_fetch_add(&shard->ticks, (long) expirations);
+    atomic_fetch_add(&shard->misses, missed);
+    atomic_fetch_add(&shard->moves, moves);
+    atomic_fetch_add(&shard->timeouts, timeouts);
+    pthread_mutex_lock(&shard->lock);
+    profPush(&shard->done, late);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// the same players go again, unless one of them has left
+void serverMatchOver(serverShard * shard, int index) {
+    serverMatch * m = shard->matches[index];
+    for (int i = 0; i < m->game.numCycles; i++) {
+        if (m->game.bots->players[i]->gone) {
+            serverDissolve(shard, index);
+            return;
+        }
+    }
+    gameStart(&m->game);
+}
+
+// A line of totals. How late ticks finish is the worst shard's, with perShard every shard's too.
+void serverReport(gameServer * server, double seconds, bool perShard) {
+    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores > server->numShards) cores = server->numShards;
+    int clients = 0, playing = 0;
+    long played = 0, ticks = 0, misses = 0, moves = 0, timeouts = 0;
+    uint64_t p50 = 0, p99 = 0;
+    for (int i = 0; i < server->numShards; i++) {
+        serverShard * shard = &server->shards[i];
+        clients += atomic_load(&shard->clients);
+        playing += atomic_load(&shard->playing);
+        played += atomic_load(&shard->played);
+        ticks += atomic_load(&shard->ticks);
+        misses += atomic_load(&shard->misses);
+        moves += atomic_load(&shard->moves);
+        timeouts += atomic_load(&shard->timeouts);
+        pthread_mutex_lock(&shard->lock);
+        uint64_t shardP50 = profPercentile(&shard->done, 50);
+        uint64_t shardP99 = profPercentile(&shard->done, 99);
+        pthread_mutex_unlock(&shard->lock);
+        if (shardP50 > p50) p50 = shardP50;
+        if (shardP99 > p99) p99 = shardP99;
+        if (perShard) {
+            printf("  shard %d: %d clients, %d matches, %ld played, %ld ticks, %ld missed, done p50/p99 %.2f/%.2f ms after due\n",
+                   i, atomic_load(&shard->clients), atomic_load(&shard->playing), atomic_load(&shard->played),
+                   atomic_load(&shard->ticks), atomic_load(&shard->misses), shardP50 / 1e6, shardP99 / 1e6);
+        }
+    }
+    printf("%6.1fs %6d clients %6d matches (%.0f per core) %7ld played | ticks %ld, deadline missed %ld (%.2f%%), "
+           "done p50/p99 %.2f/%.2f of %.1f ms | moves %ld, %ld without a reply\n",
+           seconds, clients, playing, (double) playing / cores, played, ticks, misses, ticks > 0 ? 100.0 * misses / ticks : 0.0,
+           p50 / 1e6, p99 / 1e6, server->periodNs / 1e6, moves, timeouts);
+    fflush(stdout);
+}
+
+// --load PORT|PATH: --clients connections split over --threads, all connected before any play
+int runLoad(options * opts) {
+    raiseFdLimit();
+    catchStopSignals();
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
+    int family = spectatorAddress(opts->load, &addr, &addrLen);
+    int numWorkers = opts->threads < opts->clients ? opts->threads : opts->clients;
+    loadWorker * workers = (loadWorker *) calloc(numWorkers, sizeof(loadWorker));
+    if (workers == NULL) die("malloc");
+    transTable * tt = ttInit(opts->ttMb);
+
+    uint64_t start = nowNs();
+    for (int w = 0; w < numWorkers; w++) {
+        loadWorker * worker = &workers[w];
+        worker->opts = opts;
+        worker->tt = tt;
+        worker->numClients = opts->clients / numWorkers + (w < opts->clients % numWorkers);
+        worker->clients = (loadClient *) calloc(worker->numClients, sizeof(loadClient));
+        if (worker->clients == NULL) die("malloc");
+        for (int i = 0; i < worker->numClients; i++) {
+            loadClient * c = &worker->clients[i];
+            c->fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (c->fd == -1 || connect(c->fd, (struct sockaddr *) &addr, addrLen) == -1) {
+                perror("connect");
+                return 1;
+            }
+            int on = 1;
+            setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            fcntl(c->fd, F_SETFL, O_NONBLOCK);
+            abInit(&c->in, 256);
+            abInit(&c->out, 64);
+        }
+    }
+    uint64_t connected = nowNs();
+    printf("%d clients connected in %.0f ms\n", opts->clients, (connected - start) / 1e6);
+    fflush(stdout);
+
+    for (int w = 0; w < numWorkers; w++) {
+        workers[w].until = opts->seconds > 0 ? connected + opts->seconds * 1000000000ULL : UINT64_MAX;
+        if (pthread_create(&workers[w].thread, NULL, loadWorkerMain, &workers[w]) != 0) die("pthread_create");
+    }
+    long matches = 0, wins = 0, replies = 0, hungUp = 0;
+    for (int w = 0; w < numWorkers; w++) {
+        pthread_join(workers[w].thread, NULL);
+        matches += workers[w].matches;
+        wins += workers[w].wins;
+        replies += workers[w].replies;
+        hungUp += workers[w].hungUp;
+    }
+    double elapsed = (nowNs() - connected) / 1e9;
+    printf("%d clients on %d threads, %.1fs: %ld matches joined, %ld won, %ld moves sent (%.0f/sec), %ld hung up on\n",
+           opts->clients, numWorkers, elapsed, matches, wins, replies, replies / elapsed, hungUp);
+    return 0;
+}
+
+void * loadWorkerMain(void * arg) {
+    loadWorker * w = (loadWorker *) arg;
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd == -1) die("epoll_create1");
+    for (int i = 0; i < w->numClients; i++) {
+        struct epoll_event ev = {EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, {.u32 = (uint32_t) i}};
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, w->clients[i].fd, &ev) == -1) die("epoll_ctl");
+    }
+
+    struct epoll_event events[SERVER_EVENTS];
+    int open = w->numClients;
+    while (open > 0 && !stopRequested && nowNs() < w->until) {
+        int n = epoll_wait(epollFd, events, SERVER_EVENTS, 100); // now and then for the clock
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            die("epoll_wait");
+        }
+        for (int k = 0; k < n; k++) {
+            loadClient * c = &w->clients[events[k].data.u32];
+            if (c->closed) continue;
+            if (events[k].events & EPOLLOUT) loadFlush(w, c);
+            if (events[k].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) loadReceive(w, c);
+            if (c->closed) open--;
+        }
+    }
+    for (int i = 0; i < w->numClients; i++) {
+        if (!w->clients[i].closed) close(w->clients[i].fd);
+    }
+    close(epollFd);
+    return NULL;
+}
+
+// Everything the server sent so far, every whole message in it answered straight away
+void loadReceive(loadWorker * w, loadClient * c) {
+    char buf[4096];
+    while (1) {
+        ssize_t n = read(c->fd, buf, sizeof(buf));
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && errno == EAGAIN) break;
+        if (n <= 0) {
+            w->hungUp++;
+            loadClose(c);
+            return;
+        }
+        abAppend(&c->in, buf, (int) n);
+    }
+
+    int at = 0;
+    while (c->in.len - at >= (int) sizeof(botHeader)) {
+        botHeader h;
+        memcpy(&h, c->in.b + at, sizeof(h));
+        int size = botBodySize(&h);
+        if (size < 0) {
+            loadClose(c);
+            return;
+        }
+        if (c->in.len - at < (int) sizeof(h) + size) break;
+        const uint8_t * body = (const uint8_t *) c->in.b + at + sizeof(h);
+        at += (int) sizeof(h) + size;
+
+        if (h.type == BOT_START) {
+            botStart start;
+            memcpy(&start, body, sizeof(start));
+            if (!c->ready) {
+                boardGameInit(&c->game, start.rows, start.cols, 1, 1);
+                c->game.aiBudgetNs = (uint64_t) w->opts->aiBudgetMs * 1000000ULL;
+                c->game.aiThreads = 1; // thousands of us share the cores already
+                c->game.tt = w->tt;
+                c->ready = true;
+            }
+            else if (start.rows != c->game.boardRows || start.cols != c->game.boardCols) c->ready = false;
+            w->matches++;
+        }
+        if (!c->ready || !botFollow(&c->game, &h, body, w->opts->ai)) {
+            loadClose(c);
+            return;
+        }
+        if (h.type == BOT_END) {
+            if (h.seq == (uint32_t) h.you + 1) w->wins++;
+            continue;
+        }
+        botReply reply = botAnswer(&c->game, &h);
+        abAppend(&c->out, (const char *) &reply, sizeof(reply));
+        w->replies++;
+    }
+    memmove(c->in.b, c->in.b + at, c->in.len - at);
+    c->in.len -= at;
+    loadFlush(w, c);
+}
+
+// as much of the replies as the socket takes, EPOLLOUT brings the rest
+void loadFlush(loadWorker * w, loadClient * c) {
+    int sent = 0;
+    while (!c->closed && sent < c->out.len) {
+        ssize_t n = send(c->fd, c->out.b + sent, c->out.len - sent, MSG_NOSIGNAL);
+        if (n > 0) sent += n;
+        else if (n == -1 && errno == EINTR) continue;
+        else if (n == -1 && errno == EAGAIN) break;
+        else {
+            w->hungUp++;
+            loadClose(c);
+        }
+    }
+    if (c->closed) return;
+    memmove(c->out.b, c->out.b + sent, c->out.len - sent);
+    c->out.len -= sent;
+}
+
+void loadClose(loadClient * c) {
+    if (c->closed) return;
+    close(c->fd);
+    c->closed = true;
+}
+
+/*** Headless & benchmark ***/
+bool parseArgs(int argc, char * argv[], options * opts) {
+    opts->tickRate = DEFAULT_TICK_RATE;
+    opts->headless = false;
+    opts->rows = 50;
+    opts->cols = 150;
+    opts->players = 2;
+    opts->arenaRows = 0;
+    opts->arenaCols = 0;
+    opts->inputStats = false;
+    opts->keyBench = false;
+    opts->floodBench = false;
+    opts->makeBench = false;
+    opts->hud = false;
+    opts->traceFile = NULL;
+    opts->spectate = NULL;
+    opts->watch = NULL;
+    opts->botCommand = NULL;
+    opts->botDeadlineMs = 0;
+    opts->botLog = NULL;
+    opts->serveBot = false;
+    opts->server = NULL;
+    opts->load = NULL;
+    opts->clients = 1000;
+    opts->seconds = 0;
+    opts->games = 100;
+    opts->seed = (uint32_t) time(NULL);
+    opts->ai = AI_CHASER;
+    opts->aiBudgetMs = 5;
+    opts->aiThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    opts->ttMb = TT_DEFAULT_MB;
+    opts->tournament = false;
+    opts->selfPlayFile = NULL;
+    opts->p1 = AI_CHASER;
+    opts->p2 = AI_CHASER;
+    opts->threads = opts->aiThreads;
+    opts->json = false;
+    opts->output = NULL;
+    opts->recordFile = NULL;
+    opts->replayFile = NULL;
+    opts->replaySpeed = 1.0;
+    opts->netHost = false;
+    opts->netPort = 0;
+    opts->netJoin = NULL;
+    opts->netDelayMs = 0;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--tick-rate") == 0 && hasValue) opts->tickRate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--headless") == 0) opts->headless = true;
+        else if (strcmp(argv[i], "--rows") == 0 && hasValue) opts->rows = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cols") == 0 && hasValue) opts->cols = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--games") == 0 && hasValue) opts->games = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--players") == 0 && hasValue) opts->players = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--input-stats") == 0) opts->inputStats = true;
+        else if (strcmp(argv[i], "--bench-keys") == 0) opts->keyBench = true;
+        else if (strcmp(argv[i], "--bench-flood") == 0) opts->floodBench = true;
+        else if (strcmp(argv[i], "--bench-make") == 0) opts->makeBench = true;
+        else if (strcmp(argv[i], "--hud") == 0) opts->hud = true;
+        else if (strcmp(argv[i], "--trace") == 0 && hasValue) opts->traceFile = argv[++i];
+        else if (strcmp(argv[i], "--spectate") == 0 && hasValue) opts->spectate = argv[++i];
+        else if (strcmp(argv[i], "--watch") == 0 && hasValue) opts->watch = argv[++i];
+        else if (strcmp(argv[i], "--bot") == 0 && hasValue) opts->botCommand = argv[++i];
+        else if (strcmp(argv[i], "--bot-deadline-ms") == 0 && hasValue) opts->botDeadlineMs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--bot-log") == 0 && hasValue) opts->botLog = argv[++i];
+        else if (strcmp(argv[i], "--serve-bot") == 0) opts->serveBot = true;
+        else if (strcmp(argv[i], "--server") == 0 && hasValue) opts->server = argv[++i];
+        else if (strcmp(argv[i], "--load") == 0 && hasValue) opts->load = argv[++i];
+        else if (strcmp(argv[i], "--clients") == 0 && hasValue) opts->clients = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seconds") == 0 && hasValue) opts->seconds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--arena") == 0 && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &opts->arenaRows, &opts->arenaCols) != 2) opts->arenaRows = -1;
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && hasValue) opts->seed = (uint32_t) strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--ai") == 0 && hasValue) opts->ai = parseEngine(argv[++i]);
+        else if (strcmp(argv[i], "--ai-budget-ms") == 0 && hasValue) opts->aiBudgetMs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ai-threads") == 0 && hasValue) opts->aiThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tt-mb") == 0 && hasValue) opts->ttMb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tournament") == 0) opts->tournament = true;
+        else if (strcmp(argv[i], "--selfplay") == 0 && hasValue) opts->selfPlayFile = argv[++i];
+        else if (strcmp(argv[i], "--p1") == 0 && hasValue) opts->p1 = parseEngine(argv[++i]);
+        else if (strcmp(argv[i], "--p2") == 0 && hasValue) opts->p2 = parseEngine(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && hasValue) opts->threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0) opts->json = true;
+        else if (strcmp(argv[i], "--output") == 0 && hasValue) opts->output = argv[++i];
+        else if (strcmp(argv[i], "--record") == 0 && hasValue) opts->recordFile = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && hasValue) opts->replayFile = argv[++i];
+        else if (strcmp(argv[i], "--speed") == 0 && hasValue) opts->replaySpeed = atof(argv[++i]);
+        else if (strcmp(argv[i], "--host") == 0 && hasValue) {
+            opts->netHost = true;
+            opts->netPort = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--join") == 0 && hasValue) opts->netJoin = argv[++i];
+        else if (strcmp(argv[i], "--net-delay-ms") == 0 && hasValue) opts->netDelayMs = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "usage: %s [--tick-rate HZ] [--players N] [--arena RxC] [--ai chaser|minimax|mcts|bot] [--ai-threads N] [--record FILE] [--input-stats]\n"
+                            "                   [--hud] [--trace FILE] [--tt-mb MB] [--spectate PORT|PATH] [--bot CMD] [--bot-deadline-ms MS] [--bot-log FILE]\n"
+                            "       %s --watch PORT|PATH\n"
+                            "       %s --serve-bot [--ai chaser|minimax|mcts] [--ai-budget-ms MS] [--tt-mb MB]\n"
+                            "       %s --server PORT|PATH [--threads N] [--players N] [--rows R] [--cols C] [--tick-rate HZ] [--seconds S] [--seed S]\n"
+                            "       %s --load PORT|PATH [--clients N] [--threads N] [--ai chaser|minimax|mcts] [--ai-budget-ms MS] [--seconds S]\n"
+                            "       %s --replay FILE [--speed X]\n"
+                            "       %s --host PORT | --join HOST:PORT [--tick-rate HZ] [--net-delay-ms MS]\n"
+                            "       %s --headless [--rows R] [--cols C] [--arena RxC] [--players N] [--games N] [--seed S] [--ai chaser|minimax|mcts|bot]\n"
+                            "                     [--ai-budget-ms MS] [--ai-threads N] [--tt-mb MB] [--record FILE] [--bot CMD] [--bot-deadline-ms MS] [--bot-log FILE]\n"
+                            "       %s --tournament [--games N] [--p1 ENGINE] [--p2 ENGINE] [--threads N] [--rows R] [--cols C]\n"
+                            "                       [--seed S] [--ai-budget-ms MS] [--tt-mb MB] [--json] [--output FILE]\n"
+                            "       %s --selfplay FILE [--games N] [--p1 ENGINE] [--p2 ENGINE] [--threads N] [--rows R] [--cols C]\n"
+                            "                          [--seed S] [--ai-budget-ms MS] [--tt-mb MB]\n"
+                            "       %s --bench-keys [--seed S]\n"
+                            "       %s --bench-flood | --bench-make [--rows R] [--cols C] [--seed S]\n",
+                            argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+            return false;
+        }
+    }
+
+    if (opts->tickRate < 1 || opts->tickRate > MAX_TICK_RATE) {
+        fprintf(stderr, "tick rate must be between 1 and %d\n", MAX_TICK_RATE);
+        return false;
+    }
+    if (opts->rows < 5 || opts->cols < 8 || opts->games < 1) {
+        fprintf(stderr, "board must be at least 5x8 and at least one game has to be played\n");
+        return false;
+    }
+    if (opts->players < 2 || opts->players > MAX_CYCLES) {
+        fprintf(stderr, "--players takes 2 to %d\n", MAX_CYCLES);
+        return false;
+    }
+    if (opts->arenaRows != 0) {
+        if (opts->arenaRows < 5 || opts->arenaCols < 8 || opts->arenaRows > ARENA_MAX_SIDE || opts->arenaCols > ARENA_MAX_SIDE) {
+            fprintf(stderr, "--arena takes ROWSxCOLS, from 5x8 up to %dx%d\n", ARENA_MAX_SIDE, ARENA_MAX_SIDE);
+            return false;
+        }
+        if (opts->tournament || opts->selfPlayFile != NULL || opts->replayFile != NULL || opts->recordFile != NULL || opts->netHost || opts->netJoin != NULL) {
+            fprintf(stderr, "--arena is for local and headless games, without --record\n");
+            return false;
+        }
+    }
+    if (opts->headless) {
+        int rows = opts->arenaRows > 0 ? opts->arenaRows : opts->rows;
+        int cols = opts->arenaCols > 0 ? opts->arenaCols : opts->cols;
+        int top, left, spawnRows, spawnCols;
+        spawnArea(rows, cols, opts->players, opts->arenaRows > 0, &top, &left, &spawnRows, &spawnCols);
+        if (!spawnFits(spawnRows, spawnCols, opts->players)) {
+            fprintf(stderr, "a %dx%d board is too small for %d players\n", rows, cols, opts->players);
+            return false;
+        }
+    }
+    if (opts->ai == AI_NONE || opts->aiBudgetMs < 1) {
+        fprintf(stderr, "--ai takes chaser, minimax, mcts or bot, and the budget has to be at least 1 ms\n");
+        return false;
+    }
+    if (opts->ai == AI_BOT && (opts->botCommand == NULL || opts->serveBot)) {
+        fprintf(stderr, "--ai bot runs what --bot says, and --serve-bot plays one of the built in engines\n");
+        return false;
+    }
+    if ((opts->botCommand != NULL || opts->botLog != NULL) && (opts->tournament || opts->selfPlayFile != NULL || opts->replayFile != NULL ||
+                                                               opts->netHost || opts->netJoin != NULL || opts->serveBot)) {
+        fprintf(stderr, "--bot plays local and headless games\n");
+        return false;
+    }
+    if (opts->botDeadlineMs < 0) opts->botDeadlineMs = 0;
+    if (opts->aiThreads < 1) opts->aiThreads = 1;
+    if (opts->ttMb < 0) opts->ttMb = 0;
+    if (opts->p1 == AI_NONE || opts->p2 == AI_NONE || opts->p1 == AI_BOT || opts->p2 == AI_BOT) {
+        fprintf(stderr, "--p1 and --p2 take chaser, minimax or mcts\n");
+        return false;
+    }
+    if (opts->threads < 1) opts->threads = 1;
+    if (opts->netHost || opts->netJoin != NULL) {
+        if (opts->netHost && opts->netJoin != NULL) {
+            fprintf(stderr, "--host and --join are the two ends, pick one\n");
+            return false;
+        }
+        if (opts->netHost && (opts->netPort < 1 || opts->netPort > 65535)) {
+            fprintf(stderr, "--host takes a UDP port number\n");
+            return false;
+        }
+        if (opts->netJoin != NULL && strrchr(opts->netJoin, ':') == NULL) {
+            fprintf(stderr, "--join takes HOST:PORT\n");
+            return false;
+        }
+        if (opts->players != 2 || opts->recordFile != NULL) { // rollback would rewrite recorded ticks
+            fprintf(stderr, "network games are two players and can't be recorded\n");
+            return false;
+        }
+        if (opts->netDelayMs < 0) opts->netDelayMs = 0;
+    }
+    if (opts->spectate != NULL && (opts->headless || opts->tournament || opts->selfPlayFile != NULL || opts->replayFile != NULL ||
+                                   opts->netHost || opts->netJoin != NULL)) {
+        fprintf(stderr, "--spectate serves local games\n");
+        return false;
+    }
+    if (opts->server != NULL || opts->load != NULL) {
+        if (opts->server != NULL && opts->load != NULL) {
+            fprintf(stderr, "--server and --load are the two ends, pick one\n");
+            return false;
+        }
+        if (opts->ai == AI_BOT || opts->botCommand != NULL || opts->clients < 1 || opts->seconds < 0) {
+            fprintf(stderr, "--load plays a built in engine, with at least one client, and --seconds can't be negative\n");
+            return false;
+        }
+        if (opts->server != NULL && !spawnFits(opts->rows, opts->cols, opts->players)) {
+            fprintf(stderr, "a %dx%d board is too small for %d players\n", opts->rows, opts->cols, opts->players);
+            return false;
+        }
+    }
+    if (opts->replaySpeed <= 0.0) opts->replaySpeed = 1.0;
+    if (opts->seed == 0) opts->seed = 1; // xorshift gets stuck on 0
+    return true;
+}
+
+// AI vs AI with no terminal at all, frames are still built into the frame buffer so the
+// renderer shows up in the numbers. Player 1 is always the chaser, --ai picks everyone else.
+// This is what `make bench` runs.
+int runHeadless(options * opts) {
+    tron tronGame;
+    if (opts->arenaRows > 0) arenaGameInit(&tronGame, opts->arenaRows, opts->arenaCols, opts->rows, opts->cols);
+    else gameInit(&tronGame, opts->rows, opts->cols);
+    tronGame.numCycles = opts->players;
+    tronGame.rngState = opts->seed;
+    tronGame.randomStart = true;
+    tronGame.cycles[0].engine = AI_CHASER;
+    for (int i = 1; i < tronGame.numCycles; i++) tronGame.cycles[i].engine = opts->ai;
+    tronGame.aiBudgetNs = (uint64_t) opts->aiBudgetMs * 1000000ULL;
+    tronGame.aiThreads = opts->aiThreads;
+    tronGame.tt = ttInit(opts->ttMb);
+    if (opts->recordFile != NULL) tronGame.recorder = recorderInit(opts->recordFile, opts->tickRate);
+    if (opts->botCommand != NULL) { // no frames to get out, so a move may wait for its answer
+        uint64_t deadlineNs = opts->botDeadlineMs > 0 ? opts->botDeadlineMs * 1000000ULL : 1000000000ULL / opts->tickRate;
+        tronGame.bots = botHubInit(opts->botCommand, deadlineNs, true, opts->botLog);
+    }
+
+    uint64_t aiNs[2] = {0, 0}, simNs = 0, drawNs = 0, distNs = 0, rebuildNs = 0;
+    long rebuildSamples = 0, sampledFields = 0;
+    long ticks = 0, frameBytes = 0, searches = 0, searchDepth = 0, searchNodes = 0, playouts = 0;
+    long ttProbes = 0, ttHits = 0, ttCutoffs = 0, searchSeparated = 0;
+    // the same positions searched to a fixed depth without a table and with a copy of the game's,
+    // so the samples see what earlier ticks left behind without leaving anything themselves
+    transTable * benchTable = opts->ai == AI_MINIMAX && tronGame.tt != NULL ? ttInit(opts->ttMb) : NULL;
+    uint64_t fixedNs[2] = {0, 0};
+    long fixedNodes[2] = {0, 0}, fixedSamples = 0;
+    long chaserCalls = 0, aiCalls = 0; // one per live cycle per tick between them
+    long wins[MAX_CYCLES] = {0};
+    long draws = 0;
+
+    uint64_t start = nowNs();
+    for (int g = 0; g < opts->games; g++) {
+        gameStart(&tronGame);
+        while (tronGame.curState == IN_GAME) {
+            // computerMakeMove would sync its target's field itself, do it here to time it alone.
+            // Fields of cycles nobody chases any more are left to go stale.
+            distanceFields * df = tronGame.distance;
+            uint64_t tDist = nowNs();
+            for (int i = 0; df != NULL && i < tronGame.numCycles; i++) {
+                if (!tronGame.cycles[i].alive || tronGame.cycles[i].engine != AI_CHASER) continue;
+                int target = nearestOpponent(&tronGame, i);
+                if (target != -1) distanceFieldSync(&tronGame, target);
+            }
+            uint64_t t0 = nowNs();
+            distNs += t0 - tDist;
+            if (df != NULL && ticks % DIST_REBUILD_SAMPLE == 0) { // what the same tick costs from scratch
+                long rebuilt = 0;
+                for (int i = 0; i < tronGame.numCycles; i++) {
+                    if (df->turn[i] != tronGame.numTurn) continue;
+                    distanceFieldBfs(&tronGame, i);
+                    rebuilt++;
+                }
+                if (rebuilt > 0) { // a tick with no fields synced isn't a sample of anything
+                    rebuildNs += nowNs() - t0;
+                    rebuildSamples++;
+                    sampledFields += rebuilt;
+                }
+                t0 = nowNs();
+            }
+            if (benchTable != NULL && ticks % TT_BENCH_SAMPLE == 0 && tronGame.cycles[1].alive) {
+                transTable * shared = tronGame.tt;
+                for (int k = 0; k < 2; k++) {
+                    if (k == 1) memcpy(benchTable->slots, shared->slots, sizeof(ttSlot) * (shared->mask + 1));
+                    tronGame.tt = k == 0 ? NULL : benchTable;
+                    uint64_t tFixed = nowNs();
+                    minimaxSearch(&tronGame, 1, TT_BENCH_DEPTH, UINT64_MAX / 2);
+                    fixedNs[k] += nowNs() - tFixed;
+                    fixedNodes[k] += tronGame.search->nodes;
+                }
+                tronGame.tt = shared;
+                fixedSamples++;
+                t0 = nowNs();
+            }
+            uint64_t tAi = t0;
+            if (tronGame.cycles[0].alive) { // per call, so only ticks that made one count
+                aiMakeMove(&tronGame, 0);
+                chaserCalls++;
+                tAi = nowNs();
+                aiNs[0] += tAi - t0;
+            }
+            for (int i = 1; i < tronGame.numCycles; i++) {
+                if (!tronGame.cycles[i].alive) continue;
+                aiMakeMove(&tronGame, i);
+                aiCalls++;
+                if (opts->ai == AI_MINIMAX) {
+                    searches++;
+                    searchDepth += tronGame.search->depthReached;
+                    searchNodes += tronGame.search->nodes;
+                    searchSeparated += tronGame.search->separated;
+                    ttProbes += tronGame.search->ttProbes;
+                    ttHits += tronGame.search->ttHits;
+                    ttCutoffs += tronGame.search->ttCutoffs;
+                }
+                else if (opts->ai == AI_MCTS) {
+                    playouts += atomic_load(&tronGame.mcts->playouts);
+                }
+            }
+            uint64_t t1 = nowNs();
+            moveCycles(&tronGame);
+            uint64_t t2 = nowNs();
+            buildFrame(&tronGame);
+            uint64_t t3 = nowNs();
+
+            aiNs[1] += t1 - tAi;
+            simNs += t2 - t1;
+            drawNs += t3 - t2;
+            frameBytes += tronGame.frame.len;
+            ticks++;
+        }
+        if (tronGame.winner < 0) draws++;
+        else wins[tronGame.winner]++;
+    }
+    double elapsed = (nowNs() - start) / 1e9;
+    if (tronGame.bots != NULL) botsStop(tronGame.bots);
+
+    // crashChecker is too cheap to time call by call, hammer it over the final board instead
+    enum { PROBES = 1 << 16, PROBE_ROUNDS = 64 };
+    int * probeX = (int *) malloc(sizeof(int) * PROBES);
+    int * probeY = (int *) malloc(sizeof(int) * PROBES);
+    for (int i = 0; i < PROBES; i++) {
+        probeX[i] = tronRand(&tronGame) % tronGame.boardCols;
+        probeY[i] = tronRand(&tronGame) % tronGame.boardRows;
+    }
+    long crashes = 0;
+    uint64_t t0 = nowNs();
+    for (int r = 0; r < PROBE_ROUNDS; r++) {
+        for (int i = 0; i < PROBES; i++) crashes += crashChecker(probeX[i], probeY[i], &tronGame);
+    }
+    double crashNs = (double) (nowNs() - t0) / ((double) PROBES * PROBE_ROUNDS);
+    free(probeX);
+    free(probeY);
+
+    // and the worst case for the renderer, a full repaint of the final board
+    enum { FULL_FRAMES = 20 };
+    t0 = nowNs();
+    for (int i = 0; i < FULL_FRAMES; i++) {
+        tronGame.fullRepaint = true;
+        buildFrame(&tronGame);
+    }
+    double fullFrameNs = (double) (nowNs() - t0) / FULL_FRAMES;
+    int fullFrameBytes = tronGame.frame.len;
+
+    // and a repaint of the board snaked full of trails, the most colour the encoder ever sees
+    double trailedNs = 0;
+    int trailedBytes = 0;
+    if (tronGame.arena == NULL) {
+        for (int y = 1; y < tronGame.boardRows - 1; y++) {
+            for (int x = 1; x < tronGame.boardCols - 1; x++) setCell(&tronGame, x, y, trailCell((y / 2) % tronGame.numCycles));
+        }
+        t0 = nowNs();
+        for (int i = 0; i < FULL_FRAMES; i++) {
+            tronGame.fullRepaint = true;
+            buildFrame(&tronGame);
+        }
+        trailedNs = (double) (nowNs() - t0) / FULL_FRAMES;
+        trailedBytes = tronGame.frame.len;
+    }
+
+    char board[64];
+    if (tronGame.arena != NULL) {
+        snprintf(board, sizeof(board), "%dx%d arena seen through %dx%d", tronGame.boardRows, tronGame.boardCols,
+                 tronGame.viewRows, tronGame.viewCols);
+    }
+    else snprintf(board, sizeof(board), "%dx%d board", tronGame.boardRows, tronGame.boardCols);
+    if (tronGame.numCycles == 2) {
+        printf("headless: %s, %d games, seed %u, chaser vs %s\n", board, opts->games, opts->seed, engineName(opts->ai));
+    }
+    else {
+        printf("headless: %s, %d games, seed %u, chaser vs %d %s bots\n", board, opts->games, opts->seed,
+               tronGame.numCycles - 1, opts->ai == AI_BOT ? "outside" : engineName(opts->ai));
+    }
+    enum { LISTED_PLAYERS = 8 }; // past that the line is just noise
+    printf("results:");
+    for (int i = 0; i < tronGame.numCycles && i < LISTED_PLAYERS; i++) printf(" player %d %ld,", i + 1, wins[i]);
+    if (tronGame.numCycles > LISTED_PLAYERS) {
+        long rest = 0;
+        for (int i = LISTED_PLAYERS; i < tronGame.numCycles; i++) rest += wins[i];
+        printf(" players %d-%d %ld,", LISTED_PLAYERS + 1, tronGame.numCycles, rest);
+    }
+    printf(" draw %ld, avg game length %.1f ticks\n", draws, (double) ticks / opts->games);
+    printf("throughput: %.0f ticks/sec, %.1f games/sec (%.3f s wall)\n",
+           ticks / elapsed, opts->games / elapsed, elapsed);
+    if (tronGame.arena != NULL) { // the last game's board, chunks of the earlier ones are held as spares
+        arenaMap * map = tronGame.arena;
+        long trail = arenaTrailCells(map);
+        printf("arena: %d chunks of %dx%d in use, %d spare, %.2f MB total, %.0f bytes per trail cell\n",
+               map->numChunks, ARENA_CHUNK, ARENA_CHUNK, map->numSpare, arenaBytes(map) / 1e6,
+               (double) arenaBytes(map) / (trail > 0 ? trail : 1));
+    }
+    printf("per call:\n");
+    printf("  computerMakeMove     %10.1f ns\n", (double) aiNs[0] / (chaserCalls > 0 ? chaserCalls : 1));
+    distanceFields * df = tronGame.distance;
+    if (df != NULL) { // never built in an arena
+        long fieldUpdates = df->repairs + df->rebuilds - sampledFields;
+        printf("  distanceFieldSync    %10.1f ns  (%.0f%% of field updates repaired in place, %.1f cells each)\n",
+               (double) distNs / ticks, 100.0 * df->repairs / (fieldUpdates > 0 ? fieldUpdates : 1),
+               (double) df->repaired / (df->repairs > 0 ? df->repairs : 1));
+    }
+    if (rebuildSamples > 0) {
+        printf("  distance rebuild     %10.1f ns  (every live field from scratch, sampled every %d ticks)\n",
+               (double) rebuildNs / rebuildSamples, DIST_REBUILD_SAMPLE);
+    }
+    if (opts->ai == AI_MINIMAX) {
+        printf("  minimaxMakeMove      %10.1f ns  (avg depth %.1f, %.0f leaves/move, %.0f%% walled off, %s flood fill)\n",
+               (double) aiNs[1] / aiCalls, (double) searchDepth / searches, (double) searchNodes / searches,
+               100.0 * searchSeparated / (searchNodes > 0 ? searchNodes : 1), voronoiScorerName(tronGame.search));
+        if (tronGame.tt != NULL) {
+            printf("  transposition table  %.1f%% of %.0f probes/move hit, %.1f%% answered the node (%d MB)\n",
+                   100.0 * ttHits / (ttProbes > 0 ? ttProbes : 1), (double) ttProbes / searches,
+                   100.0 * ttCutoffs / (ttProbes > 0 ? ttProbes : 1), opts->ttMb);
+        }
+        if (fixedSamples > 0) {
+            printf("  depth %d search       %10.1f ns  without a table, %.1f ns with (%.2fx, %.0f vs %.0f leaves, %ld positions)\n",
+                   TT_BENCH_DEPTH, (double) fixedNs[0] / fixedSamples, (double) fixedNs[1] / fixedSamples,
+                   (double) fixedNs[0] / (fixedNs[1] > 0 ? fixedNs[1] : 1), (double) fixedNodes[0] / fixedSamples,
+                   (double) fixedNodes[1] / fixedSamples, fixedSamples);
+        }
+    }
+    else if (opts->ai == AI_MCTS) {
+        double aiSeconds = aiNs[1] / 1e9;
+        printf("  mctsMakeMove         %10.1f ns  (%.0f playouts/move, %.0f playouts/sec/core on %d threads)\n",
+               (double) aiNs[1] / aiCalls, (double) playouts / aiCalls, playouts / aiSeconds / opts->aiThreads, opts->aiThreads);
+    }
+    else if (opts->ai == AI_BOT) {
+        botHub * hub = tronGame.bots;
+        printf("  botMakeMove          %10.1f ns  (round trip avg %.1f us, max %.1f us, p50 %.1f us and p99 %.1f us of the last %d)\n",
+               (double) aiNs[1] / aiCalls, hub->rttTotalNs / 1e3 / (hub->replies > 0 ? hub->replies : 1), hub->rttMaxNs / 1e3,
+               profPercentile(&hub->rtt, 50) / 1e3, profPercentile(&hub->rtt, 99) / 1e3, hub->rtt.count);
+        printf("  bot moves            %ld answered in time, %ld went straight past the %.1f ms deadline, %ld answers came late\n",
+               hub->moves, hub->timeouts, hub->deadlineNs / 1e6, hub->late);
+    }
+    printf("  crashChecker         %10.2f ns  (%ld of %d probes hit)\n", crashNs, crashes / PROBE_ROUNDS, PROBES);
+    printf("  moveCycles           %10.1f ns  (%.1f ns per cycle)\n", (double) simNs / ticks,
+           (double) simNs / (chaserCalls + aiCalls));
+    printf("  drawScreen (tick)    %10.1f ns  %.1f bytes/frame\n", (double) drawNs / ticks, (double) frameBytes / ticks);
+    printf("  drawScreen (full)    %10.1f ns  %d bytes/frame\n", fullFrameNs, fullFrameBytes);
+    if (trailedBytes > 0) {
+        printf("  drawScreen (trailed) %10.1f ns  %d bytes/frame (%.2f per cell)\n", trailedNs, trailedBytes,
+               (double) trailedBytes / (tronGame.boardRows * tronGame.boardCols));
+    }
+    return 0;
+}
+
+// --bench-flood: positions from chaser games, each scored by voronoiScoreBfs and by
+// floodVoronoi with every pass the CPU can run. The counts and the walled off flag have to
+// agree everywhere, then each is timed over the same positions.
+int runFloodBench(options * opts) {
+    enum { FLOOD_POSITIONS = 256, FLOOD_SAMPLE = 8, FLOOD_MIN_NS = 250000000 };
+    tron tronGame;
+    gameInit(&tronGame, opts->rows, opts->cols);
+    tronGame.rngState = opts->seed;
+    tronGame.randomStart = true;
+    searchContext * ctx = searchInit(&tronGame);
+    floodPlanes * fp = ctx->flood;
+    uint64_t * boardOcc = ctx->occ;
+    int numWords = ctx->numWords;
+
+    uint64_t * occ = (uint64_t *) malloc(sizeof(uint64_t) * numWords * FLOOD_POSITIONS);
+    int * heads = (int *) malloc(sizeof(int) * 2 * FLOOD_POSITIONS);
+    if (occ == NULL || heads == NULL) die("malloc");
+    int positions = 0, games = 0;
+    long ticks = 0;
+    while (positions < FLOOD_POSITIONS) {
+        gameStart(&tronGame);
+        games++;
+        while (tronGame.curState == IN_GAME && positions < FLOOD_POSITIONS) {
+            if (ticks++ % FLOOD_SAMPLE == 0) {
+                memcpy(&occ[(size_t) positions * numWords], tronGame.occupied, sizeof(uint64_t) * numWords);
+                heads[2 * positions] = tronGame.cycles[0].posY * ctx->stride + tronGame.cycles[0].posX;
+                heads[2 * positions + 1] = tronGame.cycles[1].posY * ctx->stride + tronGame.cycles[1].posX;
+                positions++;
+            }
+            for (int i = 0; i < tronGame.numCycles; i++) {
+                if (tronGame.cycles[i].alive) aiMakeMove(&tronGame, i);
+            }
+            moveCycles(&tronGame);
+        }
+    }
+
+    // the reference answers
+    int * score = (int *) malloc(sizeof(int) * FLOOD_POSITIONS);
+    bool * separated = (bool *) malloc(sizeof(bool) * FLOOD_POSITIONS);
+    if (score == NULL || separated == NULL) die("malloc");
+    int walledOff = 0;
+    for (int p = 0; p < FLOOD_POSITIONS; p++) {
+        ctx->occ = &occ[(size_t) p * numWords];
+        score[p] = voronoiScoreBfs(ctx, heads[2 * p], heads[2 * p + 1], &separated[p]);
+        walledOff += separated[p];
+    }
+
+    floodPassFn passes[3] = {floodPassScalar};
+    int numPasses = 1;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) passes[numPasses++] = floodPassSse2;
+    if (__builtin_cpu_supports("avx2")) passes[numPasses++] = floodPassAvx2;
+#endif
+    long mismatches = 0;
+    for (int k = 0; k < numPasses; k++) {
+        fp->pass = passes[k];
+        for (int p = 0; p < FLOOD_POSITIONS; p++) {
+            const uint64_t * board = &occ[(size_t) p * numWords];
+            floodResult r;
+            floodVoronoi(fp, board, ctx->stride, heads[2 * p], heads[2 * p + 1], &r);
+            if (r.mine - r.theirs != score[p] || r.separated != separated[p]) mismatches++;
+            // walled off, each side's share is everything it can reach
+            else if (r.separated && (floodArea(fp, board, ctx->stride, heads[2 * p]) != r.mine ||
+                                     floodArea(fp, board, ctx->stride, heads[2 * p + 1]) != r.theirs)) mismatches++;
+        }
+    }
+
+    // timed a round of every position at a time until each has run long enough to trust
+    printf("flood: %d positions from %d chaser games on %dx%d (%d words per row), %.0f%% walled off, seed %u\n",
+           FLOOD_POSITIONS, games, opts->rows, opts->cols, tronGame.wordsPerRow, 100.0 * walledOff / FLOOD_POSITIONS, opts->seed);
+    double bfsNs = 0, bestNs = 0;
+    for (int k = -1; k < numPasses; k++) {
+        if (k >= 0) fp->pass = passes[k];
+        fp->passes = 0;
+        long calls = 0;
+        volatile int sink = 0; // keeps the results wanted
+        uint64_t t0 = nowNs(), elapsed;
+        do {
+            for (int p = 0; p < FLOOD_POSITIONS; p++, calls++) {
+                if (k < 0) {
+                    bool walled;
+                    ctx->occ = &occ[(size_t) p * numWords];
+                    sink += voronoiScoreBfs(ctx, heads[2 * p], heads[2 * p + 1], &walled);
+                }
+                else {
+                    floodResult r;
+                    floodVoronoi(fp, &occ[(size_t) p * numWords], ctx->stride, heads[2 * p], heads[2 * p + 1], &r);
+                    sink += r.mine - r.theirs;
+                }
+            }
+            elapsed = nowNs() - t0;
+        } while (elapsed < FLOOD_MIN_NS);
+        double ns = (double) elapsed / calls;
+        if (k < 0) {
+            bfsNs = ns;
+            printf("  voronoiScoreBfs      %10.1f ns per call\n", ns);
+        }
+        else {
+            printf("  floodVoronoi %-7s %10.1f ns per call  %.2fx  %.1f passes per call\n",
+                   floodPassName(passes[k]), ns, bfsNs / ns, (double) fp->passes / calls);
+            if (passes[k] == floodPassBest()) bestNs = ns;
+        }
+    }
+    // what voronoiScore's trial leaves would settle on, going by these
+    printf("  %ld mismatches, the search uses %s\n", mismatches, bestNs < bfsNs ? floodPassName(floodPassBest()) : "bfs");
+
+    ctx->occ = boardOcc;
+    free(occ);
+    free(heads);
+    free(score);
+    free(separated);
+    return mismatches == 0 ? 0 : 1;
+}
+
+// what copy-make keeps per ply instead of an undo entry, board and all
+typedef struct makeBenchCopy {
+    uint8_t * cells;
+    uint64_t * occupied;
+    lightCycle cycles[2];
+    uint64_t hash;
+    gameState curState;
+    int winner;
+    int numTurn;
+    int numDirty;
+    bool fullRepaint;
+} makeBenchCopy;
+
+static void makeBenchSave(tron * this, makeBenchCopy * copy) {
+    memcpy(copy->cells, this->cells, (size_t) this->boardRows * this->boardCols);
+    memcpy(copy->occupied, this->occupied, sizeof(uint64_t) * this->wordsPerRow * this->boardRows);
+    memcpy(copy->cycles, this->cycles, sizeof(copy->cycles));
+    copy->hash = this->hash;
+    copy->curState = this->curState;
+    copy->winner = this->winner;
+    copy->numTurn = this->numTurn;
+    copy->numDirty = this->numDirty;
+    copy->fullRepaint = this->fullRepaint;
+}
+
+static void makeBenchRestore(tron * this, makeBenchCopy * copy) {
+    memcpy(this->cells, copy->cells, (size_t) this->boardRows * this->boardCols);
+    memcpy(this->occupied, copy->occupied, sizeof(uint64_t) * this->wordsPerRow * this->boardRows);
+    memcpy(this->cycles, copy->cycles, sizeof(copy->cycles));
+    this->hash = copy->hash;
+    this->curState = copy->curState;
+    this->winner = copy->winner;
+    this->numTurn = copy->numTurn;
+    this->numDirty = copy->numDirty;
+    this->fullRepaint = copy->fullRepaint;
+}
+
+static bool makeBenchSame(tron * this, makeBenchCopy * copy) {
+    return memcmp(this->cells, copy->cells, (size_t) this->boardRows * this->boardCols) == 0 &&
+           memcmp(this->occupied, copy->occupied, sizeof(uint64_t) * this->wordsPerRow * this->boardRows) == 0 &&
+           memcmp(this->cycles, copy->cycles, sizeof(copy->cycles)) == 0 && this->hash == copy->hash &&
+           this->curState == copy->curState && this->winner == copy->winner && this->numTurn == copy->numTurn &&
+           this->numDirty == copy->numDirty && this->fullRepaint == copy->fullRepaint;
+}
+
+// Every pair of moves the two cycles can make, u-turns aside, depth ticks deep. copies is NULL
+// for make/unmake, else one per ply and each child starts from a copy of its parent.
+// Returns the positions at the bottom, games that ended on the way count as one.
+static long makeBenchWalk(tron * this, int depth, makeBenchCopy * copies, long * ticks) {
+    if (depth == 0 || this->curState != IN_GAME) return 1;
+    lightCycle * a = &this->cycles[0];
+    lightCycle * b = &this->cycles[1];
+    int dirX[2] = {a->dirX, b->dirX}, dirY[2] = {a->dirY, b->dirY};
+    if (copies != NULL) makeBenchSave(this, &copies[depth]);
+    long leaves = 0;
+    for (int m = 0; m < 4; m++) {
+        if (searchDirX[m] == -a->lastDirX && searchDirY[m] == -a->lastDirY) continue;
+        for (int o = 0; o < 4; o++) {
+            if (searchDirX[o] == -b->lastDirX && searchDirY[o] == -b->lastDirY) continue;
+            a->dirX = searchDirX[m];
+            a->dirY = searchDirY[m];
+            b->dirX = searchDirX[o];
+            b->dirY = searchDirY[o];
+            (*ticks)++;
+            if (copies == NULL) {
+                if (!makeTick(this)) die("makeTick");
+                leaves += makeBenchWalk(this, depth - 1, NULL, ticks);
+                unmakeTick(this);
+            }
+            else {
+                stepCycles(this);
+                leaves += makeBenchWalk(this, depth - 1, copies, ticks);
+                makeBenchRestore(this, &copies[depth]);
+            }
+        }
+    }
+    a->dirX = dirX[0];
+    a->dirY = dirY[0];
+    b->dirX = dirX[1];
+    b->dirY = dirY[1];
+    return leaves;
+}
+
+// --bench-make: the same walk from positions of chaser games with makeTick/unmakeTick and by
+// copy-make, which restores the whole board from a copy for every child. The leaf counts have
+// to agree, and after each walk the game has to be back bit for bit.
+int runMakeBench(options * opts) {
+    tron tronGame;
+    gameInit(&tronGame, opts->rows, opts->cols);
+    tronGame.rngState = opts->seed;
+    tronGame.randomStart = true;
 
-    for (int i = 0; i < this->boardRows; i++) {
-        memset(this->gameBoard[i], ' ', this->boardCols);
+    makeBenchCopy before;
+    makeBenchCopy copies[MAKE_BENCH_DEPTH + 1];
+    for (int d = -1; d <= MAKE_BENCH_DEPTH; d++) {
+        makeBenchCopy * copy = d < 0 ? &before : &copies[d];
+        copy->cells = (uint8_t *) malloc((size_t) opts->rows * opts->cols);
+        copy->occupied = (uint64_t *) malloc(sizeof(uint64_t) * tronGame.wordsPerRow * opts->rows);
+        if (copy->cells == NULL || copy->occupied == NULL) die("malloc");
     }
-    makeBorder(this);
-    this->gameBoard[this->player1.posY][this->player1.posX] = '1';
-    this->gameBoard[this->player2.posY][this->player2.posX] = '2';
-}
 
-void makeBorder(tron * this) {
-    // border
-    for (int i = 0; i < this->boardCols; i++) {
-        this->gameBoard[0][i] = '*';
-        this->gameBoard[this->boardRows - 1][i] = '*';
+    long leaves[2] = {0, 0}, ticks[2] = {0, 0}, mismatches = 0;
+    uint64_t ns[2] = {0, 0};
+    int positions = 0, games = 0;
+    while (positions < MAKE_BENCH_POSITIONS) {
+        gameStart(&tronGame);
+        games++;
+        for (long t = 0; tronGame.curState == IN_GAME && positions < MAKE_BENCH_POSITIONS; t++) {
+            if (t % 32 == 16) {
+                makeBenchSave(&tronGame, &before);
+                long found[2];
+                for (int k = 0; k < 2; k++) {
+                    uint64_t t0 = nowNs();
+                    found[k] = makeBenchWalk(&tronGame, MAKE_BENCH_DEPTH, k == 0 ? NULL : copies, &ticks[k]);
+                    ns[k] += nowNs() - t0;
+                    leaves[k] += found[k];
+                    if (!makeBenchSame(&tronGame, &before) || tronGame.undo->top != 0) {
+                        mismatches++;
+                        makeBenchRestore(&tronGame, &before);
+                    }
+                }
+                if (found[0] != found[1]) mismatches++;
+                positions++;
+            }
+            computerMoves(&tronGame);
+            moveCycles(&tronGame);
+        }
     }
-    for (int i = 0; i < this->boardRows; i++) {
-        this->gameBoard[i][0] = '*';
-        this->gameBoard[i][this->boardCols - 1] = '*';
+
+    printf("make: %d positions from %d chaser games on %dx%d, every joint move %d ticks deep, seed %u\n",
+           positions, games, opts->rows, opts->cols, MAKE_BENCH_DEPTH, opts->seed);
+    printf("  makeTick/unmakeTick  %8.1f ns per tick  %.1fM ticks/sec  (%ld leaves, %zu bytes of undo per tick)\n",
+           (double) ns[0] / ticks[0], ticks[0] / (ns[0] / 1e3), leaves[0], sizeof(undoEntry) + 2 * sizeof(undoCycle));
+    printf("  copy-make            %8.1f ns per tick  %.1fM ticks/sec  (%ld leaves, %d bytes copied per tick)  %.2fx\n",
+           (double) ns[1] / ticks[1], ticks[1] / (ns[1] / 1e3), leaves[1],
+           opts->rows * opts->cols + (int) sizeof(uint64_t) * tronGame.wordsPerRow * opts->rows, (double) ns[1] / ns[0] * ticks[0] / ticks[1]);
+    printf("  %ld mismatches\n", mismatches);
+    for (int d = -1; d <= MAKE_BENCH_DEPTH; d++) {
+        makeBenchCopy * copy = d < 0 ? &before : &copies[d];
+        free(copy->cells);
+        free(copy->occupied);
     }
+    return mismatches == 0 ? 0 : 1;
 }
 
-bool updateCyclePos(tron * this, int playerNum) {
-    lightCycle * cycle = playerNum == 1 ? &this->player1 : &this->player2;
-    
-    int nextPosX = cycle->posX + cycle->dirX;
-    int nextPosY = cycle->posY + cycle->dirY;
-    // check for border wall
-    if (nextPosX >= 1 && nextPosX <= this->boardCols - 2
-        && nextPosY >= 1 && nextPosY <= this->boardRows - 2) {
-        // moving
-        char nextPosChar = this->gameBoard[nextPosY][nextPosX];
-        if (nextPosChar != '*' && nextPosChar != 'B' && nextPosChar != 'Y') { // allow 2 cycle to go into same pos here. Will check for draw later
-            this->gameBoard[cycle->posY][cycle->posX] = playerNum == 1 ? 'B' : 'Y';
-            cycle->posX += cycle->dirX;
-            cycle->posY += cycle->dirY;
-            this->gameBoard[cycle->posY][cycle->posX] = playerNum == 1 ? '1' : '2';
-            return true;
-        }
-    }
-     
-    // Only get here if a cycle hit wall and die
-    cycle->alive = false;
-    return false;
-}
+/*** Tournament ***/
+// Thousands of independent matches spread over all cores. Every worker owns its own tron (and
+// with it its own search scratch), the only things shared are the counter handing out match
+// numbers and the lock free transposition table. Seats alternate so neither engine always
+// plays player 1.
+void * tournamentWorkerMain(void * arg) {
+    tournamentWorker * w = (tournamentWorker *) arg;
+    options * opts = w->opts;
 
-void deathHandler(tron* this) {
-    lightCycle * one = &this->player1;
-    lightCycle * two = &this->player2;
+    tron tronGame;
+    gameInit(&tronGame, opts->rows, opts->cols);
+    tronGame.randomStart = true;
+    tronGame.aiBudgetNs = (uint64_t) opts->aiBudgetMs * 1000000ULL;
+    tronGame.aiThreads = 1; // the cores are already busy with other matches
+    tronGame.tt = w->tt;
 
-    if (one->alive && two->alive) return;
+    while (1) {
+        int match = atomic_fetch_add(w->nextMatch, 1);
+        if (match >= opts->games) break;
 
-    one->dirX = 0;
-    one->dirY = 0;
-    two->dirX = 0;
-    two->dirY = 0;
+        bool swapped = match & 1;
+        tronGame.rngState = matchSeed(opts->seed, match);
+        tronGame.cycles[0].engine = swapped ? opts->p2 : opts->p1;
+        tronGame.cycles[1].engine = swapped ? opts->p1 : opts->p2;
+        gameStart(&tronGame);
+        while (tronGame.curState == IN_GAME) {
+            computerMoves(&tronGame);
+            moveCycles(&tronGame);
+        }
 
-    if (!one->alive && !two->alive) {
-        this->curState = DRAW;
-        return;
-    }
-    if (one->alive && !two->alive) {
-        this->curState = PLAYER1_WIN;
-        return;
-    }
-    if (!one->alive && two->alive) {
-        this->curState = PLAYER2_WIN;
-        return;
+        if (tronGame.winner == (swapped ? 1 : 0)) w->winsA++;
+        else if (tronGame.winner == (swapped ? 0 : 1)) w->winsB++;
+        else w->draws++;
+        w->turns += tronGame.numTurn;
+        w->turnsSquared += (double) tronGame.numTurn * tronGame.numTurn;
     }
+    return NULL;
 }
 
-void computerMakeMove(tron * this) {
-    // find destination
-    int destX = this->player1.posX + 4 * this->player1.dirX;
-    if (destX < 1) destX = 1;
-    if (destX > this->boardCols - 2) destX = this->boardCols - 2;
-    
-    int destY = this->player1.posY + 2 * this->player1.dirY;
-    if (destY < 1) destY = 1;
-    if (destY > this->boardRows - 2) destY = this->boardRows - 2;
-
-    lightCycle * computer = &this->player2;
-    // try all direction. First check if no death, then minimize distance to destination
-    // default is not turning
-    int nextX = computer->posX + computer->dirX;
-    int nextY = computer->posY + computer->dirY;
-    int bestDistance = abs(destX - nextX) + abs(destY - nextY);
-    int potentialDistance;
-    bool gonnaCrash = crashChecker(nextX, nextY, this);
-    bool potentialCrash;
-
-    int ogdirX = computer->dirX;
-    int ogdirY = computer->dirY;
+// splitmix64 of the match number, neighbouring matches get unrelated start positions
+uint32_t matchSeed(uint32_t seed, int match) {
+    uint64_t z = ((uint64_t) seed << 32) + (uint64_t) match + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (uint32_t) z ? (uint32_t) z : 1;
+}
 
-    // test up
-    if (ogdirY == 0) {
-        nextX = computer->posX;
-        nextY = computer->posY - 1;
-        potentialDistance = abs(destX - nextX) + abs(destY - nextY);
-        potentialCrash = crashChecker(nextX, nextY, this);
+// 95% Wilson score interval, behaves at 0% and 100% unlike the normal approximation
+void wilsonInterval(long hits, long n, double * lo, double * hi) {
+    const double z = 1.96;
+    double p = (double) hits / n;
+    double denom = 1.0 + z * z / n;
+    double centre = (p + z * z / (2.0 * n)) / denom;
+    double spread = z * sqrt(p * (1.0 - p) / n + z * z / (4.0 * n * n)) / denom;
+    *lo = centre - spread > 0.0 ? centre - spread : 0.0;
+    *hi = centre + spread < 1.0 ? centre + spread : 1.0;
+}
 
-        bool turnUp = false;
-        if (gonnaCrash && !potentialCrash) {
-            turnUp = true;
-        }
-        else if (!potentialCrash && potentialDistance < bestDistance) {
-            turnUp = true;
-        }
+int runTournament(options * opts) {
+    atomic_int nextMatch = 0;
+    tournamentWorker * workers = (tournamentWorker *) calloc(opts->threads, sizeof(tournamentWorker));
+    if (workers == NULL) die("malloc");
+    transTable * tt = ttInit(opts->ttMb);
 
-        if (turnUp) {
-            gonnaCrash = potentialCrash;
-            bestDistance = potentialDistance;
-            computer->dirX = 0;
-            computer->dirY = -1;
-        }
+    uint64_t start = nowNs();
+    for (int i = 0; i < opts->threads; i++) {
+        workers[i].opts = opts;
+        workers[i].nextMatch = &nextMatch;
+        workers[i].tt = tt;
+        if (pthread_create(&workers[i].thread, NULL, tournamentWorkerMain, &workers[i]) != 0) die("pthread_create");
     }
-    // test down
-    if (ogdirY == 0) {
-        nextX = computer->posX;
-        nextY = computer->posY + 1;
-        potentialDistance = abs(destX - nextX) + abs(destY - nextY);
-        potentialCrash = crashChecker(nextX, nextY, this);
-
-        bool turnDown = false;
-        if (gonnaCrash && !potentialCrash) {
-            turnDown = true;
-        }
-        else if (!potentialCrash && potentialDistance < bestDistance) {
-            turnDown = true;
-        }
 
-        if (turnDown) {
-            gonnaCrash = potentialCrash;
-            bestDistance = potentialDistance;
-            computer->dirX = 0;
-            computer->dirY = 1;
-        }
+    long winsA = 0, winsB = 0, draws = 0;
+    double turns = 0, turnsSquared = 0;
+    for (int i = 0; i < opts->threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        winsA += workers[i].winsA;
+        winsB += workers[i].winsB;
+        draws += workers[i].draws;
+        turns += workers[i].turns;
+        turnsSquared += workers[i].turnsSquared;
+    }
+    double elapsed = (nowNs() - start) / 1e9;
+    free(workers);
+    if (tt != NULL) {
+        free(tt->slots);
+        free(tt);
     }
-    // test left
-    if (ogdirX == 0) {
-        nextX = computer->posX - 1;
-        nextY = computer->posY;
-        potentialDistance = abs(destX - nextX) + abs(destY - nextY);
-        potentialCrash = crashChecker(nextX, nextY, this);
 
-        bool turnLeft = false;
-        if (gonnaCrash && !potentialCrash) {
-            turnLeft = true;
-        }
-        else if (!potentialCrash && potentialDistance < bestDistance) {
-            turnLeft = true;
-        }
+    long n = opts->games;
+    double winLo, winHi, lossLo, lossHi, drawLo, drawHi;
+    wilsonInterval(winsA, n, &winLo, &winHi);
+    wilsonInterval(winsB, n, &lossLo, &lossHi);
+    wilsonInterval(draws, n, &drawLo, &drawHi);
+    double avgTurns = turns / n;
+    double variance = n > 1 ? (turnsSquared - turns * turns / n) / (n - 1) : 0.0;
+    double turnsSpread = 1.96 * sqrt(variance > 0.0 ? variance : 0.0) / sqrt((double) n);
 
-        if (turnLeft) {
-            gonnaCrash = potentialCrash;
-            bestDistance = potentialDistance;
-            computer->dirX = -1;
-            computer->dirY = 0;
-        }
+    FILE * out = stdout;
+    if (opts->output != NULL) {
+        out = fopen(opts->output, "w");
+        if (out == NULL) die("fopen");
     }
-    // test right
-    if (ogdirX == 0) {
-        nextX = computer->posX + 1;
-        nextY = computer->posY;
-        potentialDistance = abs(destX - nextX) + abs(destY - nextY);
-        potentialCrash = crashChecker(nextX, nextY, this);
 
-        bool turnRight = false;
-        if (gonnaCrash && !potentialCrash) {
-            turnRight = true;
-        }
-        else if (!potentialCrash && potentialDistance < bestDistance) {
-            turnRight = true;
-        }
-        
-        if (turnRight) {
-            gonnaCrash = potentialCrash;
-            bestDistance = potentialDistance;
-            computer->dirX = 1;
-            computer->dirY = 0;
-        }
+    const char * a = engineName(opts->p1);
+    const char * b = engineName(opts->p2);
+    if (opts->json) {
+        fprintf(out, "{\n");
+        fprintf(out, "  \"engine_a\": \"%s\", \"engine_b\": \"%s\",\n", a, b);
+        fprintf(out, "  \"rows\": %d, \"cols\": %d, \"seed\": %u, \"matches\": %ld, \"threads\": %d, \"seconds\": %.3f,\n",
+                opts->rows, opts->cols, opts->seed, n, opts->threads, elapsed);
+        fprintf(out, "  \"wins_a\": %ld, \"wins_b\": %ld, \"draws\": %ld,\n", winsA, winsB, draws);
+        fprintf(out, "  \"win_rate_a\": {\"value\": %.4f, \"ci95\": [%.4f, %.4f]},\n", (double) winsA / n, winLo, winHi);
+        fprintf(out, "  \"win_rate_b\": {\"value\": %.4f, \"ci95\": [%.4f, %.4f]},\n", (double) winsB / n, lossLo, lossHi);
+        fprintf(out, "  \"draw_rate\": {\"value\": %.4f, \"ci95\": [%.4f, %.4f]},\n", (double) draws / n, drawLo, drawHi);
+        fprintf(out, "  \"avg_turns\": {\"value\": %.2f, \"ci95\": [%.2f, %.2f]}\n", avgTurns, avgTurns - turnsSpread, avgTurns + turnsSpread);
+        fprintf(out, "}\n");
     }
-    
-    return;
+    else {
+        fprintf(out, "engine_a,engine_b,rows,cols,seed,matches,threads,seconds,wins_a,wins_b,draws,"
+                     "win_rate_a,win_rate_a_lo,win_rate_a_hi,win_rate_b,win_rate_b_lo,win_rate_b_hi,"
+                     "draw_rate,draw_rate_lo,draw_rate_hi,avg_turns,avg_turns_lo,avg_turns_hi\n");
+        fprintf(out, "%s,%s,%d,%d,%u,%ld,%d,%.3f,%ld,%ld,%ld,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.2f,%.2f,%.2f\n",
+                a, b, opts->rows, opts->cols, opts->seed, n, opts->threads, elapsed, winsA, winsB, draws,
+                (double) winsA / n, winLo, winHi, (double) winsB / n, lossLo, lossHi, (double) draws / n, drawLo, drawHi,
+                avgTurns, avgTurns - turnsSpread, avgTurns + turnsSpread);
+    }
+
+    if (out != stdout) fclose(out);
+    return 0;
 }
 
-bool crashChecker(int nextX, int nextY, tron * this) {
-    if (nextX >= 1 && nextX <= this->boardCols - 2
-        && nextX >= 1 && nextY <= this->boardRows - 2) { // make sure we don't get a seg fault
-        char nextChar = this->gameBoard[nextY][nextX];
-        if (nextChar == 'B' || nextChar == 'Y' || nextChar == '*' || nextChar == '1' || nextChar == '2') {
-            return true;
-        }
-        else {
-            return false;
+/*** Self-play ***/
+// Same match loop as the tournament. The game records itself through a recorder like --record does,
+// and the finished recording goes into the worker's chunk, which goes to disk when the game doesn't
+// fit. So memory stays at a chunk per worker however many games are played.
+void * selfPlayWorkerMain(void * arg) {
+    selfPlayWorker * w = (selfPlayWorker *) arg;
+    options * opts = w->opts;
+
+    tron tronGame;
+    gameInit(&tronGame, opts->rows, opts->cols);
+    tronGame.randomStart = true;
+    tronGame.aiBudgetNs = (uint64_t) opts->aiBudgetMs * 1000000ULL;
+    tronGame.aiThreads = 1;
+    tronGame.tt = w->tt;
+    tronGame.recorder = recorderInit(NULL, 0);
+    recorder * rec = tronGame.recorder;
+
+    abInit(&w->chunk, SELFPLAY_CHUNK_BYTES);
+    // a chunk past SELFPLAY_CHUNK_BYTES holds one game, so it never holds more records than this
+    w->chunkGames = (int *) malloc(sizeof(int) * (SELFPLAY_CHUNK_BYTES / sizeof(selfPlayGame)));
+    if (w->chunkGames == NULL) die("malloc");
+    w->numChunkGames = 0;
+
+    while (1) {
+        int match = atomic_fetch_add(w->nextMatch, 1);
+        if (match >= opts->games) break;
+
+        bool swapped = match & 1;
+        tronGame.rngState = matchSeed(opts->seed, match);
+        tronGame.cycles[0].engine = swapped ? opts->p2 : opts->p1;
+        tronGame.cycles[1].engine = swapped ? opts->p1 : opts->p2;
+        gameStart(&tronGame); // recorderBegin, moveCycles records every tick from here
+        while (tronGame.curState == IN_GAME) {
+            computerMoves(&tronGame);
+            moveCycles(&tronGame);
         }
+
+        selfPlayGame game;
+        memset(&game, 0, sizeof(game));
+        size_t movesEnd = sizeof(selfPlayGame) + rec->moves.len;
+        size_t tableEnd = movesEnd + rec->keyframes.len + rec->keyframeTable.len;
+        size_t recordBytes = (tableEnd + 7) & ~(size_t) 7;
+        if (recordBytes > INT32_MAX) die("selfplay record"); // abuf lengths are ints
+        game.ticks = (uint32_t) rec->numTicks;
+        game.match = (uint32_t) match;
+        game.numKeyframes = (uint32_t) rec->numKeyframes;
+        game.keyframesOffset = (uint32_t) movesEnd;
+        game.tableOffset = (uint32_t) (movesEnd + rec->keyframes.len);
+        game.recordBytes = (uint32_t) recordBytes;
+        game.winner = (int8_t) tronGame.winner;
+        game.engine[0] = (uint8_t) tronGame.cycles[0].engine;
+        game.engine[1] = (uint8_t) tronGame.cycles[1].engine;
+
+        if (w->numChunkGames > 0 && w->chunk.len + recordBytes > SELFPLAY_CHUNK_BYTES) selfPlayFlush(w);
+        w->chunkGames[w->numChunkGames++] = w->chunk.len;
+        static const char zeros[8] = {0};
+        abAppend(&w->chunk, (const char *) &game, sizeof(game));
+        abAppend(&w->chunk, rec->moves.b, rec->moves.len);
+        abAppend(&w->chunk, rec->keyframes.b, rec->keyframes.len);
+        abAppend(&w->chunk, rec->keyframeTable.b, rec->keyframeTable.len);
+        abAppend(&w->chunk, zeros, (int) (recordBytes - tableEnd));
+        if ((size_t) w->chunk.len != w->chunkGames[w->numChunkGames - 1] + recordBytes) die("realloc"); // abAppend gave up
+        if ((size_t) w->chunk.cap > w->chunkPeak) w->chunkPeak = w->chunk.cap;
+        w->samples += game.ticks;
     }
-    else {
-        return true;
-    }
+    if (w->numChunkGames > 0) selfPlayFlush(w);
+    abFree(&rec->moves);
+    abFree(&rec->keyframes);
+    abFree(&rec->keyframeTable);
+    free(rec);
+    abFree(&w->chunk);
+    free(w->chunkGames);
+    return NULL;
 }
 
-/*** Input & Output ***/
-// input
-void processKeypress(tron * tronGame) {
-    int c = readKey();
+// claims file space and sample numbers for the whole chunk, other workers can be writing theirs
+void selfPlayFlush(selfPlayWorker * w) {
+    selfPlayWriter * out = w->out;
+    long offset = atomic_fetch_add(&out->nextOffset, (long) w->chunk.len);
+    long sample = 0;
+    for (int i = 0; i < w->numChunkGames; i++) sample += ((selfPlayGame *) (w->chunk.b + w->chunkGames[i]))->ticks;
+    sample = atomic_fetch_add(&out->nextSample, sample);
 
-    if (tronGame->curState == IN_GAME && tronGame->singlePlayer) {
-        computerMakeMove(tronGame);
-        tronGame->numTurn++;
+    for (int i = 0; i < w->numChunkGames; i++) {
+        selfPlayGame * game = (selfPlayGame *) (w->chunk.b + w->chunkGames[i]);
+        game->firstSample = (uint64_t) sample;
+        sample += game->ticks;
+        out->index[game->match] = (uint64_t) (offset + w->chunkGames[i]);
     }
+    pwriteAll(out->fd, w->chunk.b, w->chunk.len, (off_t) offset);
+    w->chunk.len = 0;
+    w->numChunkGames = 0;
+}
 
-    switch (c) {
-        case CTRL_KEY('q'):
-            write(STDOUT_FILENO, "\x1b[2J", 4); 
-            write(STDOUT_FILENO, "\x1b[H", 3);
-            exit(0);
-            break;
-        case '1':
-        case '2':
-            if (tronGame->curState != IN_GAME) {
-                tronGame->singlePlayer = c == '1' ? true : false;
-                gameStart(tronGame);
-            }
-            break;
-        case ' ':
-            if (tronGame->curState != IN_GAME) {
-                gameStart(tronGame);
-            }
-            break;
-        case 'w':
-        case 'W':
-            if (tronGame->curState == IN_GAME && tronGame->player1.dirY == 0) {
-                tronGame->player1.dirY = -1;
-                tronGame->player1.dirX = 0;
-            }
-            break;
-        case 'a':
-        case 'A':
-            if (tronGame->curState == IN_GAME && tronGame->player1.dirX == 0) {
-                tronGame->player1.dirX = -1;
-                tronGame->player1.dirY = 0;
-            }
-            break;
-        case 's':
-        case 'S':
-            if (tronGame->curState == IN_GAME && tronGame->player1.dirY == 0) {
-                tronGame->player1.dirY = 1;
-                tronGame->player1.dirX = 0;
-            }
-            break;
-        case 'd':
-        case 'D':
-            if (tronGame->curState == IN_GAME && tronGame->player1.dirX == 0) {
-                tronGame->player1.dirX = 1;
-                tronGame->player1.dirY = 0;
-            }
-            break;
-        case ARROW_UP:
-            if (tronGame->curState == IN_GAME && !tronGame->singlePlayer && tronGame->player2.dirY == 0) {
-                tronGame->player2.dirY = -1;
-                tronGame->player2.dirX = 0;
-            }
-            break;
-        case ARROW_LEFT:
-            if (tronGame->curState == IN_GAME && !tronGame->singlePlayer && tronGame->player2.dirX == 0) {
-                tronGame->player2.dirX = -1;
-                tronGame->player2.dirY = 0;
-            }
-            break;
-        case ARROW_DOWN:
-            if (tronGame->curState == IN_GAME && !tronGame->singlePlayer && tronGame->player2.dirY == 0) {
-                tronGame->player2.dirY = 1;
-                tronGame->player2.dirX = 0;
-            }
-            break;
-        case ARROW_RIGHT:
-            if (tronGame->curState == IN_GAME && !tronGame->singlePlayer && tronGame->player2.dirX == 0) {
-                tronGame->player2.dirX = 1;
-                tronGame->player2.dirY = 0;
-            }
-            break;
-        case '\0':
-            break;
+// A game of a mapped self-play file seen as a replay, nothing copied: restore keyframe 0 on a tron
+// gameInit'ed to the file's size with numCycles 2, then replaySeek(rp, this, i) is sample i's board
+// and cycles. Checked like replayLoad, so a bad file is refused rather than read past.
+bool selfPlayGameReplay(const uint8_t * data, size_t size, uint64_t match, replay * rp) {
+    selfPlayHeader header;
+    if (size < sizeof(header)) return false;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SELFPLAY_MAGIC, 4) != 0 || header.version != SELFPLAY_VERSION || match >= header.numGames
+        || header.indexOffset > size || (size - header.indexOffset) / sizeof(uint64_t) < header.numGames) {
+        return false;
     }
-
-    updateCyclePos(tronGame, 1);
-    updateCyclePos(tronGame, 2);
-    
-    // check if player2's movement kill player 1/both
-    int player1PosX = tronGame->player1.posX;
-    int player1PosY = tronGame->player1.posY;
-    if (player1PosX >= 1 && player1PosX <= tronGame->boardCols - 2
-        && player1PosY >= 1 && player1PosY <= tronGame->boardRows - 2) { // make sure we don't get a seg fault
-        char player1Char = tronGame->gameBoard[player1PosY][player1PosX];
-        if (player1Char == '2') { // simultaenously ran into same pos
-            tronGame->player1.alive = false;
-            tronGame->player2.alive = false;
-        }
-        else if (player1Char == 'Y') {
-            tronGame->player1.alive = false;
-        }
+    uint64_t offset;
+    memcpy(&offset, data + header.indexOffset + match * sizeof(uint64_t), sizeof(offset));
+    selfPlayGame game;
+    if (offset % 8 != 0 || offset > header.indexOffset || header.indexOffset - offset < sizeof(game)) return false;
+    memcpy(&game, data + offset, sizeof(game));
+    if (game.recordBytes > header.indexOffset - offset || game.keyframesOffset < sizeof(game)
+        || game.keyframesOffset > game.tableOffset || game.tableOffset > game.recordBytes || game.numKeyframes == 0
+        || ((uint64_t) game.ticks * 2 * 2 + 7) / 8 > game.keyframesOffset - sizeof(game)
+        || (uint64_t) game.numKeyframes * 12 > game.recordBytes - game.tableOffset) {
+        return false;
     }
 
-    deathHandler(tronGame);
+    const uint8_t * record = data + offset;
+    rp->data = NULL; // the mapping stays the caller's
+    rp->size = game.recordBytes;
+    rp->rows = (int) header.rows;
+    rp->cols = (int) header.cols;
+    rp->tickRate = 0;
+    rp->numCycles = 2;
+    rp->winner = game.winner;
+    rp->numTicks = game.ticks;
+    rp->keyframeInterval = REPLAY_KEYFRAME_INTERVAL;
+    rp->numKeyframes = game.numKeyframes;
+    rp->moves = record + sizeof(game);
+    rp->keyframes = record + game.keyframesOffset;
+    rp->keyframesLen = game.tableOffset - game.keyframesOffset;
+    rp->table = record + game.tableOffset;
+    return true;
 }
 
-// output
-void abAppend(struct abuf * ab, const char * s, int len) {
-    char * new = (char *) realloc(ab->b, ab->len + len);
-    if (new == NULL) return;
-
-    memcpy(&new[ab->len], s, len);
-    ab->b = new;
-    ab->len += len;
+void pwriteAll(int fd, const void * buf, size_t len, off_t offset) {
+    const char * p = (const char *) buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) die("pwrite");
+        p += n;
+        len -= n;
+        offset += n;
+    }
 }
 
-void drawScreen(tron * this){
-    struct abuf ab = ABUF_INIT;
-    abAppend(&ab, "\x1b[?25l", 6); //hide cursor
+int runSelfPlay(options * opts) {
+    int fd = open(opts->selfPlayFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) die("open");
 
-    // draw board
-    abAppend(&ab, "\x1b[H", 3);
-    for (int i = 0; i < this->boardRows; i++) {
-        for (int j = 0; j < this->boardCols; j++) {
-            char charToPrint = this->gameBoard[i][j];
-            switch (charToPrint) {
-                case '1':
-                    abAppend(&ab, this->player1.alive ? "\x1b[36m" : "\x1b[31m", 5); // cyan
-                    abAppend(&ab, this->player1.alive ? "1" : "X", 1);
-                    abAppend(&ab, "\x1b[m", 3);
-                    break;
-                case 'B':
-                    abAppend(&ab, "\x1b[7;36m", 7);
-                    abAppend(&ab, " ", 1);
-                    abAppend(&ab, "\x1b[m", 3);
-                    break;
-                case '2':
-                    abAppend(&ab, this->player2.alive ? "\x1b[33m" : "\x1b[31m", 5); // yellow
-                    abAppend(&ab, this->player2.alive ? "2" : "X", 1);
-                    abAppend(&ab, "\x1b[m", 3);
-                    break;
-                case 'Y':
-                    abAppend(&ab, "\x1b[7;33m", 7);
-                    abAppend(&ab, " ", 1);
-                    abAppend(&ab, "\x1b[m", 3);
-                    break;
-                default:
-                    abAppend(&ab, &charToPrint, 1);
-                    break;
-            }
-        }
+    selfPlayWriter out;
+    out.fd = fd;
+    atomic_init(&out.nextOffset, (long) sizeof(selfPlayHeader));
+    atomic_init(&out.nextSample, 0);
+    out.index = (uint64_t *) calloc(opts->games, sizeof(uint64_t));
+    if (out.index == NULL) die("malloc");
 
-        // Potential message overlay
-        if (this->curState != IN_GAME && i == this->boardRows / 3) {
-            abAppend(&ab, "\r", 1);
-            char message[80];
-            int msgLen = 0;
-            switch (this->curState) {
-                case START_SCREEN:
-                    msgLen = snprintf(message, sizeof(message), "Michael's Tron -- ver %s(start by pressing 1/2 to select # of player)", MICHAEL_TRON_VER);
-                    break;
-                case PLAYER1_WIN:
-                    msgLen = snprintf(message, sizeof(message), "\x1b[36mPlayer 1 Win \x1b[0m(restart by pressing 1/2 to select # of player)");
-                    break;
-                case PLAYER2_WIN:
-                    msgLen = snprintf(message, sizeof(message), "\x1b[33mPlayer 2 Win \x1b[0m(restart by pressing 1/2 to select # of player)");
-                    break;
-                case DRAW:
-                    msgLen = snprintf(message, sizeof(message), "\x1b[32mDraw \x1b[0m(restart by pressing 1/2 to select # of player)");
-                    break;
-            }
-            
-            int padding = (this->boardCols - msgLen) / 2;
-            for (int z = padding; z > 0; z--) abAppend(&ab, " ", 1);
+    atomic_int nextMatch = 0;
+    selfPlayWorker * workers = (selfPlayWorker *) calloc(opts->threads, sizeof(selfPlayWorker));
+    if (workers == NULL) die("malloc");
+    transTable * tt = ttInit(opts->ttMb);
 
-            if (msgLen > this->boardCols) msgLen = this->boardCols;
-            abAppend(&ab, message, msgLen);
-        }
-        
-        abAppend(&ab, "\x1b[K", 3);  // clear line right of cursor (optional in our case)
-        abAppend(&ab, "\r\n", 2);
+    uint64_t start = nowNs();
+    for (int i = 0; i < opts->threads; i++) {
+        workers[i].opts = opts;
+        workers[i].nextMatch = &nextMatch;
+        workers[i].out = &out;
+        workers[i].tt = tt;
+        if (pthread_create(&workers[i].thread, NULL, selfPlayWorkerMain, &workers[i]) != 0) die("pthread_create");
     }
-    // Instructions
-    abAppend(&ab, "\x1b[7m", 4); // invert color
-    char * instruction = this->singlePlayer? "Player 1: WASD | Player 2: Computer | Ctrl-Q to quit" : 
-                                                "Player 1: WASD | Player 2: Arrow keys | Ctrl-Q to quit";
-    int instLen = strlen(instruction);
-    abAppend(&ab, instruction, instLen > this->boardCols ? this->boardCols : instLen);
-    abAppend(&ab, "\x1b[m", 3); // invert color
+    for (int i = 0; i < opts->threads; i++) pthread_join(workers[i].thread, NULL);
+
+    // the header goes in last, a file cut short by a crash says it holds nothing
+    selfPlayHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SELFPLAY_MAGIC, 4);
+    header.version = SELFPLAY_VERSION;
+    header.rows = (uint32_t) opts->rows;
+    header.cols = (uint32_t) opts->cols;
+    header.numGames = (uint64_t) opts->games;
+    header.numSamples = (uint64_t) atomic_load(&out.nextSample);
+    header.indexOffset = (uint64_t) atomic_load(&out.nextOffset);
+    pwriteAll(fd, out.index, sizeof(uint64_t) * opts->games, (off_t) header.indexOffset);
+    pwriteAll(fd, &header, sizeof(header), 0);
+    if (close(fd) == -1) die("close");
+    double elapsed = (nowNs() - start) / 1e9;
 
-    write(STDOUT_FILENO, ab.b, ab.len);
-    abFree(&ab);
+    double megabytes = (header.indexOffset + sizeof(uint64_t) * opts->games) / 1e6;
+    size_t chunkBytes = 0;
+    for (int i = 0; i < opts->threads; i++) chunkBytes += workers[i].chunkPeak;
+    printf("selfplay: %s vs %s on %dx%d, %d games, seed %u, %d threads\n", engineName(opts->p1), engineName(opts->p2),
+           opts->rows, opts->cols, opts->games, opts->seed, opts->threads);
+    printf("wrote %llu samples to %s, %.1f MB (%.1f bytes per sample with the boards) in %.3f s\n",
+           (unsigned long long) header.numSamples, opts->selfPlayFile, megabytes,
+           megabytes * 1e6 / (header.numSamples > 0 ? header.numSamples : 1), elapsed);
+    printf("throughput: %.2f million samples/min, %.1f MB/s, %.1f MB of chunk buffers\n",
+           header.numSamples / elapsed * 60.0 / 1e6, megabytes / elapsed, (double) chunkBytes / 1e6);
+
+    free(workers);
+    free(out.index);
+    if (tt != NULL) {
+        free(tt->slots);
+        free(tt);
+    }
+    return 0;
 }
 
 /*** terminal ***/
@@ -589,7 +7076,7 @@ void enableRawMode() {
     raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
 
     raw.c_cc[VMIN] = 0;
-    raw.c_cc[VTIME] = 1;    // adds a timeout to read (in 0.1s)
+    raw.c_cc[VTIME] = 0;    // never block in read, gameLoop polls for input
 
     if(tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) { // TCSAFLUCH defines how the change is applied
         die("tcsetattr"); 
@@ -611,102 +7098,213 @@ void die(const char* s) { //error handling
     exit(1);
 }
 
-int readKey(void) {
-    int nread;
-    char c;
-
-    nread = read(STDIN_FILENO, &c, 1);
-    if(nread == -1 && errno != EAGAIN) die("read");
-    else if (nread != 1) return '\0';
+// One read() for everything the terminal has for us, and every complete key in it. Returns
+// how many went into keys, which needs room for KEY_READ_SIZE + 1.
+int readKeys(keyParser * kp, int fd, int * keys) {
+    uint8_t buf[KEY_READ_SIZE];
+    int n = read(fd, buf, sizeof(buf));
+    kp->reads++;
+    if (n == -1 && errno != EAGAIN && errno != EINTR) die("read");
+    if (n <= 0) return 0;
+    return keyParserFeed(kp, buf, n, keys);
+}
 
-    if (c == '\x1b') {
-        char seq[5];
-        if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-        
-        switch(seq[0]) {
-            case 's': return ALT_S;
-            case 'f': return ALT_F;
-        }
-
-        if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
-
-        if (seq[0] == '[') {
-            if (seq[1] >= '0' && seq[1] <= '9') {
-                if (read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b';
-                if (seq[2] == '~') {
-                    switch (seq[1]) {
-                        case '1': return HOME_KEY;
-                        case '3': return DEL_KEY;
-                        case '4': return END_KEY;
-                        case '5': return PAGE_UP;
-                        case '6': return PAGE_DOWN;
-                        case '7': return HOME_KEY;
-                        case '8': return END_KEY;
-                    }
+// Runs bytes through the state machine. A byte can finish at most one key, except one that
+// breaks off a bare ESC: the ESC comes out first and the byte is taken again from scratch.
+int keyParserFeed(keyParser * kp, const uint8_t * bytes, int n, int * keys) {
+    int numKeys = 0;
+    keyState state = kp->state; // a local, keys could alias kp as far as the compiler knows
+    for (int i = 0; i < n; i++) {
+        uint8_t c = bytes[i];
+        switch (state) {
+            case KEY_GROUND:
+                if (c == '\x1b') state = KEY_ESC;
+                else keys[numKeys++] = c;
+                break;
+            case KEY_ESC:
+                if (c == '[') {
+                    state = KEY_CSI;
+                    kp->numParams = 0;
+                    memset(kp->params, 0, sizeof(kp->params));
                 }
-                else if (seq[2] == ';') {
-                    if (read(STDIN_FILENO, &seq[3], 2) != 2) return '\x1b'; //this means something went wrong
-                    if (seq[3] == '5') { //ctrl key pressed, seq is esc[1;5C, C is from arrow key, 1 is unchanged default keycode (used by page up/down and delete), 5 is modifier meaning ctrl
-                                        //https://en.wikipedia.org/wiki/ANSI_escape_code#:~:text=0%3B%0A%7D-,Terminal%20input%20sequences,-%5Bedit%5D
-                        switch (seq[4]) {
-                            case 'A': return CTRL_UP;
-                            case 'B': return CTRL_DOWN;
-                            case 'C': return CTRL_RIGHT;
-                            case 'D': return CTRL_LEFT;
-                        }
-                    }
+                else if (c == 'O' || c == '0') {
+                    state = KEY_SS3;
+                    kp->intro = c;
                 }
-                else if (read(STDIN_FILENO, &seq[3], 1) == 1) {
-                    if (seq[3] == '~' && seq[1] == '1') {
-                        switch (seq[2]) {
-                            case '5': return F5_FUNCTION_KEY;
-                            case '7': return F6_FUNCTION_KEY;
-                            case '8': return F7_FUNCTION_KEY;
-                            case '9': return F8_FUNCTION_KEY;
-                        }
-                    }
-                    else if (seq[3] == '~' && seq[1] == '2' && seq[2] == '0') {
-                        return F9_FUNCTION_KEY;
-                    }
+                else if (c == 's' || c == 'f') {
+                    keys[numKeys++] = c == 's' ? ALT_S : ALT_F;
+                    state = KEY_GROUND;
                 }
-            }
-            else {
-                switch (seq[1]) {
-                    case 'A': return ARROW_UP;
-                    case 'B': return ARROW_DOWN;
-                    case 'C': return ARROW_RIGHT;
-                    case 'D': return ARROW_LEFT;
-                    case 'H': return HOME_KEY;
-                    case 'F': return END_KEY;
+                else if (c == '\x1b') keys[numKeys++] = '\x1b'; // Esc Esc, the second may still start something
+                else {
+                    keys[numKeys++] = '\x1b';
+                    state = KEY_GROUND;
+                    i--; // not a sequence after all, the byte is a key of its own
                 }
-            }
-        }
-        else if (seq[0] == '0') {
-            switch (seq[1]) {
-                case 'H': return HOME_KEY;
-                case 'F': return END_KEY;
-            }
+                break;
+            case KEY_CSI:
+                if (c >= '0' && c <= '9') {
+                    if (kp->numParams == 0) kp->numParams = 1;
+                    int * param = &kp->params[kp->numParams - 1];
+                    if (kp->numParams <= KEY_MAX_PARAMS && *param < 1000) *param = *param * 10 + (c - '0');
+                }
+                else if (c == ';') {
+                    if (kp->numParams == 0) kp->numParams = 1;
+                    if (kp->numParams < KEY_MAX_PARAMS) kp->numParams++;
+                    else kp->numParams = KEY_MAX_PARAMS + 1; // too many to mean anything to us
+                }
+                else if (c >= 0x40 && c <= 0x7e) { // final byte
+                    keys[numKeys++] = keyDecodeCsi(kp, c);
+                    state = KEY_GROUND;
+                }
+                break; // anything else is an intermediate byte, ignored
+            case KEY_SS3:
+                keys[numKeys++] = keyDecodeSs3(kp->intro, c);
+                state = KEY_GROUND;
+                break;
         }
-        else if (seq[0] == 'O') {
-            switch (seq[1]) {
-                case 'P': return F1_FUNCTION_KEY;
-                case 'Q': return F2_FUNCTION_KEY;
-                case 'R': return F3_FUNCTION_KEY;
-                case 'S': return F4_FUNCTION_KEY;
-                case 't': return F5_FUNCTION_KEY;
-                case 'u': return F6_FUNCTION_KEY;
-                case 'v': return F7_FUNCTION_KEY;
-                case 'l': return F8_FUNCTION_KEY;
-                case 'w': return F9_FUNCTION_KEY;
-                case 'x': return F10_FUNCTION_KEY;
+    }
+    kp->state = state;
+    kp->keys += numKeys;
+    return numKeys;
+}
+
+// nothing came after an ESC in time, whatever was started is dropped and the Esc stands alone
+int keyParserFlush(keyParser * kp, int * keys) {
+    if (kp->state == KEY_GROUND) return 0;
+    kp->state = KEY_GROUND;
+    keys[0] = '\x1b';
+    kp->keys++;
+    return 1;
+}
+
+// ESC [ params final, unknown ones come out as a bare Esc which nothing binds
+int keyDecodeCsi(keyParser * kp, char final) {
+    int first = kp->numParams > 0 ? kp->params[0] : 0;
+    int modifier = kp->numParams == 2 ? kp->params[1] : 1;
+    if (kp->numParams > KEY_MAX_PARAMS) return '\x1b';
+
+    switch (final) {
+        case 'A': return modifier == 5 ? CTRL_UP : ARROW_UP; // 5 is Ctrl, ESC [ 1 ; 5 A
+        case 'B': return modifier == 5 ? CTRL_DOWN : ARROW_DOWN;
+        case 'C': return modifier == 5 ? CTRL_RIGHT : ARROW_RIGHT;
+        case 'D': return modifier == 5 ? CTRL_LEFT : ARROW_LEFT;
+        case 'H': return HOME_KEY;
+        case 'F': return END_KEY;
+        case '~':
+            switch (first) {
+                case 1: return HOME_KEY;
+                case 3: return DEL_KEY;
+                case 4: return END_KEY;
+                case 5: return PAGE_UP;
+                case 6: return PAGE_DOWN;
+                case 7: return HOME_KEY;
+                case 8: return END_KEY;
+                case 15: return F5_FUNCTION_KEY;
+                case 17: return F6_FUNCTION_KEY;
+                case 18: return F7_FUNCTION_KEY;
+                case 19: return F8_FUNCTION_KEY;
+                case 20: return F9_FUNCTION_KEY;
             }
-        }
+            break;
+    }
+    return '\x1b';
+}
 
+int keyDecodeSs3(char intro, char final) {
+    if (intro == '0') {
+        switch (final) {
+            case 'H': return HOME_KEY;
+            case 'F': return END_KEY;
+        }
         return '\x1b';
     }
-    else {
-        return c;
+    switch (final) {
+        case 'A': return ARROW_UP; // arrows in application cursor mode
+        case 'B': return ARROW_DOWN;
+        case 'C': return ARROW_RIGHT;
+        case 'D': return ARROW_LEFT;
+        case 'H': return HOME_KEY;
+        case 'F': return END_KEY;
+        case 'P': return F1_FUNCTION_KEY;
+        case 'Q': return F2_FUNCTION_KEY;
+        case 'R': return F3_FUNCTION_KEY;
+        case 'S': return F4_FUNCTION_KEY;
+        case 't': return F5_FUNCTION_KEY;
+        case 'u': return F6_FUNCTION_KEY;
+        case 'v': return F7_FUNCTION_KEY;
+        case 'l': return F8_FUNCTION_KEY;
+        case 'w': return F9_FUNCTION_KEY;
+        case 'x': return F10_FUNCTION_KEY;
+    }
+    return '\x1b';
+}
+
+// --bench-keys: a seeded stream of letters, arrows and the odd Ctrl/F key goes through a
+// pipe in bursts cut at random points, so sequences get split between reads. Every key that
+// comes out is checked, then the state machine alone is timed on the same bytes.
+int runKeyBench(options * opts) {
+    enum { BENCH_KEYS = 1 << 18, MAX_BURST = 24, PARSE_ROUNDS = 16 };
+    static const char * const samples[] = {"w", "a", "s", "d", " ", "\x1b[A", "\x1b[B", "\x1b[C", "\x1b[D",
+                                           "\x1b[1;5C", "\x1bOA", "\x1b[15~", "\x1bOP", "\x1b[3~"};
+    static const int sampleKeys[] = {'w', 'a', 's', 'd', ' ', ARROW_UP, ARROW_DOWN, ARROW_RIGHT, ARROW_LEFT,
+                                     CTRL_RIGHT, ARROW_UP, F5_FUNCTION_KEY, F1_FUNCTION_KEY, DEL_KEY};
+    enum { NUM_SAMPLES = sizeof(sampleKeys) / sizeof(sampleKeys[0]) };
+
+    tron dice; // only for tronRand
+    dice.rngState = opts->seed;
+    uint8_t * stream = (uint8_t *) malloc(BENCH_KEYS * 8);
+    int * expected = (int *) malloc(sizeof(int) * BENCH_KEYS);
+    if (stream == NULL || expected == NULL) die("malloc");
+    int bytes = 0;
+    for (int i = 0; i < BENCH_KEYS; i++) {
+        int pick = tronRand(&dice) % (NUM_SAMPLES * 2); // half plain letters, like real play
+        if (pick >= NUM_SAMPLES) pick %= 5;
+        int len = strlen(samples[pick]);
+        memcpy(&stream[bytes], samples[pick], len);
+        bytes += len;
+        expected[i] = sampleKeys[pick];
     }
+
+    int pipeFds[2];
+    if (pipe(pipeFds) == -1) die("pipe");
+    keyParser kp;
+    memset(&kp, 0, sizeof(kp));
+    int keys[KEY_READ_SIZE + 1];
+    long decoded = 0, mismatches = 0, bursts = 0;
+    for (int sent = 0; sent < bytes; bursts++) {
+        int burst = 1 + tronRand(&dice) % MAX_BURST;
+        if (burst > bytes - sent) burst = bytes - sent;
+        if (writeAll(pipeFds[1], (const char *) &stream[sent], burst) != burst) die("write");
+        sent += burst;
+        int numKeys = readKeys(&kp, pipeFds[0], keys);
+        for (int k = 0; k < numKeys; k++, decoded++) {
+            if (decoded >= BENCH_KEYS || keys[k] != expected[decoded]) mismatches++;
+        }
+    }
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+    if (decoded != BENCH_KEYS) mismatches += labs(BENCH_KEYS - decoded);
+    long reads = kp.reads;
+
+    long parsed = 0;
+    memset(&kp, 0, sizeof(kp));
+    uint64_t t0 = nowNs();
+    for (int r = 0; r < PARSE_ROUNDS; r++) {
+        for (int off = 0; off < bytes; off += KEY_READ_SIZE) {
+            int n = bytes - off < KEY_READ_SIZE ? bytes - off : KEY_READ_SIZE;
+            parsed += keyParserFeed(&kp, &stream[off], n, keys);
+        }
+    }
+    double parseNs = (double) (nowNs() - t0);
+
+    printf("keys: %d keys in %d bytes, %ld bursts of 1-%d bytes, seed %u\n", BENCH_KEYS, bytes, bursts, MAX_BURST, opts->seed);
+    printf("  readKeys         %6.3f read() per key  (byte at a time would take %.3f), %ld mismatches\n",
+           (double) reads / BENCH_KEYS, (double) (bytes + bursts) / BENCH_KEYS, mismatches);
+    printf("  keyParserFeed    %6.2f ns per key  %.0f MB/s\n", parseNs / parsed, (double) bytes * PARSE_ROUNDS / parseNs * 1e3);
+    free(stream);
+    free(expected);
+    return mismatches == 0 ? 0 : 1;
 }
 
 int getWindowSize (int* rows, int* cols) {
@@ -735,5 +7333,6 @@ int getCursorPosition(int* rows, int* cols) {
 
     if (buf[0] != '\x1b' || buf[1] != '[') return -1;
     if (sscanf(&buf[2], "%d;%d", rows, cols) !=2) return -1;
+    return 0;
 }
 